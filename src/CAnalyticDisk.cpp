@@ -0,0 +1,149 @@
+/*
+ * CAnalyticDisk.cpp
+ *
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+
+#include "CAnalyticDisk.h"
+
+#ifndef PI
+#ifdef M_PI
+#define PI M_PI
+#else
+#define PI 3.1415926535897932384626433832795028841968
+#endif // M_PI
+#endif // PI
+
+/// Milliarcseconds to radians
+static const double sMasToRad = PI / (180.0 * 3600.0 * 1000.0);
+
+/// Returns Gamma(nu + 1) (2 / z)^nu J_nu(z) for nu > 0 and z > 0.  J is computed by Miller's
+/// backward recurrence, J_{m-1}(z) = (2 m / z) J_m(z) - J_{m+1}(z), started well above z and
+/// normalized with the Neumann series
+///   (z / 2)^nu = sum_k (nu + 2k) Gamma(nu + k) / k! J_{nu+2k}(z)
+/// which gives the result directly (without Gamma or pow).
+static double BesselLambda(double nu, double z)
+{
+	const int m_start = 2 * int((z + 8 * sqrt(z) + 20) / 2);
+
+	// g = Gamma(nu + k) / (k! Gamma(nu + 1)) for k = m / 2.
+	double g = 1 / nu;
+	for(int k = 1; k <= m_start / 2; k++)
+		g *= (nu + k - 1) / k;
+
+	double j_up = 0;
+	double j = 1E-30;
+	double j_down;
+	double sum = 0;
+	for(int m = m_start; m > 0; m--)
+	{
+		if(m % 2 == 0)
+		{
+			sum += (nu + m) * g * j;
+			g *= (m / 2) / (nu + m / 2 - 1);
+		}
+
+		j_down = 2 * (nu + m) / z * j - j_up;
+		j_up = j;
+		j = j_down;
+
+		// Rescale to avoid overflow, only the ratio is needed.
+		if(fabs(j) > 1E250)
+		{
+			j *= 1E-250;
+			j_up *= 1E-250;
+			sum *= 1E-250;
+		}
+	}
+
+	// The k = 0 term, nu g j = j.
+	return j / (sum + j);
+}
+
+CAnalyticDisk::CAnalyticDisk()
+{
+	x = 0;
+	y = 0;
+	diameter = 0;
+	color = 0;
+}
+
+CAnalyticDisk::~CAnalyticDisk()
+{
+
+}
+
+/// Adds the term coefficient * mu^exponent to the intensity profile.
+void CAnalyticDisk::AddTerm(double exponent, double coefficient)
+{
+	if(coefficient == 0)
+		return;
+
+	mExponents.push_back(exponent);
+	mCoefficients.push_back(coefficient);
+}
+
+/// Returns the flux of the disk in (intensity) * mas^2.
+/// The integral of mu^a over a disk of radius R is 2 pi R^2 / (a + 2).
+double CAnalyticDisk::GetFlux() const
+{
+	const double radius = diameter / 2;
+	double flux = 0;
+	for(unsigned int k = 0; k < mExponents.size(); k++)
+		flux += mCoefficients[k] * 2 * PI * radius * radius / (mExponents[k] + 2);
+
+	return color * flux;
+}
+
+/// Computes the visibility, scaled by the flux, at (u,v) (in wavelengths).  The phase
+/// follows the same convention as the image DFT, exp(-2 pi i (u x + v y)).
+/// Each term mu^a contributes (Hestroffer 1997)
+///   V(z) = Gamma(nu + 1) (2 / z)^nu J_nu(z),  nu = a / 2 + 1,  z = pi diameter r_uv
+void CAnalyticDisk::GetVisibility(double u, double v, double & re, double & im) const
+{
+	const double radius = diameter / 2;
+	const double z = PI * diameter * sMasToRad * sqrt(u * u + v * v);
+	double amp = 0;
+	double term;
+
+	for(unsigned int k = 0; k < mExponents.size(); k++)
+	{
+		term = 1;
+		if(z > 1E-8)
+			term = BesselLambda(mExponents[k] / 2 + 1, z);
+
+		amp += mCoefficients[k] * 2 * PI * radius * radius / (mExponents[k] + 2) * term;
+	}
+
+	amp *= color;
+
+	const double phase = -2 * PI * (u * x + v * y) * sMasToRad;
+	re = amp * cos(phase);
+	im = amp * sin(phase);
+}
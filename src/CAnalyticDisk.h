@@ -0,0 +1,67 @@
+/*
+ * CAnalyticDisk.h
+ *
+ *  A limb-darkened disk on the sky whose visibility has a closed form.  Models which
+ *  can be described this way (see CModel::GetAnalyticDisk) are evaluated without
+ *  rendering an image.
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CANALYTICDISK_H_
+#define CANALYTICDISK_H_
+
+#include <vector>
+
+using namespace std;
+
+/// The intensity profile is a sum of power laws in mu = cos(theta):
+///   I(mu) = color * sum_k coefficient[k] * mu^exponent[k]
+/// which covers the uniform disk and the power law, quadratic, square root and
+/// Claret (2000) limb darkening laws.
+class CAnalyticDisk
+{
+public:
+	double x;			// position on the sky (image coordinates), mas
+	double y;
+	double diameter;	// mas
+	double color;
+
+protected:
+	vector<double> mExponents;
+	vector<double> mCoefficients;
+
+public:
+	CAnalyticDisk();
+	virtual ~CAnalyticDisk();
+
+	void AddTerm(double exponent, double coefficient);
+
+	double GetFlux() const;
+	void GetVisibility(double u, double v, double & re, double & im) const;
+};
+
+#endif /* CANALYTICDISK_H_ */
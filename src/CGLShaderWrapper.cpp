@@ -33,6 +33,7 @@
 #include "CGLShader.h"
 #include "CGLShaderWrapper.h"
 #include "CModel.h"
+#include "CRasterizer.h"
 
 CGLShaderWrapper::CGLShaderWrapper(CGLShaderPtr shader, int n_params)
 	: CParameters(n_params)
@@ -63,3 +64,10 @@ void CGLShaderWrapper::UseShader(double min_xyz[3], double max_xyz[3])
 	if(mShader != NULL)
 		mShader->UseShader(min_xyz, max_xyz, mParams, mNParams);
 }
+
+// Selects the equivalent CPU shader in the software rasterizer
+void CGLShaderWrapper::UseShader(CRasterizer * rasterizer, double min_xyz[3], double max_xyz[3])
+{
+	if(mShader != NULL)
+		rasterizer->UseShader(mShader->GetType(), mParams, mNParams, min_xyz, max_xyz);
+}
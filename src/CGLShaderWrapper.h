@@ -43,6 +43,8 @@ using namespace std;
 
 typedef shared_ptr<CGLShader> CGLShaderPtr;
 
+class CRasterizer;
+
 class CGLShaderWrapper : public CParameters
 {
 protected:
@@ -55,6 +57,7 @@ public:
 	CGLShaderList::ShaderTypes GetType() { return mShader->GetType(); };
 
 	void UseShader(double min_xyz[3], double max_xyz[3]);
+	void UseShader(CRasterizer * rasterizer, double min_xyz[3], double max_xyz[3]);
 };
 
 #endif /* CGLSHADERWRAPPER_H_ */
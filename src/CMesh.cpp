@@ -0,0 +1,140 @@
+/*
+ * CMesh.cpp
+ *
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+
+#include "CMesh.h"
+
+CMesh::CMesh()
+{
+	mVertexBuffer = 0;
+	mIndexBuffer = 0;
+	mUploaded = false;
+}
+
+CMesh::~CMesh()
+{
+	if(mVertexBuffer != 0)
+		glDeleteBuffers(1, &mVertexBuffer);
+	if(mIndexBuffer != 0)
+		glDeleteBuffers(1, &mIndexBuffer);
+}
+
+/// Appends the triangles of a GL_QUAD_STRIP made from the n_vertices vertices starting at first.
+void CMesh::AddQuadStrip(GLuint first, unsigned int n_vertices)
+{
+	// Same triangulation as CRasterizer::End
+	for(GLuint i = first; i + 3 < first + n_vertices; i += 2)
+	{
+		mIndices.push_back(i);
+		mIndices.push_back(i + 1);
+		mIndices.push_back(i + 2);
+		mIndices.push_back(i + 1);
+		mIndices.push_back(i + 3);
+		mIndices.push_back(i + 2);
+	}
+
+	mUploaded = false;
+}
+
+/// Appends a vertex, returns its index.
+GLuint CMesh::AddVertex(double x, double y, double z, double nx, double ny, double nz, double red, double alpha)
+{
+	mVertices.push_back(x);
+	mVertices.push_back(y);
+	mVertices.push_back(z);
+	mNormals.push_back(nx);
+	mNormals.push_back(ny);
+	mNormals.push_back(nz);
+	mColors.push_back(red);
+	mColors.push_back(0);
+	mColors.push_back(0);
+	mColors.push_back(alpha);
+
+	mUploaded = false;
+	return GetNVertices() - 1;
+}
+
+/// Removes all geometry.
+void CMesh::Clear()
+{
+	mVertices.clear();
+	mNormals.clear();
+	mColors.clear();
+	mIndices.clear();
+	mUploaded = false;
+}
+
+/// Draws the mesh using OpenGL.  The arrays are copied to buffers on the GPU when they
+/// have changed, so unchanged meshes are drawn without transferring any geometry.
+void CMesh::Render()
+{
+	if(mIndices.size() == 0)
+		return;
+
+	const unsigned int n_vertices = GetNVertices();
+	const GLsizeiptr vertex_bytes = 3 * n_vertices * sizeof(GLfloat);
+	const GLsizeiptr color_bytes = 4 * n_vertices * sizeof(GLfloat);
+
+	if(mVertexBuffer == 0)
+		glGenBuffers(1, &mVertexBuffer);
+	if(mIndexBuffer == 0)
+		glGenBuffers(1, &mIndexBuffer);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+
+	if(!mUploaded)
+	{
+		// Vertices, normals, then colors in a single buffer.
+		glBufferData(GL_ARRAY_BUFFER, 2 * vertex_bytes + color_bytes, NULL, GL_STATIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, vertex_bytes, &mVertices[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, vertex_bytes, vertex_bytes, &mNormals[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, 2 * vertex_bytes, color_bytes, &mColors[0]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(GLuint), &mIndices[0], GL_STATIC_DRAW);
+		mUploaded = true;
+	}
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, (const GLvoid *) 0);
+	glNormalPointer(GL_FLOAT, 0, (const GLvoid *) vertex_bytes);
+	glColorPointer(4, GL_FLOAT, 0, (const GLvoid *) (2 * vertex_bytes));
+
+	glDrawElements(GL_TRIANGLES, mIndices.size(), GL_UNSIGNED_INT, (const GLvoid *) 0);
+
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
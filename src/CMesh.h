@@ -0,0 +1,74 @@
+/*
+ * CMesh.h
+ *
+ *  Triangle geometry stored in vertex/index arrays so that models can build their
+ *  geometry once and draw it with a few calls (see CModel::DrawMesh).
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMESH_H_
+#define CMESH_H_
+
+#include <GL/gl.h>
+#include <vector>
+
+using namespace std;
+
+class CMesh
+{
+protected:
+	// Per-vertex attributes, stored interleaved by attribute as OpenGL expects them.
+	vector<GLfloat> mVertices;	// x, y, z
+	vector<GLfloat> mNormals;	// x, y, z
+	vector<GLfloat> mColors;	// red, green, blue, alpha
+	vector<GLuint> mIndices;	// triangles
+
+	// OpenGL buffers, created when the mesh is first rendered.
+	GLuint mVertexBuffer;
+	GLuint mIndexBuffer;
+	bool mUploaded;
+
+public:
+	CMesh();
+	virtual ~CMesh();
+
+	GLuint AddVertex(double x, double y, double z, double nx, double ny, double nz, double red, double alpha);
+	void AddQuadStrip(GLuint first, unsigned int n_vertices);
+
+	void Clear();
+
+	const GLfloat * GetColors() const { return &mColors[0]; };
+	const GLuint * GetIndices() const { return &mIndices[0]; };
+	unsigned int GetNIndices() const { return mIndices.size(); };
+	unsigned int GetNVertices() const { return mVertices.size() / 3; };
+	const GLfloat * GetNormals() const { return &mNormals[0]; };
+	const GLfloat * GetVertices() const { return &mVertices[0]; };
+
+	void Render();
+};
+
+#endif /* CMESH_H_ */
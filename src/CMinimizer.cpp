@@ -42,6 +42,9 @@
 #include "CMinimizer_levmar.h"
 #include "CMinimizer_GridSearch.h"
 #include "CMinimizer_Bootstrap.h"
+#include "CMinimizer_Ensemble.h"
+#include "CMinimizer_Evolution.h"
+#include "CMinimizer_MultiStart.h"
 
 CMinimizer::CMinimizer(CCL_GLThread * cl_gl_thread)
 {
@@ -88,6 +91,7 @@ void CMinimizer::ExportResults(double * params, int n_params, bool no_setparams)
 			printf("%i: %e \n", i, params[i]);
 
 		mCLThread->SetFreeParameters(params, n_params, true);
+		mCLThread->EnqueueOperation(GLT_RenderModels);
 	}
 
 	mCLThread->ExportResults(mSaveFileBasename);
@@ -116,6 +120,18 @@ CMinimizer * CMinimizer::GetMinimizer(CMinimizer::MinimizerTypes type, CCL_GLThr
 		tmp = new CMinimizer_Bootstrap(cl_gl_thread);
 		break;
 
+	case ENSEMBLE:
+		tmp = new CMinimizer_Ensemble(cl_gl_thread);
+		break;
+
+	case MULTISTART:
+		tmp = new CMinimizer_MultiStart(cl_gl_thread);
+		break;
+
+	case EVOLUTION:
+		tmp = new CMinimizer_Evolution(cl_gl_thread);
+		break;
+
 	default:
 	case BENCHMARK:
 		tmp = new CMinimizer_Benchmark(cl_gl_thread);
@@ -137,6 +153,9 @@ vector< pair<CMinimizer::MinimizerTypes, string> > CMinimizer::GetTypes(void)
 	tmp.push_back(pair<CMinimizer::MinimizerTypes, string> (CMinimizer::LEVMAR, "Levmar"));
 	tmp.push_back(pair<CMinimizer::MinimizerTypes, string> (CMinimizer::GRIDSEARCH, "Grid Search"));
 	tmp.push_back(pair<CMinimizer::MinimizerTypes, string> (CMinimizer::BOOTSTRAP, "Bootstrap (Levmar)"));
+	tmp.push_back(pair<CMinimizer::MinimizerTypes, string> (CMinimizer::ENSEMBLE, "Ensemble MCMC"));
+	tmp.push_back(pair<CMinimizer::MinimizerTypes, string> (CMinimizer::MULTISTART, "Multi-start (Levmar)"));
+	tmp.push_back(pair<CMinimizer::MinimizerTypes, string> (CMinimizer::EVOLUTION, "Differential Evolution"));
 	return tmp;
 }
 
@@ -68,6 +68,9 @@ public:
 		MULTINEST = 3,
 		GRIDSEARCH = 4,
 		BOOTSTRAP = 5,
+		ENSEMBLE = 6,
+		MULTISTART = 7,
+		EVOLUTION = 8,
 		LAST_VALUE	// this must always be the last value in this enum.
 	};
 
@@ -85,7 +85,7 @@ int CMinimizer_Benchmark::run()
 	for(int i = 0; i < n_iterations && mRun; i++)
 	{
 		mCLThread->SetTime(mCLThread->GetDataAveJD(0));
-		mCLThread->EnqueueOperation(GLT_RenderModels);
+		mCLThread->EnqueueOperation(GLT_RenderOffscreen);
 		chi2r = mCLThread->GetChi2(0) / (nData - mNParams - 1);
 
 		if(i % 100 == 0)
@@ -35,14 +35,19 @@
 #include <random>
 #include <chrono>
 #include <stdexcept>
+#include <string>
 
 #include "levmar.h"
+#ifdef LINSOLVERS_RETAIN_MEMORY
+#error "Concurrent fits require levmar built with LINSOLVERS_RETAIN_MEMORY off (re-run cmake)."
+#endif
 #include "CCL_GLThread.h"
 #include "oi_tools.hpp"
 #include "CUniformDisk.h"
 
 using namespace std;
 
+bool CMinimizer_Bootstrap::mDefaultResume = false;
 
 CMinimizer_Bootstrap::CMinimizer_Bootstrap(CCL_GLThread * cl_gl_thread)
 : CMinimizer_levmar(cl_gl_thread)
@@ -50,13 +55,54 @@ CMinimizer_Bootstrap::CMinimizer_Bootstrap(CCL_GLThread * cl_gl_thread)
 	mType = CMinimizer::BOOTSTRAP;
 	mResiduals = NULL;
 
-	mBootstrapFailures = 0;
 	mMaxBootstrapFailures = 20;
+	mUseWeights = false;
+	mSeed = std::chrono::system_clock::now().time_since_epoch().count();
+	mNReplicas = 10000;
+	mResume = mDefaultResume;
+	mMaxQueued = 2;
+	mProduce = false;
+	mNFits = 2;
 }
 
 CMinimizer_Bootstrap::~CMinimizer_Bootstrap()
 {
+	StopProducer();
 
+	for(auto fitter : mFitters)
+		delete fitter;
+}
+
+/// Loads replica into weight set weight_set (or replaces the loaded data).  Returns false
+/// if the replica could not be used.
+bool CMinimizer_Bootstrap::ApplyReplica(Replica & replica, unsigned int weight_set)
+{
+	if(replica.error)
+		rethrow_exception(replica.error);
+
+	if(mUseWeights)
+	{
+		for(unsigned int data_set = 0; data_set < replica.weights.size(); data_set++)
+			mCLThread->SetDataWeights(data_set, weight_set, replica.weights[data_set], replica.scales[data_set]);
+
+		return true;
+	}
+
+	// Due to a bug in ccoifits the total data size may not be preserved, in which case the
+	// replica is discarded.
+	try
+	{
+		for(unsigned int i = 0; i < replica.data.size(); i++)
+			mCLThread->ReplaceData(i, replica.data[i]);
+	}
+	catch(length_error& l)
+	{
+		// Generate an error message on stderr.
+		cerr << " Warning: " << l.what() << " " << "Using the next bootstrapped data set." << endl;
+		return false;
+	}
+
+	return true;
 }
 
 ///
@@ -66,191 +112,452 @@ void CMinimizer_Bootstrap::ErrorFunc(double * params, double * output, int nPara
 	CMinimizer_levmar::ErrorFunc(params, output, nParams, nOutput, misc);
 }
 
-void CMinimizer_Bootstrap::ExportResults(double * params, int n_params, bool no_setparams)
+/// Fits replicas from the queue with mFitters[fitter_id] until they are exhausted or the
+/// minimizer is stopped.  Runs on its own thread, exceptions are stored in mFitErrors.
+void CMinimizer_Bootstrap::FitReplicas(unsigned int fitter_id)
 {
-	stringstream filename;
-	ofstream outfile;
-	double tmp[3];
-
-	// Open the statistics file for writing:
-	filename.str("");
-	filename << mSaveFileBasename << "_bootstrap.txt";
-	outfile.open(filename.str().c_str());
-	outfile.width(15);
-	outfile.precision(8);
-	outfile << "# Param1 Param2 ... ParamN Chi2/(nData - nParams - 1)" << endl;
-
-	// write the data to the file
-	WriteTable(mResults, outfile);
-	outfile.close();
-
-//	// now write out the masks
-//	filename.str("");
-//	filename << mResultsBaseFilename << "_bootstrap_mask.txt";
-//	outfile.open(filename.str().c_str());
-//	outfile.width(3);
-//	outfile.precision(0);
-//	outfile << "# Bootstrap masks on the data.  Each row is one mask designated by:" << endl;
-//	outfile << "# Data0 ... DataN" << endl;
-//	WriteTable(mMasks, outfile);
-//	outfile.close();
-
-	// Call the base class function to export the parameter names.
-	CMinimizer::ExportResults(params, n_params, no_setparams);
+	CMinimizer_levmar * fitter = mFitters[fitter_id];
+	unsigned int weight_set = (mUseWeights) ? fitter_id + 1 : 0;
+
+	// The maximum chi2r that will be accepted. Fits exceeding this value will be repeated.
+	double chi2_threshold = 10;
+	unsigned int failures = 0;
+	unsigned int chi2r_exceeded = 0;
+	double chi2r = 0;
+
+	uniform_real_distribution<double> distribution(0.0, 1.0);
+	vector<double> params(mNParams);
+	vector<float> residuals(mCLThread->GetNDataAllocated());
+	valarray<double> info;
+	valarray<double> covar;
+	Replica replica;
+
+	try
+	{
+		while(mRun && TakeReplica(replica))
+		{
+			if(!ApplyReplica(replica, weight_set))
+			{
+				failures += 1;
+				if(failures < mMaxBootstrapFailures)
+					continue;
+				else
+					throw runtime_error("Too many bootstrap data generation failures.");
+			}
+			failures = 0;
+
+			while(true)
+			{
+				// Randomize the starting position of the minimizer
+				for(int i = 0; i < mNParams; i++)
+					params[i] = mLowerBounds[i] + distribution(replica.generator) * (mUpperBounds[i] - mLowerBounds[i]);
+
+				fitter->Fit(&params[0], info, covar, &CMinimizer_Bootstrap::ErrorFunc);
+
+				// Interrupted fits are not recorded.
+				if(!mRun)
+					return;
+
+				// If the average reduced chi2 is too high automatically redo the fit
+				chi2r = GetChi2r(&params[0], weight_set, residuals);
+				if(chi2r <= chi2_threshold)
+					break;
+
+				cerr << " Average Chi2r = " << chi2r << " exceeds chi2_threshold = " << chi2_threshold << " repeating replica " << replica.index << "." << endl;
+				cout << " Average Chi2r = " << chi2r << " exceeds chi2_threshold = " << chi2_threshold << " repeating replica " << replica.index << "." << endl;
+				chi2r_exceeded += 1;
+
+				if(chi2r_exceeded >= mMaxBootstrapFailures)
+					throw runtime_error("Maximum chi2r trials exceeded.");
+			}
+			chi2r_exceeded = 0;
+
+			WriteResult(replica.index, &params[0], chi2r);
+		}
+	}
+	catch(...)
+	{
+		mFitErrors[fitter_id] = current_exception();
+		Stop();
+	}
+}
+
+/// Returns the reduced chi2 for params, averaged over the data sets, with the weights in
+/// weight_set.  residuals must hold GetNDataAllocated() elements.
+double CMinimizer_Bootstrap::GetChi2r(const double * params, unsigned int weight_set, vector<float> & residuals)
+{
+	double chi2 = 0;
+	double chi2r_ave = 0;
+
+	// All data sets are rendered and reduced in one batch.
+	mCLThread->GetChiBatch(params, 1, mNParams, false, &residuals[0], weight_set);
+	const float * chi = &residuals[0];
+	for(unsigned int data_set = 0; data_set < mNData.size(); data_set++)
+	{
+		chi2 = 0;
+		for(unsigned int i = 0; i < mNData[data_set]; i++)
+			chi2 += chi[i] * chi[i];
+
+		chi += mNData[data_set];
 
+		// Compute the reduced chi2 for this data set and add it to the average
+		chi2r_ave += chi2 / (double(mNData[data_set]) - mNParams - 1);
+	}
+
+	// Divide by the number of data sets to compute the average.
+	return chi2r_ave / mNData.size();
 }
 
 void CMinimizer_Bootstrap::Init()
 {
 	CMinimizer_levmar::Init();
 
-	// Get a copy of the original data, load it into memory.
+	// Replicates are weights applied to the loaded data if possible, otherwise new data sets
+	// are made from a copy of the original data (which can only be fit one at a time).
+	mUseWeights = mCLThread->SupportsDataWeights();
+	if(!mUseWeights)
+		mNFits = 1;
+
+	mMaxQueued = mNFits + 1;
+
 	int nData = mCLThread->GetNDataSets();
 	for(int data_set = 0; data_set < nData; data_set++)
-		mData.push_back(mCLThread->GetData(data_set));
+	{
+		mNV2.push_back(mCLThread->GetNV2(data_set));
+		mNT3.push_back(mCLThread->GetNT3(data_set));
+		mNData.push_back(mCLThread->GetNDataAllocated(data_set));
+
+		// Get a copy of the original data, load it into memory.
+		if(!mUseWeights)
+			mData.push_back(mCLThread->GetData(data_set));
+	}
+
+	for(auto fitter : mFitters)
+		delete fitter;
+
+	mFitters.clear();
+	for(unsigned int i = 0; i < mNFits; i++)
+	{
+		CMinimizer_levmar * fitter = new CMinimizer_levmar(mCLThread);
+		fitter->SetJacobianMode(mJacobianMode);
+		fitter->SetWeightSet((mUseWeights) ? i + 1 : 0);
+		fitter->Init();
+		mFitters.push_back(fitter);
+	}
 }
 
-void CMinimizer_Bootstrap::Next()
+/// Generates replica.index from its own random number stream, seeded by (mSeed, index),
+/// so the replicas do not depend on the order or thread in which they are made.  The
+/// stream continues in replica.generator (used for the starting positions of the fits).
+void CMinimizer_Bootstrap::MakeReplica(Replica & replica)
 {
-
 // TODO: Calibrator information is hard-coded for eps Aur. This should be read in from elsewhere.
 	pair<double, double> cal_diam(0.419 * MAS_TO_RAD, 0.063 * MAS_TO_RAD);
 
-	std::default_random_engine generator;
-	std::normal_distribution<double> distribution(cal_diam.first, cal_diam.second);
+	seed_seq seed = {mSeed, replica.index};
+	default_random_engine & generator = replica.generator;
+	generator.seed(seed);
+	unsigned int nDataSets = mNV2.size();
 
-	// Setup the old calibrator
-	OICalibratorPtr old_cal = OICalibratorPtr( new ccoifits::CUniformDisk(cal_diam.first) );
-	OICalibratorPtr new_cal = OICalibratorPtr( new ccoifits::CUniformDisk(distribution(generator)) );
+	// Replica 0 is the original data.
+	if(replica.index == 0)
+	{
+		if(mUseWeights)
+		{
+			replica.weights.resize(nDataSets);
+			replica.scales.resize(nDataSets);
+		}
+		else
+			replica.data = mData;
+
+		return;
+	}
 
-	// Recalibrate the data.
-	// TODO: Note this function assumes the SAME calibrator is used on ALL data sets. This probably isn't true.
-	// This issue is listed in https://github.com/bkloppenborg/simtoi/issues/53.
-	for(int i = 0; i < mData.size(); i++)
+	std::normal_distribution<double> distribution(cal_diam.first, cal_diam.second);
+	double new_diameter = distribution(generator);
+
+	if(!mUseWeights)
 	{
-		auto data = mData[i];
+		// Setup the old calibrator
+		OICalibratorPtr old_cal = OICalibratorPtr( new ccoifits::CUniformDisk(cal_diam.first) );
+		OICalibratorPtr new_cal = OICalibratorPtr( new ccoifits::CUniformDisk(new_diameter) );
 
-		// Recalibrate, bootstrap, then push to the OpenCL device:
-		OIDataList t_data = Recalibrate(data, old_cal, new_cal);
-		t_data = Bootstrap_Spectral(t_data);
+		// Recalibrate and bootstrap the data.
+		// TODO: Note this function assumes the SAME calibrator is used on ALL data sets. This probably isn't true.
+		// This issue is listed in https://github.com/bkloppenborg/simtoi/issues/53.
+		for(unsigned int i = 0; i < mData.size(); i++)
+			replica.data.push_back(Bootstrap_Spectral(Recalibrate(mData[i], old_cal, new_cal)));
 
-		// Replace the 0th entry with temp.
-		// Due to a bug in ccoifits the total data size may not be preserved, so we need to
-		// catch and repeat.
-		try
+		return;
+	}
+
+	// Every V2 and T3 measurement is weighted by the number of times it is drawn (with
+	// replacement), a T3 amplitude and its closure phase are drawn together.  The amplitudes
+	// are scaled as if the data were calibrated with the new calibrator diameter.
+	replica.weights.resize(nDataSets);
+	replica.scales.resize(nDataSets);
+	for(unsigned int data_set = 0; data_set < nDataSets; data_set++)
+	{
+		unsigned int n_v2 = mNV2[data_set];
+		unsigned int n_t3 = mNT3[data_set];
+		unsigned int n = n_v2 + 2 * n_t3;
+		vector<float> & weights = replica.weights[data_set];
+		vector<float> & scales = replica.scales[data_set];
+		weights.assign(n, 0);
+		scales.assign(n, 1);
+
+		if(n_v2 > 0)
 		{
-			mCLThread->ReplaceData(i, t_data);
+			uniform_int_distribution<unsigned int> pick(0, n_v2 - 1);
+			for(unsigned int i = 0; i < n_v2; i++)
+				weights[pick(generator)] += 1;
 		}
-		catch(length_error& l)
+
+		if(n_t3 > 0)
 		{
-			// Generate an error message on stderr.
-			cerr << " Warning: " << l.what() << " " << "Generating a new bootstrapped data set." << endl;
-			mBootstrapFailures += 1;
-			i--;
-
-			// If we haven't exceeded the maximum number of bootstrap failures, repeat
-			// this iteration.
-			if(mBootstrapFailures < mMaxBootstrapFailures)
-				continue;
-			else
-				throw runtime_error("Too many bootstrap data generation failures.");
+			uniform_int_distribution<unsigned int> pick(0, n_t3 - 1);
+			for(unsigned int i = 0; i < n_t3; i++)
+			{
+				unsigned int j = n_v2 + 2 * pick(generator);
+				weights[j] += 1;
+				weights[j + 1] += 1;
+			}
 		}
-		mBootstrapFailures = 0;
+
+		// Only reads the (fixed) uv coordinates of the loaded data.
+		mCLThread->GetCalibrationScales(data_set, cal_diam.first / MAS_TO_RAD, new_diameter / MAS_TO_RAD, &scales[0], n);
 	}
 }
 
-int CMinimizer_Bootstrap::run()
+/// Selects whether bootstrap minimizers created hereafter resume from an existing checkpoint
+/// (see OpenOutput) rather than starting over.
+void CMinimizer_Bootstrap::SetDefaultResume(bool resume)
 {
-	// init local storage
-	vector<double> tmp_vec;
-	long double tmp_chi2 = 0;
-	double chi2r_ave = 0;
-	double tmp = 0;
-	int exit_value = 0;
-	int iterations = 10000;
-	// The maximum chi2r that will be accepted. Iterations exceeding this value will be repeated.
-	float chi2_threshold = 10;
-	int chi2r_exceeded = 0;
-	int nData = 0;
-
-	// Setup the random number generator:
-	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-	std::default_random_engine generator (seed);
-	uniform_real_distribution<double> distribution (0.0,1.0);
-	vector< pair<double, double> > min_max = mCLThread->GetFreeParamMinMaxes();
-
-	for(int iteration = 0; iteration < iterations; iteration++)
+	mDefaultResume = resume;
+}
+
+/// Opens the results and checkpoint files.  If mResume is set and a checkpoint exists, the
+/// seed and completed replicas are read from it and the files are appended to.
+void CMinimizer_Bootstrap::OpenOutput()
+{
+	string results_name = mSaveFileBasename + "_bootstrap.txt";
+	string checkpoint_name = mSaveFileBasename + "_bootstrap_checkpoint.txt";
+	vector<string> lines;
+	string line;
+	string key;
+	unsigned int n_params = 0;
+	unsigned int index = 0;
+
+	mCompleted.clear();
+	vector<unsigned int> completed;
+
+	ifstream checkpoint(checkpoint_name.c_str());
+	bool resume = mResume && checkpoint.good();
+	if(resume)
 	{
-		if(!mRun)
-			break;
+		checkpoint >> key >> mSeed;
+		if(key != "seed")
+			throw runtime_error("Cannot read the bootstrap checkpoint " + checkpoint_name);
+
+		checkpoint >> key >> n_params;
+		if(key != "nparams" || n_params != mNParams)
+			throw runtime_error("The bootstrap checkpoint " + checkpoint_name + " does not match the number of free parameters.");
+
+		while(checkpoint >> index)
+			completed.push_back(index);
+
+		// Keep the results of the completed replicas only, the last result may have been
+		// written without its index if the run was interrupted.
+		ifstream results(results_name.c_str());
+		unsigned int n_results = 0;
+		while(getline(results, line))
+		{
+			if(line.size() > 0 && line[0] != '#')
+			{
+				if(n_results == completed.size())
+					break;
 
-		// Randomize the starting position of the minimizer
-		for(int i = 0; i < mNParams; i++)
-			mParams[i] = distribution(generator);
+				n_results++;
+			}
 
-		// Set the starting position.  Note these values are [0...1] and need to be scaled.
-		mCLThread->SetFreeParameters(mParams, mNParams, true);
+			lines.push_back(line);
+		}
+
+		completed.resize(n_results);
+		mCompleted.insert(completed.begin(), completed.end());
+	}
+	checkpoint.close();
 
-		// Print a status message:
-		cout << endl << "Starting iteration " << iteration + 1 << endl;
+	mOutput.open(results_name.c_str());
+	mOutput.precision(8);
+	if(resume)
+	{
+		for(auto & row : lines)
+			mOutput << row << endl;
+	}
+	else
+		mOutput << "# Param1 Param2 ... ParamN Chi2/(nData - nParams - 1)" << endl;
+
+	// The checkpoint is rewritten so an incomplete last line is not appended to.
+	mCheckpoint.open(checkpoint_name.c_str());
+	mCheckpoint << "seed " << mSeed << endl;
+	mCheckpoint << "nparams " << mNParams << endl;
+	for(auto i : completed)
+		mCheckpoint << i << endl;
+
+	if(resume)
+		cout << "Resuming bootstrap with " << mCompleted.size() << " of " << mNReplicas << " replicas completed." << endl;
+}
 
-		// run the minimizer
-		exit_value = CMinimizer_levmar::run(&CMinimizer_Bootstrap::ErrorFunc);
+/// Generates replicas 0, 1, ... mNReplicas - 1 (skipping those in mCompleted) on the
+/// producer thread, keeping at most mMaxQueued ready.
+void CMinimizer_Bootstrap::Produce()
+{
+	for(unsigned int index = 0; index < mNReplicas; index++)
+	{
+		if(mCompleted.count(index) > 0)
+			continue;
 
-		// Compute the average reduced chi2 per data set:
-		chi2r_ave = 0;
-		tmp_chi2 = 0;
-		mCLThread->SetFreeParameters(mParams, mNParams, false);
-		for(int data_set = 0; data_set < mData.size(); data_set++)
 		{
-			nData = mCLThread->GetNDataAllocated(data_set);
-			mCLThread->SetTime(mCLThread->GetDataAveJD(data_set));
-			mCLThread->EnqueueOperation(GLT_RenderModels);
-			mCLThread->GetChi(data_set, mResiduals, nData);
-
-			tmp_chi2 = 0;
-			tmp = 0;
-			for(int i = 0; i < nData; i++)
-				tmp_chi2 += mResiduals[i] * mResiduals[i];
-
-			// Compute the reduced chi2 for this data set and add it to the average
-			chi2r_ave += tmp_chi2 / (nData - mNParams - 1);
+			unique_lock<mutex> lock(mReplicaMutex);
+			mReplicaCondition.wait(lock, [this]{ return !mProduce || mReplicas.size() < mMaxQueued; });
+			if(!mProduce)
+				return;
 		}
-		// Divide by the number of data sets to compute the average.
-		chi2r_ave /= mData.size();
 
-		// If the average reduced chi2 is too high automatically redo the bootstrap
-		if(chi2r_ave > chi2_threshold)
+		Replica replica;
+		replica.index = index;
+		try
+		{
+			MakeReplica(replica);
+		}
+		catch(...)
 		{
-			cerr << " Average Chi2r = " << chi2r_ave << " exceeds chi2_threshold = " << chi2_threshold << " repeating iteration " << iteration << "." << endl;
-			cout << " Average Chi2r = " << chi2r_ave << " exceeds chi2_threshold = " << chi2_threshold << " repeating iteration " << iteration << "." << endl;
-			chi2r_exceeded += 1;
-			iteration--;
-
-			if(chi2r_exceeded < mMaxBootstrapFailures)
-				continue;
-			else
-				throw runtime_error("Maximum chi2r trials exceeded.");
+			replica.error = current_exception();
 		}
-		chi2r_exceeded = 0;
 
-		// Save the results.  Start by copying the current entry to the temporary vector:
-		tmp_vec.clear();
-		for(int i = 0; i < mNParams; i++)
-			tmp_vec.push_back(mParams[i]);
+		{
+			lock_guard<mutex> lock(mReplicaMutex);
+			mReplicas.push_back(move(replica));
+		}
+		mReplicaCondition.notify_all();
+	}
 
-		// append the chi2
-		tmp_vec.push_back(tmp_chi2);
+	// Signal the fitters that no more replicas will be made.
+	{
+		lock_guard<mutex> lock(mReplicaMutex);
+		mProduce = false;
+	}
+	mReplicaCondition.notify_all();
+}
+
+int CMinimizer_Bootstrap::run()
+{
+	int nDataSets = mCLThread->GetNDataSets();
+
+	// The first fit uses the original data, the replicas are generated while it runs.
+	OpenOutput();
+	StartProducer();
+
+	mIsRunning = true;
+	mFitErrors.assign(mNFits, exception_ptr());
+	vector<thread> fits;
+	for(unsigned int i = 0; i < mNFits; i++)
+		fits.push_back(thread(&CMinimizer_Bootstrap::FitReplicas, this, i));
 
-		// push this vector onto the back of mResults
-		mResults.push_back(tmp_vec);
+	for(auto & fit : fits)
+		fit.join();
+
+	mIsRunning = false;
+	StopProducer();
+
+	mOutput.close();
+	mCheckpoint.close();
+
+	// Remove the weights used by the fitters.
+	if(mUseWeights)
+	{
+		for(int data_set = 0; data_set < nDataSets; data_set++)
+		{
+			for(unsigned int i = 0; i < mNFits; i++)
+				mCLThread->SetDataWeights(data_set, i + 1, vector<float>(), vector<float>());
+		}
+	}
 
-		// Get the next bootstrapped data set and repeat.
-		Next();
+	for(auto error : mFitErrors)
+	{
+		if(error)
+			rethrow_exception(error);
 	}
 
-	// Save the results of the bootstrapper.
-    ExportResults(mParams, mNParams, true);
+	// The results were saved as they were found, export the parameter names.
+	ExportResults(mParams, mNParams, true);
 
 	return 0;
 }
+
+void CMinimizer_Bootstrap::StartProducer()
+{
+	StopProducer();
+
+	mReplicas.clear();
+	mProduce = true;
+	mProducer = thread(&CMinimizer_Bootstrap::Produce, this);
+}
+
+void CMinimizer_Bootstrap::StopProducer()
+{
+	{
+		lock_guard<mutex> lock(mReplicaMutex);
+		mProduce = false;
+	}
+	mReplicaCondition.notify_all();
+
+	if(mProducer.joinable())
+		mProducer.join();
+}
+
+/// Stops the fitters and wakes any waiting for a replica.
+void CMinimizer_Bootstrap::Stop()
+{
+	CMinimizer_levmar::Stop();
+	for(auto fitter : mFitters)
+		fitter->Stop();
+
+	{
+		lock_guard<mutex> lock(mReplicaMutex);
+		mProduce = false;
+	}
+	mReplicaCondition.notify_all();
+}
+
+/// Takes the next replica from the queue, waiting for it if necessary.  Returns false once
+/// all replicas have been taken (or the minimizer was stopped).
+bool CMinimizer_Bootstrap::TakeReplica(Replica & replica)
+{
+	{
+		unique_lock<mutex> lock(mReplicaMutex);
+		mReplicaCondition.wait(lock, [this]{ return !mReplicas.empty() || !mProduce; });
+		if(mReplicas.empty() || !mRun)
+			return false;
+
+		replica = move(mReplicas.front());
+		mReplicas.pop_front();
+	}
+	mReplicaCondition.notify_all();
+
+	return true;
+}
+
+/// Appends a fit to the results file, then records its index in the checkpoint.
+void CMinimizer_Bootstrap::WriteResult(unsigned int index, const double * params, double chi2r)
+{
+	vector<double> row(params, params + mNParams);
+	row.push_back(chi2r);
+
+	lock_guard<mutex> lock(mOutputMutex);
+	WriteRow(row, mOutput);
+	mCheckpoint << index << endl;
+
+	cout << "Replica " << index << " finished, average chi2r = " << chi2r << endl;
+}
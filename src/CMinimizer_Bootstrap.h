@@ -8,6 +8,15 @@
  *  This minimizer runs levmar like normal, but applies a mask to the chi
  *  which weights (potentially ignores) some chi elements. This, in effect
  *  selects a random subset of the data.
+ *
+ *  If the visibility engine supports weights, each replicate is a vector of per-point
+ *  multiplicities and calibration scale factors and the loaded data are left unchanged.
+ *  Replicates are generated on a background thread while the previous one is being fit.
+ *  With weights, several replicates are fit at once (each with its own weight set).
+ *
+ *  Every fit is appended to <base>_bootstrap.txt as soon as it completes and its index to
+ *  <base>_bootstrap_checkpoint.txt.  As replicate i is generated from (seed, i) alone, the
+ *  seed and the completed indices are sufficient to resume an interrupted run.
  */
 
  /*
@@ -38,6 +47,14 @@
 #ifndef CMINIMIZER_BOOTSTRAP_H_
 #define CMINIMIZER_BOOTSTRAP_H_
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
 #include "CMinimizer_levmar.h"
 #include "oi_file.hpp"
 
@@ -46,8 +63,46 @@ using namespace ccoifits;
 class CMinimizer_Bootstrap: public CMinimizer_levmar
 {
 protected:
-	unsigned int mBootstrapFailures;
+	/// A bootstrap replicate of every data set, either as weights on the loaded data
+	/// (if mUseWeights) or as new data sets.  Replica 0 is the original data.
+	struct Replica
+	{
+		unsigned int index;
+		vector< vector<float> > weights;
+		vector< vector<float> > scales;
+		vector<OIDataList> data;
+		default_random_engine generator;	// starting positions for the fit
+		exception_ptr error;	// rethrown when the replica is used
+	};
+
 	unsigned int mMaxBootstrapFailures;
+	bool mUseWeights;
+	unsigned int mSeed;
+	unsigned int mNReplicas;
+	static bool mDefaultResume;
+	bool mResume;
+
+	// The sizes of the data sets (used to generate weights and compute chi2r).
+	vector<unsigned int> mNV2;
+	vector<unsigned int> mNT3;
+	vector<unsigned int> mNData;
+
+	// Replicas generated ahead of time by mProducer, at most mMaxQueued at once.
+	deque<Replica> mReplicas;
+	unsigned int mMaxQueued;
+	bool mProduce;
+	mutex mReplicaMutex;
+	condition_variable mReplicaCondition;
+	thread mProducer;
+	set<unsigned int> mCompleted;	// replicas fit by a previous (resumed) run
+
+	// Replicas are fit concurrently by mNFits minimizers, fitter k uses weight set k + 1.
+	unsigned int mNFits;
+	vector<CMinimizer_levmar *> mFitters;
+	vector<exception_ptr> mFitErrors;
+	mutex mOutputMutex;
+	ofstream mOutput;
+	ofstream mCheckpoint;
 
 public:
 	vector<OIDataList> mData;	// A copy of the original data
@@ -56,16 +111,37 @@ public:
 	CMinimizer_Bootstrap(CCL_GLThread * cl_gl_thread);
 	virtual ~CMinimizer_Bootstrap();
 
-	vector< vector<double> > mResults;
-
+protected:
+	bool ApplyReplica(Replica & replica, unsigned int weight_set);
+public:
 	static void ErrorFunc(double * params, double * output, int nParams, int nOutput, void * misc);
-	virtual void ExportResults(double * params, int n_params, bool no_setparams);
-
+protected:
+	void FitReplicas(unsigned int fitter_id);
+	double GetChi2r(const double * params, unsigned int weight_set, vector<float> & residuals);
+public:
 	void Init();
 
-	void Next();
+protected:
+	void MakeReplica(Replica & replica);
+	void OpenOutput();
+	void Produce();
+public:
 
 	int run();
+
+	static void SetDefaultResume(bool resume);
+	void SetNFits(unsigned int n_fits) { mNFits = max(n_fits, 1u); };
+	void SetNReplicas(unsigned int n_replicas) { mNReplicas = n_replicas; };
+	void SetResume(bool resume) { mResume = resume; };
+	void SetSeed(unsigned int seed) { mSeed = seed; };
+protected:
+	void StartProducer();
+	void StopProducer();
+public:
+	virtual void Stop();
+protected:
+	bool TakeReplica(Replica & replica);
+	void WriteResult(unsigned int index, const double * params, double chi2r);
 };
 
 #endif /* CMINIMIZER_BOOTSTRAP_H_ */
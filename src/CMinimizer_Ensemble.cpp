@@ -0,0 +1,243 @@
+/*
+ * CMinimizer_Ensemble.cpp
+ *
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CMinimizer_Ensemble.h"
+
+#include <cmath>
+#include <chrono>
+#include <limits>
+
+#include "CCL_GLThread.h"
+
+CMinimizer_Ensemble::CMinimizer_Ensemble(CCL_GLThread * cl_gl_thread)
+: CMinimizer(cl_gl_thread)
+{
+	mType = CMinimizer::ENSEMBLE;
+	mNWalkers = 0;
+	mNSteps = 1000;
+	mStretch = 2;
+	mNAccepted = 0;
+	mBestLogPost = -numeric_limits<double>::infinity();
+}
+
+CMinimizer_Ensemble::~CMinimizer_Ensemble()
+{
+
+}
+
+/// Computes the log posterior of n_vectors positions (x = [0...1]) in a single batch.
+/// The priors are uniform, so within the hypercube this is the sum of the log likelihoods.
+void CMinimizer_Ensemble::GetLogPost(const double * params, unsigned int n_vectors, double * output)
+{
+	if(n_vectors == 0)
+		return;
+
+	unsigned int n_data_sets = mCLThread->GetNDataSets();
+	vector<double> log_like(n_vectors * n_data_sets);
+	mCLThread->GetLogLikeBatch(params, n_vectors, mNParams, true, &log_like[0]);
+
+	for(unsigned int i = 0; i < n_vectors; i++)
+	{
+		output[i] = 0;
+		for(unsigned int data_set = 0; data_set < n_data_sets; data_set++)
+			output[i] += log_like[i * n_data_sets + data_set];
+
+		if(std::isnan(output[i]))
+			output[i] = -numeric_limits<double>::infinity();
+	}
+}
+
+void CMinimizer_Ensemble::Init()
+{
+	CMinimizer::Init();
+
+	// The ensemble must span the parameter space, use at least 2 (n + 1) walkers.
+	SetNWalkers(max(mNWalkers, 2 * (mNParams + 1)));
+	mWalkers.resize(mNWalkers * mNParams);
+	mLogPost.resize(mNWalkers);
+	mBest.resize(mNParams);
+	mMinMax = mCLThread->GetFreeParamMinMaxes();
+
+	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
+	mGenerator.seed(seed);
+}
+
+int CMinimizer_Ensemble::run()
+{
+	if(mNParams == 0)
+		return 0;
+
+	// Start the walkers in a small ball about the current parameter values:
+	vector<double> start(mNParams);
+	mCLThread->GetFreeParameters(&start[0], mNParams, false);
+	normal_distribution<double> ball(0.0, 1E-2);
+	for(unsigned int k = 0; k < mNWalkers; k++)
+	{
+		for(unsigned int i = 0; i < mNParams; i++)
+		{
+			double & x = mWalkers[k * mNParams + i];
+			do
+				x = start[i] + ball(mGenerator);
+			while(x < 0 || x > 1);
+		}
+	}
+
+	GetLogPost(&mWalkers[0], mNWalkers, &mLogPost[0]);
+	mBestLogPost = -numeric_limits<double>::infinity();
+	for(unsigned int k = 0; k < mNWalkers; k++)
+	{
+		if(mLogPost[k] > mBestLogPost)
+		{
+			mBestLogPost = mLogPost[k];
+			copy(&mWalkers[k * mNParams], &mWalkers[(k + 1) * mNParams], mBest.begin());
+		}
+	}
+
+	// Open the chain file, it is written as the chains are produced.
+	stringstream filename;
+	filename << mSaveFileBasename << "_ensemble.txt";
+	ofstream outfile(filename.str().c_str());
+	outfile.precision(10);
+	outfile << "# Step, Walker, LogPosterior, Param0, ..., ParamN" << endl;
+
+	printf("Starting ensemble sampler with %i walkers...\n", mNWalkers);
+
+	mIsRunning = true;
+	mNAccepted = 0;
+	unsigned int step = 0;
+	for(step = 0; step < mNSteps && mRun; step++)
+	{
+		Update(0);
+		if(!mRun)
+			break;
+
+		Update(1);
+		WriteStep(step, outfile);
+	}
+	mIsRunning = false;
+	outfile.close();
+
+	if(step > 0)
+		printf("Ensemble sampler executed %i steps, acceptance fraction %f.\n", step, double(mNAccepted) / (step * mNWalkers));
+
+	// Save the most probable position in native units and export the model there.
+	for(unsigned int i = 0; i < mNParams; i++)
+		mParams[i] = mMinMax[i].first + (mMinMax[i].second - mMinMax[i].first) * mBest[i];
+
+	ExportResults(&mBest[0], mNParams);
+
+	return step;
+}
+
+/// Sets the number of walkers, which is rounded up to an even number.
+void CMinimizer_Ensemble::SetNWalkers(unsigned int n_walkers)
+{
+	mNWalkers = n_walkers + n_walkers % 2;
+}
+
+/// Moves every walker in one half (0 or 1) of the ensemble using the stretch move:
+///  Y = X_j + z (X_k - X_j), accepted with probability min(1, z^(n - 1) p(Y) / p(X_k))
+/// where X_j is a random walker from the other half.  Proposals which leave the hypercube
+/// have zero prior and are rejected without rendering, the rest are evaluated as one batch.
+void CMinimizer_Ensemble::Update(unsigned int half)
+{
+	unsigned int n_half = mNWalkers / 2;
+	unsigned int start = half * n_half;
+	unsigned int other = (1 - half) * n_half;
+
+	uniform_real_distribution<double> uniform(0.0, 1.0);
+	uniform_int_distribution<unsigned int> pick(0, n_half - 1);
+
+	vector<double> proposals;
+	vector<unsigned int> walkers;
+	vector<double> log_z;
+	proposals.reserve(n_half * mNParams);
+
+	for(unsigned int k = start; k < start + n_half; k++)
+	{
+		unsigned int j = other + pick(mGenerator);
+		double z = (mStretch - 1) * uniform(mGenerator) + 1;
+		z = z * z / mStretch;
+
+		bool inside = true;
+		unsigned int offset = proposals.size();
+		for(unsigned int i = 0; i < mNParams; i++)
+		{
+			double x_j = mWalkers[j * mNParams + i];
+			double y = x_j + z * (mWalkers[k * mNParams + i] - x_j);
+			inside &= (y >= 0 && y <= 1);
+			proposals.push_back(y);
+		}
+
+		if(!inside)
+		{
+			proposals.resize(offset);
+			continue;
+		}
+
+		walkers.push_back(k);
+		log_z.push_back((mNParams - 1) * log(z));
+	}
+
+	vector<double> log_post(walkers.size());
+	GetLogPost(proposals.data(), walkers.size(), log_post.data());
+
+	for(unsigned int m = 0; m < walkers.size(); m++)
+	{
+		unsigned int k = walkers[m];
+		if(!(log(uniform(mGenerator)) < log_z[m] + log_post[m] - mLogPost[k]))
+			continue;
+
+		copy(&proposals[m * mNParams], &proposals[(m + 1) * mNParams], &mWalkers[k * mNParams]);
+		mLogPost[k] = log_post[m];
+		mNAccepted += 1;
+
+		if(mLogPost[k] > mBestLogPost)
+		{
+			mBestLogPost = mLogPost[k];
+			copy(&mWalkers[k * mNParams], &mWalkers[(k + 1) * mNParams], mBest.begin());
+		}
+	}
+}
+
+/// Appends the current position of every walker, in native units, to the chain file.
+void CMinimizer_Ensemble::WriteStep(unsigned int step, ofstream & output)
+{
+	for(unsigned int k = 0; k < mNWalkers; k++)
+	{
+		output << step << ", " << k << ", " << mLogPost[k];
+		for(unsigned int i = 0; i < mNParams; i++)
+			output << ", " << mMinMax[i].first + (mMinMax[i].second - mMinMax[i].first) * mWalkers[k * mNParams + i];
+
+		output << "\n";
+	}
+
+	output.flush();
+}
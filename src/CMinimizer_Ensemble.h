@@ -0,0 +1,82 @@
+/*
+ * CMinimizer_Ensemble.h
+ *
+ *  An affine-invariant ensemble sampler (Goodman & Weare 2010, "stretch move").
+ *  Each half of the ensemble is evaluated as a single batch of likelihoods.
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMINIMIZER_ENSEMBLE_H_
+#define CMINIMIZER_ENSEMBLE_H_
+
+#include <random>
+#include "CMinimizer.h"
+
+/// Samples the posterior with an ensemble of walkers which move along lines through
+/// walkers of the complementary half of the ensemble.  The parameters are sampled in the
+/// unit hypercube (i.e. uniform priors), the chains are written to disk after every step.
+class CMinimizer_Ensemble: public CMinimizer
+{
+protected:
+	unsigned int mNWalkers;
+	unsigned int mNSteps;
+	double mStretch;		// the scale 'a' of the stretch move, z ~ 1/sqrt(z) on [1/a, a]
+
+	// Walker positions (x = [0...1]) stored contiguously, and their log posteriors.
+	vector<double> mWalkers;
+	vector<double> mLogPost;
+	unsigned int mNAccepted;
+
+	// The most probable position found so far.
+	vector<double> mBest;
+	double mBestLogPost;
+
+	vector< pair<double, double> > mMinMax;
+
+	default_random_engine mGenerator;
+
+public:
+	CMinimizer_Ensemble(CCL_GLThread * cl_gl_thread);
+	virtual ~CMinimizer_Ensemble();
+
+protected:
+	void 	GetLogPost(const double * params, unsigned int n_vectors, double * output);
+
+public:
+	void 	Init();
+
+	int 	run();
+
+	void 	SetNSteps(unsigned int n_steps) { mNSteps = n_steps; };
+	void 	SetNWalkers(unsigned int n_walkers);
+
+protected:
+	void 	Update(unsigned int half);
+	void 	WriteStep(unsigned int step, ofstream & output);
+};
+
+#endif /* CMINIMIZER_ENSEMBLE_H_ */
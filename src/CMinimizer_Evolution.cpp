@@ -0,0 +1,270 @@
+/*
+ * CMinimizer_Evolution.cpp
+ *
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CMinimizer_Evolution.h"
+
+#include <cmath>
+#include <chrono>
+#include <limits>
+
+#include "levmar.h"
+#include "CCL_GLThread.h"
+#include "CMinimizer_GridSearch.h"
+
+CMinimizer_Evolution::CMinimizer_Evolution(CCL_GLThread * cl_gl_thread)
+: CMinimizer_levmar(cl_gl_thread)
+{
+	mType = CMinimizer::EVOLUTION;
+	mPopulationSize = 0;
+	mNGenerations = 500;
+	mCrossover = 0.7;
+	mMinWeight = 0.5;
+	mMaxWeight = 1.0;
+	mTolerance = 0.01;
+	mPolish = true;
+	mBest = 0;
+
+	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
+	mGenerator.seed(seed);
+}
+
+CMinimizer_Evolution::~CMinimizer_Evolution()
+{
+
+}
+
+/// Computes the chi2r (averaged over the data sets) of n_vectors points (x = [0...1]) in a
+/// single batch.
+void CMinimizer_Evolution::GetChi2r(const double * params, unsigned int n_vectors, double * output)
+{
+	unsigned int nDataSets = mNData.size();
+	mChi2.resize(n_vectors * nDataSets);
+	mCLThread->GetChi2Batch(params, n_vectors, mNParams, true, &mChi2[0]);
+
+	for(unsigned int k = 0; k < n_vectors; k++)
+	{
+		output[k] = 0;
+		for(unsigned int data_set = 0; data_set < nDataSets; data_set++)
+			output[k] += mChi2[k * nDataSets + data_set] / (mNData[data_set] - int(mNParams) - 1);
+
+		output[k] /= nDataSets;
+
+		// Invalid models never survive selection.
+		if(!std::isfinite(output[k]))
+			output[k] = numeric_limits<double>::max();
+	}
+}
+
+/// Makes a trial point for every member (DE/rand/1/bin).  The mutant is a + weight * (b - c)
+/// for three distinct members other than the current one, at least one parameter is taken
+/// from the mutant.  Parameters which leave the hypercube are redrawn uniformly.
+void CMinimizer_Evolution::GetTrials(double weight)
+{
+	uniform_real_distribution<double> uniform(0.0, 1.0);
+	uniform_int_distribution<unsigned int> pick_member(0, mPopulationSize - 1);
+	uniform_int_distribution<unsigned int> pick_param(0, mNParams - 1);
+	unsigned int a, b, c;
+
+	for(unsigned int k = 0; k < mPopulationSize; k++)
+	{
+		do { a = pick_member(mGenerator); } while(a == k);
+		do { b = pick_member(mGenerator); } while(b == k || b == a);
+		do { c = pick_member(mGenerator); } while(c == k || c == a || c == b);
+
+		const double * x = &mPopulation[k * mNParams];
+		const double * xa = &mPopulation[a * mNParams];
+		const double * xb = &mPopulation[b * mNParams];
+		const double * xc = &mPopulation[c * mNParams];
+		double * trial = &mTrials[k * mNParams];
+
+		unsigned int forced = pick_param(mGenerator);
+		for(unsigned int i = 0; i < mNParams; i++)
+		{
+			if(i != forced && uniform(mGenerator) >= mCrossover)
+			{
+				trial[i] = x[i];
+				continue;
+			}
+
+			trial[i] = xa[i] + weight * (xb[i] - xc[i]);
+			if(trial[i] < 0 || trial[i] > 1)
+				trial[i] = uniform(mGenerator);
+		}
+	}
+}
+
+/// Finds the best member of the population (mBest) and returns the mean chi2r.
+double CMinimizer_Evolution::FindBest()
+{
+	double mean = 0;
+	mBest = 0;
+	for(unsigned int k = 0; k < mPopulationSize; k++)
+	{
+		mean += mCost[k];
+		if(mCost[k] < mCost[mBest])
+			mBest = k;
+	}
+
+	return mean / mPopulationSize;
+}
+
+void CMinimizer_Evolution::Init()
+{
+	CMinimizer_levmar::Init();
+
+	// The mutation needs three members besides the current one.
+	if(mPopulationSize == 0)
+		mPopulationSize = 10 * mNParams;
+
+	mPopulationSize = max(mPopulationSize, 4u);
+
+	mNData.clear();
+	for(int data_set = 0; data_set < mCLThread->GetNDataSets(); data_set++)
+		mNData.push_back(mCLThread->GetNDataAllocated(data_set));
+}
+
+int CMinimizer_Evolution::run()
+{
+	if(mNParams == 0 || mNData.size() == 0)
+		return 0;
+
+	uniform_real_distribution<double> weight(mMinWeight, mMaxWeight);
+	double mean = 0;
+	double variance = 0;
+
+	// The generations are written as they are computed.
+	stringstream filename;
+	filename << mSaveFileBasename << "_evolution.txt";
+	ofstream outfile(filename.str().c_str());
+	outfile.precision(8);
+	outfile << "# Generation, Best Chi2r, Mean Chi2r, Param0, ..., ParamN" << endl;
+
+	mIsRunning = true;
+
+	// The initial population is a Latin hypercube.
+	CMinimizer_GridSearch sweep(mCLThread);
+	sweep.SetSweepType(CMinimizer_GridSearch::LATIN_HYPERCUBE);
+	sweep.SetNSamples(mPopulationSize);
+	sweep.Init();
+
+	mPopulation.resize(mPopulationSize * mNParams);
+	mTrials.resize(mPopulationSize * mNParams);
+	mCost.resize(mPopulationSize);
+	mTrialCost.resize(mPopulationSize);
+	for(unsigned int k = 0; k < mPopulationSize; k++)
+		sweep.GetPoint(k, &mPopulation[k * mNParams]);
+
+	GetChi2r(&mPopulation[0], mPopulationSize, &mCost[0]);
+
+	unsigned int generation;
+	for(generation = 0; generation < mNGenerations; generation++)
+	{
+		mean = FindBest();
+		WriteGeneration(generation, mean, outfile);
+
+		// Converged once the spread of the population is small.
+		variance = 0;
+		for(unsigned int k = 0; k < mPopulationSize; k++)
+			variance += (mCost[k] - mean) * (mCost[k] - mean);
+
+		if(sqrt(variance / mPopulationSize) <= mTolerance * fabs(mean))
+			break;
+
+		// Permit termination in the middle of a run.
+		if(!mRun)
+			break;
+
+		// The whole generation is evaluated in a single batch.
+		GetTrials(weight(mGenerator));
+		GetChi2r(&mTrials[0], mPopulationSize, &mTrialCost[0]);
+
+		for(unsigned int k = 0; k < mPopulationSize; k++)
+		{
+			if(mTrialCost[k] > mCost[k])
+				continue;
+
+			copy(&mTrials[k * mNParams], &mTrials[k * mNParams] + mNParams, &mPopulation[k * mNParams]);
+			mCost[k] = mTrialCost[k];
+		}
+	}
+
+	// The last selection has not been summarized if we ran out of generations.
+	if(generation == mNGenerations)
+	{
+		mean = FindBest();
+		WriteGeneration(generation, mean, outfile);
+	}
+
+	outfile.close();
+
+	printf("Differential evolution executed %i generations, best chi2r: %f\n", generation, mCost[mBest]);
+
+	// Save the best member in native units.
+	vector<double> best(&mPopulation[mBest * mNParams], &mPopulation[mBest * mNParams] + mNParams);
+	for(unsigned int i = 0; i < mNParams; i++)
+		mParams[i] = mLowerBounds[i] + (mUpperBounds[i] - mLowerBounds[i]) * best[i];
+
+	// Refine the best member with levmar.
+	if(mPolish && mRun)
+	{
+		valarray<double> info;
+		valarray<double> covar;
+
+		printf("Polishing the best member with levmar...\n");
+		Fit(mParams, info, covar, &CMinimizer_levmar::ErrorFunc);
+		printf("Reason for exiting:\n %s\n", GetExitString(int(info[6])).c_str());
+
+		for(unsigned int i = 0; i < mNParams; i++)
+			best[i] = (mParams[i] - mLowerBounds[i]) / (mUpperBounds[i] - mLowerBounds[i]);
+	}
+
+	mIsRunning = false;
+
+	ExportResults(&best[0], mNParams);
+
+	return generation;
+}
+
+/// Sets the crossover probability, [0...1].
+void CMinimizer_Evolution::SetCrossover(double crossover)
+{
+	if(crossover >= 0 && crossover <= 1)
+		mCrossover = crossover;
+}
+
+/// Appends the best and mean chi2r of the population and the best member (in native units).
+void CMinimizer_Evolution::WriteGeneration(unsigned int generation, double mean, ofstream & output)
+{
+	output << generation << ", " << mCost[mBest] << ", " << mean;
+	for(unsigned int i = 0; i < mNParams; i++)
+		output << ", " << mLowerBounds[i] + (mUpperBounds[i] - mLowerBounds[i]) * mPopulation[mBest * mNParams + i];
+
+	output << endl;
+}
@@ -0,0 +1,89 @@
+/*
+ * CMinimizer_Evolution.h
+ *
+ *  A differential evolution minimizer (Storn & Price 1997, DE/rand/1/bin).  Every generation
+ *  is evaluated as a single batch, the best member may be polished with levmar.
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMINIMIZER_EVOLUTION_H_
+#define CMINIMIZER_EVOLUTION_H_
+
+#include <random>
+#include "CMinimizer_levmar.h"
+
+/// Evolves a population of points in the unit hypercube of the free parameters.  Each
+/// member competes with a trial point made by adding a scaled difference of two random
+/// members to a third and crossing the result with the member.
+class CMinimizer_Evolution: public CMinimizer_levmar
+{
+protected:
+	unsigned int mPopulationSize;	// zero selects 10 * mNParams
+	unsigned int mNGenerations;
+	double mCrossover;		// the probability that a parameter is taken from the mutant
+	double mMinWeight;		// the differential weight is drawn from [mMinWeight, mMaxWeight)
+	double mMaxWeight;		// every generation
+	double mTolerance;		// convergence, relative spread of the population's chi2r
+	bool mPolish;
+
+	// Members and trial points (x = [0...1]) stored contiguously, and their chi2r.
+	vector<double> mPopulation;
+	vector<double> mCost;
+	vector<double> mTrials;
+	vector<double> mTrialCost;
+	unsigned int mBest;
+
+	vector<int> mNData;
+	vector<double> mChi2;
+	default_random_engine mGenerator;
+
+public:
+	CMinimizer_Evolution(CCL_GLThread * cl_gl_thread);
+	virtual ~CMinimizer_Evolution();
+
+protected:
+	double 	FindBest();
+	void 	GetChi2r(const double * params, unsigned int n_vectors, double * output);
+	void 	GetTrials(double weight);
+
+public:
+	void 	Init();
+
+	int 	run();
+
+	void 	SetCrossover(double crossover);
+	void 	SetNGenerations(unsigned int n_generations) { mNGenerations = n_generations; };
+	void 	SetPolish(bool polish) { mPolish = polish; };
+	void 	SetPopulationSize(unsigned int population_size) { mPopulationSize = population_size; };
+	void 	SetSeed(unsigned int seed) { mGenerator.seed(seed); };
+	void 	SetTolerance(double tolerance) { mTolerance = tolerance; };
+
+protected:
+	void 	WriteGeneration(unsigned int generation, double mean, ofstream & output);
+};
+
+#endif /* CMINIMIZER_EVOLUTION_H_ */
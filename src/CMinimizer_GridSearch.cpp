@@ -32,106 +32,328 @@
 
 #include "CMinimizer_GridSearch.h"
 
-#include <tuple>
+#include <chrono>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
+#include <limits>
 
 #include "CCL_GLThread.h"
 
 using namespace std;
 
+// Sobol sequence direction numbers for dimensions 2...21 from Joe & Kuo (2008),
+// "Constructing Sobol sequences with better two-dimensional projections" (new-joe-kuo-6.21201).
+// Each row is: degree s, polynomial coefficients a, initial direction numbers m_1 ... m_s.
+static const unsigned int sobol_n_dims = 21;
+static const unsigned int sobol_table[sobol_n_dims - 1][9] = {
+	{1,  0, 1},
+	{2,  1, 1, 3},
+	{3,  1, 1, 3, 1},
+	{3,  2, 1, 1, 1},
+	{4,  1, 1, 1, 3, 3},
+	{4,  4, 1, 3, 5, 13},
+	{5,  2, 1, 1, 5, 5, 17},
+	{5,  4, 1, 1, 5, 5, 5},
+	{5,  7, 1, 1, 7, 11, 19},
+	{5, 11, 1, 1, 5, 1, 1},
+	{5, 13, 1, 1, 1, 3, 11},
+	{5, 14, 1, 3, 5, 5, 31},
+	{6,  1, 1, 3, 3, 9, 7, 49},
+	{6, 13, 1, 1, 1, 15, 21, 21},
+	{6, 16, 1, 3, 1, 13, 27, 49},
+	{6, 19, 1, 1, 1, 15, 7, 5},
+	{6, 22, 1, 3, 1, 15, 13, 25},
+	{6, 25, 1, 1, 5, 5, 19, 61},
+	{7,  1, 1, 3, 7, 11, 23, 15, 103},
+	{7,  4, 1, 3, 7, 13, 13, 15, 69}
+};
+
+CMinimizer_GridSearch::SweepTypes CMinimizer_GridSearch::mDefaultSweepType = CMinimizer_GridSearch::GRID;
+unsigned long long CMinimizer_GridSearch::mDefaultNSamples = 2500;
+vector<unsigned int> CMinimizer_GridSearch::mDefaultGridSteps;
+
 CMinimizer_GridSearch::CMinimizer_GridSearch(CCL_GLThread * cl_gl_thread)
 : CMinimizer(cl_gl_thread)
 {
 	mType = CMinimizer::GRIDSEARCH;
+	mSweepType = mDefaultSweepType;
+	mDefaultSteps = 50;
+	mNSamples = mDefaultNSamples;
+	mBatchSize = 256;
+
+	// A single number of steps applies to all parameters.
+	mSteps = mDefaultGridSteps;
+	if(mSteps.size() == 1)
+	{
+		mDefaultSteps = mSteps[0];
+		mSteps.clear();
+	}
 }
 
 CMinimizer_GridSearch::~CMinimizer_GridSearch() {
 	// TODO Auto-generated destructor stub
 }
 
-void CMinimizer_GridSearch::ExportResults(double * params, int n_params, bool no_setparams)
+/// Returns the number of points in the sweep.
+unsigned long long CMinimizer_GridSearch::GetNPoints()
 {
-	stringstream filename;
-	ofstream outfile;
-	double tmp[3];
+	if(mSweepType != GRID)
+		return mNSamples;
 
-	// Open the statistics file for writing:
-	filename.str("");
-	filename << mSaveFileBasename << "_gridsearch.txt";
-	outfile.open(filename.str().c_str());
-	outfile.width(15);
-	outfile.precision(8);
-	outfile << "# Param1 Param2 Chi2" << endl;
+	unsigned long long n_points = 1;
+	for(unsigned int i = 0; i < mNParams; i++)
+	{
+		if(n_points > numeric_limits<unsigned long long>::max() / mSteps[i])
+			throw runtime_error("Too many grid points requested.");
+
+		n_points *= mSteps[i];
+	}
 
-	// write the data to the file
-	for(int i = 0; i < mResults.size(); i++)
-		outfile << get<0>(mResults[i]) << " " << get<1>(mResults[i]) << " " << get<2>(mResults[i]) << endl;
+	return n_points;
+}
 
-	outfile.close();
+/// Computes the index-th point of the sweep in the unit hypercube (x = [0...1]).  Points may
+/// be computed in any order, the Latin hypercube jitter is only reproducible in sequence.
+void CMinimizer_GridSearch::GetPoint(unsigned long long index, double * point)
+{
+	uniform_real_distribution<double> uniform(0.0, 1.0);
+	unsigned int gray = 0;
+	unsigned int x = 0;
+
+	switch(mSweepType)
+	{
+	case LATIN_HYPERCUBE:
+		for(unsigned int i = 0; i < mNParams; i++)
+			point[i] = (Permute(index, mNSamples, mPermutations[i]) + uniform(mGenerator)) / mNSamples;
+		break;
+
+	case SOBOL:
+		// Skip the first point (the origin), then use the Gray code of the index.
+		gray = (index + 1) ^ ((index + 1) >> 1);
+		for(unsigned int i = 0; i < mNParams; i++)
+		{
+			x = 0;
+			for(unsigned int bit = 0; bit < 32; bit++)
+			{
+				if(gray & (1u << bit))
+					x ^= mDirections[i * 32 + bit];
+			}
+			point[i] = x / 4294967296.0;
+		}
+		break;
+
+	default:
+	case GRID:
+		// The index is a mixed-radix number with one digit per parameter.  As before, the
+		// points start at the minimum and stop one step short of the maximum.
+		for(unsigned int i = 0; i < mNParams; i++)
+		{
+			point[i] = double(index % mSteps[i]) / mSteps[i];
+			index /= mSteps[i];
+		}
+		break;
+	}
 }
 
 void CMinimizer_GridSearch::Init()
 {
 	CMinimizer::Init();
+
+	// Parameters without an explicit number of steps use the default.
+	mSteps.resize(mNParams, mDefaultSteps);
+	for(unsigned int i = 0; i < mNParams; i++)
+		mSteps[i] = max(mSteps[i], 1u);
+
+	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
+	mGenerator.seed(seed);
+	mPermutations.resize(mNParams);
+	for(unsigned int i = 0; i < mNParams; i++)
+		mPermutations[i] = mGenerator();
+
+	if(mSweepType == SOBOL)
+		InitSobol();
 }
 
+/// Computes the Sobol direction numbers for the free parameters.
+void CMinimizer_GridSearch::InitSobol()
+{
+	if(mNParams > sobol_n_dims)
+		throw runtime_error("Sobol sequences are limited to 21 free parameters, use a Latin hypercube instead.");
 
-int CMinimizer_GridSearch::run()
+	mDirections.resize(mNParams * 32);
+
+	// The first dimension is the van der Corput sequence.
+	for(unsigned int bit = 0; bit < 32 && mNParams > 0; bit++)
+		mDirections[bit] = 1u << (31 - bit);
+
+	for(unsigned int i = 1; i < mNParams; i++)
+	{
+		const unsigned int * row = sobol_table[i - 1];
+		unsigned int s = row[0];
+		unsigned int a = row[1];
+		unsigned int * v = &mDirections[i * 32];
+
+		for(unsigned int k = 0; k < s; k++)
+			v[k] = row[2 + k] << (31 - k);
+
+		for(unsigned int k = s; k < 32; k++)
+		{
+			v[k] = v[k - s] ^ (v[k - s] >> s);
+			for(unsigned int j = 1; j < s; j++)
+				v[k] ^= ((a >> (s - 1 - j)) & 1) * v[k - j];
+		}
+	}
+}
+
+/// Returns the image of i under a pseudo-random permutation of [0...n) selected by seed.
+/// The permutation is computed on the fly (Kensler 2013, "Correlated Multi-Jittered
+/// Sampling") so Latin hypercubes of any size need no storage.
+unsigned int CMinimizer_GridSearch::Permute(unsigned int i, unsigned int n, unsigned int seed)
 {
-	// TODO: This minimizer only works on two-dimentional data.
-	if(mNParams > 2)
-		return 0;
+	unsigned int w = n - 1;
+	w |= w >> 1;
+	w |= w >> 2;
+	w |= w >> 4;
+	w |= w >> 8;
+	w |= w >> 16;
+
+	// Hash within the smallest power of two containing n, repeating until the result is in range.
+	do
+	{
+		i ^= seed; i *= 0xe170893d;
+		i ^= seed >> 16;
+		i ^= (i & w) >> 4;
+		i ^= seed >> 8; i *= 0x0929eb3f;
+		i ^= seed >> 23;
+		i ^= (i & w) >> 1; i *= 1 | seed >> 27;
+		i *= 0x6935fa69;
+		i ^= (i & w) >> 11; i *= 0x74dcb303;
+		i ^= (i & w) >> 2; i *= 0x9e501cc3;
+		i ^= (i & w) >> 2; i *= 0xc860a3df;
+		i &= w;
+		i ^= i >> 5;
+	} while (i >= n);
+
+	return (i + seed) % n;
+}
 
-	int nData = 0;
+int CMinimizer_GridSearch::run()
+{
 	int nDataSets = mCLThread->GetNDataSets();
-	int n_data_offset = 0;
+	vector<int> nData(nDataSets);
 	double chi2r_sum = 0;
+	unsigned long long n_points = GetNPoints();
+
+	if(mNParams == 0 || n_points == 0)
+		return 0;
+
+	if(mSweepType != GRID && n_points > numeric_limits<unsigned int>::max())
+		throw runtime_error("Too many samples requested.");
 
-	// Get the min/max ranges for the parameters:
-	mCLThread->GetFreeParameters(mParams, mNParams, true);
 	vector< pair<double, double> > min_max = mCLThread->GetFreeParamMinMaxes();
 
-	// Hard coded for the moment, results in 2500 iterations equally spaced in both dimensions.
-	int nSteps = 50;
+	for(int data_set = 0; data_set < nDataSets; data_set++)
+		nData[data_set] = mCLThread->GetNDataAllocated(data_set);
 
-	// Determine the size of each step.
-	double steps[mNParams];
-	for(int i = 0; i < mNParams; i++)
-		steps[i] = (min_max[i].second - min_max[i].first) / nSteps;
+	// The results are written as they are computed.
+	stringstream filename;
+	filename << mSaveFileBasename << "_gridsearch.txt";
+	ofstream outfile(filename.str().c_str());
+	outfile.precision(8);
+	outfile << "# Param0 ... ParamN Chi2r" << endl;
+
+	// Points are evaluated in batches (x = [0...1]), see CCL_GLThread::GetChi2Batch.
+	vector<double> batch_params(mBatchSize * mNParams);
+	vector<double> batch_chi2(mBatchSize * nDataSets);
+	vector<double> best(mNParams);
+	double best_chi2r = numeric_limits<double>::max();
+
+	mIsRunning = true;
 
-	// Run the grid search.
-	for(mParams[0] = min_max[0].first; mParams[0] < min_max[0].second; mParams[0] += steps[0])
+	unsigned long long start;
+	for(start = 0; start < n_points; start += mBatchSize)
 	{
-		for(mParams[1] = min_max[1].first; mParams[1] < min_max[1].second; mParams[1] += steps[1])
-		{
-			chi2r_sum = 0;
-			// Permit termination in the middle of a run.
-			if(!mRun)
-				break;
+		// Permit termination in the middle of a run.
+		if(!mRun)
+			break;
+
+		unsigned int n_vectors = min((unsigned long long) mBatchSize, n_points - start);
+		for(unsigned int i = 0; i < n_vectors; i++)
+			GetPoint(start + i, &batch_params[i * mNParams]);
 
-			// Set the parameters (note, they are not scaled to unit magnitude).
-			mCLThread->SetFreeParameters(mParams, mNParams, false);
+		mCLThread->GetChi2Batch(&batch_params[0], n_vectors, mNParams, true, &batch_chi2[0]);
+
+		for(unsigned int i = 0; i < n_vectors; i++)
+		{
+			const double * point = &batch_params[i * mNParams];
 
-			// Now iterate through the data and pull out the residuals, notice we do pointer math on mResiduals
+			chi2r_sum = 0;
 			for(int data_set = 0; data_set < nDataSets; data_set++)
+				chi2r_sum += batch_chi2[i * nDataSets + data_set] / (nData[data_set] - mNParams - 1);
+
+			chi2r_sum /= nDataSets;
+			if(chi2r_sum < best_chi2r)
 			{
-				nData = mCLThread->GetNDataAllocated(data_set);
-				mCLThread->SetTime(mCLThread->GetDataAveJD(data_set));
-				mCLThread->EnqueueOperation(GLT_RenderModels);
-				chi2r_sum += mCLThread->GetChi2(data_set) / (nData - mNParams - 1);
-				n_data_offset += nData;
+				best_chi2r = chi2r_sum;
+				copy(point, point + mNParams, best.begin());
 			}
 
-			mResults.push_back( tuple<double, double, double>(mParams[0], mParams[1], chi2r_sum/nDataSets) );
+			for(unsigned int j = 0; j < mNParams; j++)
+				outfile << min_max[j].first + (min_max[j].second - min_max[j].first) * point[j] << " ";
 
+			outfile << chi2r_sum << "\n";
 		}
+
+		outfile.flush();
 	}
 
-	// Export the results.  Note, mParams is set to the maximum value, not the minimum.
-	ExportResults(mParams, mNParams, true);
+	mIsRunning = false;
+	outfile.close();
+
+	printf("Grid search evaluated %llu of %llu points, minimum chi2r: %f\n", min(start, n_points), n_points, best_chi2r);
+
+	// Save the best point in native units and export the model there.
+	for(unsigned int j = 0; j < mNParams; j++)
+		mParams[j] = min_max[j].first + (min_max[j].second - min_max[j].first) * best[j];
+
+	ExportResults(&best[0], mNParams);
 	return 0;
 }
 
+/// Sets the number of points evaluated in each batch.
+void CMinimizer_GridSearch::SetBatchSize(unsigned int batch_size)
+{
+	if(batch_size > 0)
+		mBatchSize = batch_size;
+}
 
+/// Sets the number of points used by the Latin hypercube and Sobol sweeps of grid searches
+/// created hereafter.
+void CMinimizer_GridSearch::SetDefaultNSamples(unsigned long long n_samples)
+{
+	if(n_samples > 0)
+		mDefaultNSamples = n_samples;
+}
 
+/// Sets the number of steps along each parameter used by the grids of grid searches created
+/// hereafter.  A single value applies to all parameters, otherwise the values are used for
+/// the free parameters in order (any remaining parameters use 50 steps).
+void CMinimizer_GridSearch::SetDefaultSteps(const vector<unsigned int> & steps)
+{
+	mDefaultGridSteps = steps;
+}
+
+/// Selects the method used to place the points by grid searches created hereafter.
+void CMinimizer_GridSearch::SetDefaultSweepType(SweepTypes type)
+{
+	if(type >= GRID && type < LAST_VALUE)
+		mDefaultSweepType = type;
+}
+
+/// Selects the method used to place the points.
+void CMinimizer_GridSearch::SetSweepType(SweepTypes type)
+{
+	if(type >= GRID && type < LAST_VALUE)
+		mSweepType = type;
+}
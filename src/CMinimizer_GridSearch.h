@@ -4,7 +4,7 @@
  *  Created on: Oct 4, 2012
  *      Author: bkloppen
  *
- *  Implementation of a basic grid-search minimizer.
+ *  Implementation of a grid, Latin hypercube and Sobol sequence search minimizer.
  */
 
  /*
@@ -35,19 +35,61 @@
 #ifndef CMINIMIZER_GRIDSEARCH_H_
 #define CMINIMIZER_GRIDSEARCH_H_
 
+#include <random>
 #include "CMinimizer.h"
 
+/// Evaluates the chi2r at a set of points which cover the free parameter space.  The points
+/// are evaluated in batches and each batch is appended to the output file as it completes.
 class CMinimizer_GridSearch: public CMinimizer {
+public:
+	/// Methods used to place the points
+	enum SweepTypes
+	{
+		GRID,				// a regular grid with mSteps[i] steps along parameter i
+		LATIN_HYPERCUBE,	// mNSamples points, one in each of mNSamples strata per parameter
+		SOBOL,				// the first mNSamples points of a Sobol sequence
+		LAST_VALUE	// must be the last value in this list.
+	};
+
+protected:
+	static SweepTypes mDefaultSweepType;
+	static unsigned long long mDefaultNSamples;
+	static vector<unsigned int> mDefaultGridSteps;
+
+	SweepTypes mSweepType;
+	vector<unsigned int> mSteps;
+	unsigned int mDefaultSteps;
+	unsigned long long mNSamples;
+	unsigned int mBatchSize;
+
+	// Latin hypercube state, one permutation seed per parameter.
+	vector<unsigned int> mPermutations;
+	default_random_engine mGenerator;
+
+	// Sobol direction numbers, mDirections[i * 32 + bit].
+	vector<unsigned int> mDirections;
+
 public:
 	CMinimizer_GridSearch(CCL_GLThread * cl_gl_thread);
 	virtual ~CMinimizer_GridSearch();
 
-	vector< tuple<double,double,double> > mResults;
+	unsigned long long GetNPoints();
+	void GetPoint(unsigned long long index, double * point);
 
 	void Init();
-	virtual void ExportResults(double * params, int n_params, bool no_setparams);
+	void InitSobol();
+
+	static unsigned int Permute(unsigned int i, unsigned int n, unsigned int seed);
 
 	int run();
+
+	void SetBatchSize(unsigned int batch_size);
+	static void SetDefaultNSamples(unsigned long long n_samples);
+	static void SetDefaultSteps(const vector<unsigned int> & steps);
+	static void SetDefaultSweepType(SweepTypes type);
+	void SetNSamples(unsigned long long n_samples) { mNSamples = n_samples; };
+	void SetSteps(const vector<unsigned int> & steps) { mSteps = steps; };
+	void SetSweepType(SweepTypes type);
 };
 
 #endif /* CMINIMIZER_GRIDSEARCH_H_ */
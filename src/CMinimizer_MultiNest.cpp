@@ -88,13 +88,11 @@ void CMinimizer_MultiNest::log_likelihood(double * params, int & ndim, int & npa
 	// Convert the double parameter values back to floats
 	int nData = minimizer->mCLThread->GetNData();
 
-	minimizer->mCLThread->SetFreeParameters(params, npars, true);
+	// Evaluate all data sets in one submission.  MultiNest hands us one point at a time.
+	vector<double> log_like(n_data_sets);
+	minimizer->mCLThread->GetLogLikeBatch(params, 1, npars, true, &log_like[0]);
 	for(int data_set = 0; data_set < n_data_sets; data_set++)
-	{
-		minimizer->mCLThread->SetTime(minimizer->mCLThread->GetDataAveJD(data_set));
-		minimizer->mCLThread->EnqueueOperation(GLT_RenderModels);
-		tmp += minimizer->mCLThread->GetLogLike(data_set);
-	}
+		tmp += log_like[data_set];
 
 	// Add in the priors.
 	tmp += minimizer->mCLThread->GetFreeParameterPriorProduct();
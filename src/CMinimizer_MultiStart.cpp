@@ -0,0 +1,384 @@
+/*
+ * CMinimizer_MultiStart.cpp
+ *
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CMinimizer_MultiStart.h"
+
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <thread>
+
+#include "levmar.h"
+#ifdef LINSOLVERS_RETAIN_MEMORY
+#error "Concurrent fits require levmar built with LINSOLVERS_RETAIN_MEMORY off (re-run cmake)."
+#endif
+#include "CCL_GLThread.h"
+#include "CMinimizer_GridSearch.h"
+
+CMinimizer_MultiStart::CMinimizer_MultiStart(CCL_GLThread * cl_gl_thread)
+: CMinimizer_levmar(cl_gl_thread)
+{
+	mType = CMinimizer::MULTISTART;
+	mStartType = SOBOL;
+	mNStarts = 64;
+	mNFits = 4;
+	mBasinRadius = 0.01;
+	mNextStart = 0;
+	mNUnconverged = 0;
+	mNData = 0;
+
+	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
+	mGenerator.seed(seed);
+}
+
+CMinimizer_MultiStart::~CMinimizer_MultiStart()
+{
+	for(auto fitter : mFitters)
+		delete fitter;
+}
+
+/// Merges a converged fit (native values) with the minimum in whose basin it lies, or
+/// records it as a new minimum.
+void CMinimizer_MultiStart::AddMinimum(const double * params, double chi2)
+{
+	lock_guard<mutex> lock(mMutex);
+
+	for(auto & minimum : mMinima)
+	{
+		if(!InBasin(params, minimum))
+			continue;
+
+		minimum.n_converged += 1;
+		if(chi2 < minimum.chi2)
+		{
+			minimum.params.assign(params, params + mNParams);
+			for(unsigned int i = 0; i < mNParams; i++)
+				minimum.unit[i] = (params[i] - mLowerBounds[i]) / (mUpperBounds[i] - mLowerBounds[i]);
+
+			minimum.chi2 = chi2;
+		}
+
+		return;
+	}
+
+	Minimum minimum;
+	minimum.params.assign(params, params + mNParams);
+	minimum.unit.resize(mNParams);
+	for(unsigned int i = 0; i < mNParams; i++)
+		minimum.unit[i] = (params[i] - mLowerBounds[i]) / (mUpperBounds[i] - mLowerBounds[i]);
+
+	minimum.chi2 = chi2;
+	minimum.n_converged = 1;
+	minimum.n_abandoned = 0;
+	mMinima.push_back(minimum);
+
+	printf("Found minimum %lu, chi2r: %f\n", mMinima.size(), chi2 / (mNData - mNParams - 1));
+}
+
+/// Computes the residuals of a Fitter.  Once the fit has been abandoned (see JacobianFunc)
+/// an invalid result is returned, which terminates levmar.
+void CMinimizer_MultiStart::ErrorFunc(double * params, double * output, int nParams, int nOutput, void * misc)
+{
+	Fitter * fitter = reinterpret_cast<Fitter*>(misc);
+
+	if(fitter->mAbandoned)
+	{
+		output[0] = 1.0/0;	// Intentional, generate NAN to cause levmar to terminate.
+		return;
+	}
+
+	CMinimizer_levmar::ErrorFunc(params, output, nParams, nOutput, misc);
+}
+
+/// Returns true if params (native values) lie in the basin of a known minimum, which is
+/// returned in basin.
+bool CMinimizer_MultiStart::FindBasin(const double * params, unsigned int & basin)
+{
+	lock_guard<mutex> lock(mMutex);
+
+	for(unsigned int i = 0; i < mMinima.size(); i++)
+	{
+		if(InBasin(params, mMinima[i]))
+		{
+			basin = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// Fits starting points with mFitters[fitter_id] until they are exhausted or the minimizer
+/// is stopped.  Runs on its own thread, exceptions are stored in mFitErrors.
+void CMinimizer_MultiStart::FitStarts(unsigned int fitter_id)
+{
+	Fitter * fitter = mFitters[fitter_id];
+	vector<double> params(mNParams);
+	valarray<double> info;
+	valarray<double> covar;
+	unsigned int start;
+
+	try
+	{
+		while(mRun)
+		{
+			{
+				lock_guard<mutex> lock(mMutex);
+				if(mNextStart >= mNStarts)
+					return;
+
+				start = mNextStart;
+				mNextStart += 1;
+			}
+
+			for(unsigned int i = 0; i < mNParams; i++)
+				params[i] = mLowerBounds[i] + (mUpperBounds[i] - mLowerBounds[i]) * mStarts[start * mNParams + i];
+
+			fitter->mAbandoned = false;
+			fitter->Fit(&params[0], info, covar, &CMinimizer_MultiStart::ErrorFunc, &CMinimizer_MultiStart::JacobianFunc);
+
+			// Interrupted fits are not recorded.
+			if(!mRun)
+				return;
+
+			if(fitter->mAbandoned)
+			{
+				lock_guard<mutex> lock(mMutex);
+				mMinima[fitter->mBasin].n_abandoned += 1;
+				continue;
+			}
+
+			// Only fits stopped by the gradient (1), step size (2) or residual (6) criteria
+			// have converged.  info[1] is the chi2 at the solution.
+			int exit_num = int(info[6]);
+			if((exit_num == 1 || exit_num == 2 || exit_num == 6) && std::isfinite(info[1]))
+			{
+				AddMinimum(&params[0], info[1]);
+			}
+			else
+			{
+				lock_guard<mutex> lock(mMutex);
+				mNUnconverged += 1;
+			}
+		}
+	}
+	catch(...)
+	{
+		mFitErrors[fitter_id] = current_exception();
+		Stop();
+	}
+}
+
+/// Computes mNStarts starting points (x = [0...1]).
+void CMinimizer_MultiStart::GetStarts()
+{
+	mStarts.resize(mNStarts * mNParams);
+
+	if(mStartType == RANDOM)
+	{
+		uniform_real_distribution<double> distribution(0.0, 1.0);
+		for(unsigned int i = 0; i < mStarts.size(); i++)
+			mStarts[i] = distribution(mGenerator);
+
+		return;
+	}
+
+	// The other sequences are those of the grid search.  Sobol sequences are limited in
+	// dimension, a Latin hypercube is used for larger problems.
+	CMinimizer_GridSearch sweep(mCLThread);
+	if(mStartType == SOBOL && mNParams <= 21)
+		sweep.SetSweepType(CMinimizer_GridSearch::SOBOL);
+	else
+		sweep.SetSweepType(CMinimizer_GridSearch::LATIN_HYPERCUBE);
+
+	sweep.SetNSamples(mNStarts);
+	sweep.Init();
+	for(unsigned int i = 0; i < mNStarts; i++)
+		sweep.GetPoint(i, &mStarts[i * mNParams]);
+}
+
+/// Returns true if params (native values) lie within mBasinRadius of minimum along every
+/// parameter, in units of the parameter ranges.  mMutex must be held.
+bool CMinimizer_MultiStart::InBasin(const double * params, const Minimum & minimum)
+{
+	double x;
+	for(unsigned int i = 0; i < mNParams; i++)
+	{
+		x = (params[i] - mLowerBounds[i]) / (mUpperBounds[i] - mLowerBounds[i]);
+		if(fabs(x - minimum.unit[i]) > mBasinRadius)
+			return false;
+	}
+
+	return true;
+}
+
+void CMinimizer_MultiStart::Init()
+{
+	CMinimizer_levmar::Init();
+
+	mNData = mCLThread->GetNDataAllocated();
+
+	for(auto fitter : mFitters)
+		delete fitter;
+
+	// The basin check needs levmar's Jacobian callback (see JacobianFunc), which SERIAL
+	// mode does not use, so it is replaced by the equivalent BATCHED differences.
+	mFitters.clear();
+	for(unsigned int i = 0; i < mNFits; i++)
+	{
+		Fitter * fitter = new Fitter(mCLThread, this);
+		fitter->SetJacobianMode((mJacobianMode == SERIAL) ? BATCHED : mJacobianMode);
+		fitter->Init();
+		mFitters.push_back(fitter);
+	}
+}
+
+/// Computes the Jacobian of a Fitter.  levmar requests it only at accepted points, so a
+/// fit is abandoned here, rather than at a (possibly rejected) trial point, if params have
+/// entered the basin of a known minimum.
+void CMinimizer_MultiStart::JacobianFunc(double * params, double * jacobian, int nParams, int nOutput, void * misc)
+{
+	Fitter * fitter = reinterpret_cast<Fitter*>(misc);
+
+	if(!fitter->mMultiStart->FindBasin(params, fitter->mBasin))
+	{
+		CMinimizer_levmar::JacobianFunc(params, jacobian, nParams, nOutput, misc);
+		return;
+	}
+
+	// Any non-singular Jacobian will do, the next call to ErrorFunc terminates levmar.
+	fitter->mAbandoned = true;
+	for(int i = 0; i < nOutput * nParams; i++)
+		jacobian[i] = 0;
+
+	for(int j = 0; j < nParams && j < nOutput; j++)
+		jacobian[j * nParams + j] = 1;
+}
+
+int CMinimizer_MultiStart::run()
+{
+	if(mNParams == 0 || mNStarts == 0)
+		return 0;
+
+	GetStarts();
+	mNextStart = 0;
+	mMinima.clear();
+	mNUnconverged = 0;
+
+	printf("Starting %i levmar fits, %i at a time...\n", mNStarts, mNFits);
+
+	mIsRunning = true;
+	mFitErrors.assign(mNFits, exception_ptr());
+	vector<thread> fits;
+	for(unsigned int i = 0; i < mNFits; i++)
+		fits.push_back(thread(&CMinimizer_MultiStart::FitStarts, this, i));
+
+	for(auto & fit : fits)
+		fit.join();
+
+	mIsRunning = false;
+
+	for(auto error : mFitErrors)
+	{
+		if(error)
+			rethrow_exception(error);
+	}
+
+	if(mMinima.size() == 0)
+	{
+		printf("No fit converged (%i unconverged).\n", mNUnconverged);
+		return 0;
+	}
+
+	WriteMinima();
+
+	// Save the best minimum and export the model there.
+	copy(mMinima[0].params.begin(), mMinima[0].params.end(), mParams);
+	ExportResults(&mMinima[0].unit[0], mNParams);
+
+	return 0;
+}
+
+/// Sets the size of the basins, in units of the free parameter ranges.
+void CMinimizer_MultiStart::SetBasinRadius(double radius)
+{
+	if(radius > 0)
+		mBasinRadius = radius;
+}
+
+/// Selects the method used to place the starting points.
+void CMinimizer_MultiStart::SetStartType(StartTypes type)
+{
+	if(type >= RANDOM && type < LAST_VALUE)
+		mStartType = type;
+}
+
+/// Stops the fitters.
+void CMinimizer_MultiStart::Stop()
+{
+	CMinimizer_levmar::Stop();
+	for(auto fitter : mFitters)
+		fitter->Stop();
+}
+
+/// Ranks the minima by chi2, then prints them and saves them to <base>_multistart.txt.
+void CMinimizer_MultiStart::WriteMinima()
+{
+	sort(mMinima.begin(), mMinima.end(),
+			[](const Minimum & a, const Minimum & b) { return a.chi2 < b.chi2; });
+
+	stringstream filename;
+	filename << mSaveFileBasename << "_multistart.txt";
+	ofstream outfile(filename.str().c_str());
+	outfile.precision(8);
+	outfile << "# Unconverged starts: " << mNUnconverged << endl;
+	outfile << "# Chi2r, NConverged, NAbandoned, Param0, ..., ParamN" << endl;
+
+	vector<string> names = mCLThread->GetFreeParamNames();
+	printf("Distinct minima (of %i starts, %i unconverged):\n", mNStarts, mNUnconverged);
+	vector<double> row;
+	for(unsigned int k = 0; k < mMinima.size(); k++)
+	{
+		const Minimum & minimum = mMinima[k];
+		double chi2r = minimum.chi2 / (mNData - mNParams - 1);
+
+		printf(" %i: chi2r = %f, converged: %i, abandoned: %i\n", k + 1, chi2r, minimum.n_converged, minimum.n_abandoned);
+		for(unsigned int i = 0; i < mNParams; i++)
+			printf("  P[%d] = %f (%s)\n", i, minimum.params[i], names[i].c_str());
+
+		row.assign(1, chi2r);
+		row.push_back(minimum.n_converged);
+		row.push_back(minimum.n_abandoned);
+		row.insert(row.end(), minimum.params.begin(), minimum.params.end());
+		WriteRow(row, outfile);
+	}
+
+	outfile.close();
+}
@@ -0,0 +1,125 @@
+/*
+ * CMinimizer_MultiStart.h
+ *
+ *  Runs levmar from many starting points at once and reports the distinct minima found.
+ *  A start which enters the basin of a minimum that has already been found is abandoned.
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMINIMIZER_MULTISTART_H_
+#define CMINIMIZER_MULTISTART_H_
+
+#include <exception>
+#include <mutex>
+#include <random>
+#include "CMinimizer_levmar.h"
+
+class CMinimizer_MultiStart: public CMinimizer_levmar
+{
+public:
+	/// Methods used to place the starting points
+	enum StartTypes
+	{
+		RANDOM,				// uniform random points
+		LATIN_HYPERCUBE,	// see CMinimizer_GridSearch
+		SOBOL,				// see CMinimizer_GridSearch
+		LAST_VALUE	// must be the last value in this list.
+	};
+
+protected:
+	/// A levmar fit which is abandoned once it enters the basin of a known minimum.
+	class Fitter: public CMinimizer_levmar
+	{
+	public:
+		CMinimizer_MultiStart * mMultiStart;
+		bool mAbandoned;
+		unsigned int mBasin;	// the basin entered, if abandoned
+
+	public:
+		Fitter(CCL_GLThread * cl_gl_thread, CMinimizer_MultiStart * multi_start)
+			: CMinimizer_levmar(cl_gl_thread), mMultiStart(multi_start), mAbandoned(false), mBasin(0) {};
+	};
+
+	/// A distinct minimum and the number of starts which ended in its basin.
+	struct Minimum
+	{
+		vector<double> params;	// native values
+		vector<double> unit;	// x = [0...1]
+		double chi2;
+		unsigned int n_converged;
+		unsigned int n_abandoned;
+	};
+
+	StartTypes mStartType;
+	unsigned int mNStarts;
+	unsigned int mNFits;
+	double mBasinRadius;	// in units of the free parameter ranges
+	default_random_engine mGenerator;
+
+	// The starting points (x = [0...1]), fitted in order by mNFits concurrent fitters.
+	vector<double> mStarts;
+	unsigned int mNextStart;
+	vector<Fitter *> mFitters;
+	vector<exception_ptr> mFitErrors;
+
+	// The minima found so far, in the order in which they were found, and the number of fits
+	// which stopped without converging (e.g. at the iteration limit or a singular matrix).
+	vector<Minimum> mMinima;
+	unsigned int mNUnconverged;
+	int mNData;
+	mutex mMutex;	// guards mNextStart, mMinima and mNUnconverged
+
+public:
+	CMinimizer_MultiStart(CCL_GLThread * cl_gl_thread);
+	virtual ~CMinimizer_MultiStart();
+
+protected:
+	void AddMinimum(const double * params, double chi2);
+public:
+	static void ErrorFunc(double * params, double * output, int nParams, int nOutput, void * misc);
+protected:
+	bool FindBasin(const double * params, unsigned int & basin);
+	void FitStarts(unsigned int fitter_id);
+	void GetStarts();
+	bool InBasin(const double * params, const Minimum & minimum);
+public:
+	void Init();
+	static void JacobianFunc(double * params, double * jacobian, int nParams, int nOutput, void * misc);
+
+	int run();
+
+	void SetBasinRadius(double radius);
+	void SetNFits(unsigned int n_fits) { mNFits = max(n_fits, 1u); };
+	void SetNStarts(unsigned int n_starts) { mNStarts = n_starts; };
+	void SetSeed(unsigned int seed) { mGenerator.seed(seed); };
+	void SetStartType(StartTypes type);
+	virtual void Stop();
+protected:
+	void WriteMinima();
+};
+
+#endif /* CMINIMIZER_MULTISTART_H_ */
@@ -36,12 +36,26 @@
 #include "levmar.h"
 #include "CCL_GLThread.h"
 
+// levmar's covariance routine, declared in levmar's misc.h rather than levmar.h.
+extern "C" int dlevmar_covar(double *JtJ, double *C, double sumsq, int m, int n);
+
+CMinimizer_levmar::JacobianModes CMinimizer_levmar::mDefaultJacobianMode = CMinimizer_levmar::BATCHED;
+
 
 CMinimizer_levmar::CMinimizer_levmar(CCL_GLThread * cl_gl_thread)
 : CMinimizer(cl_gl_thread)
 {
 	mType = CMinimizer::LEVMAR;
 	mResiduals = NULL;
+	mJacobianMode = mDefaultJacobianMode;
+	mWeightSet = 0;
+	mBroydenRefresh = 10;
+	mNBroydenUpdates = 0;
+	mErrorRendersAtJacobian = 0;
+	mNErrorRenders = 0;
+	mNJacobianRenders = 0;
+	mNJacobians = 0;
+	mNBroydenJacobians = 0;
 }
 
 CMinimizer_levmar::~CMinimizer_levmar()
@@ -53,9 +67,6 @@ void CMinimizer_levmar::ErrorFunc(double * params, double * output, int nParams,
 {
 	// Get the "this" pointer
 	CMinimizer_levmar * minimizer = reinterpret_cast<CMinimizer_levmar*>(misc);
-	int n_data_sets = minimizer->mCLThread->GetNDataSets();
-	int n_data_alloc = 0;
-	int n_data_offset = 0;
 
 	// See if we have been requested to exit.  If so, give levmar an invalid result
 	if(!minimizer->mRun)
@@ -64,18 +75,14 @@ void CMinimizer_levmar::ErrorFunc(double * params, double * output, int nParams,
 		return;
 	}
 
-	// Set the parameters (note, they are already scaled)
-	minimizer->mCLThread->SetFreeParameters(params, nParams, false);
+	// Set the parameters (note, they are already scaled), render and compute the residuals
+	// for all data sets in a single submission.
+	minimizer->mCLThread->GetChiBatch(params, 1, nParams, false, minimizer->mResiduals, minimizer->mWeightSet);
+	minimizer->mNErrorRenders += 1;
 
-	// Now iterate through the data and pull out the residuals, notice we do pointer math on mResiduals
-	for(int data_set = 0; data_set < n_data_sets; data_set++)
-	{
-		n_data_alloc = minimizer->mCLThread->GetNDataAllocated(data_set);
-		minimizer->mCLThread->SetTime(minimizer->mCLThread->GetDataAveJD(data_set));
-		minimizer->mCLThread->EnqueueOperation(GLT_RenderModels);
-		minimizer->mCLThread->GetChi(data_set, minimizer->mResiduals + n_data_offset, n_data_alloc);
-		n_data_offset += n_data_alloc;
-	}
+	// Save the residuals for JacobianFunc (levmar requests the Jacobian at accepted points).
+	minimizer->mLastParams.assign(params, params + nParams);
+	minimizer->mLastResiduals.assign(minimizer->mResiduals, minimizer->mResiduals + nOutput);
 
 	// Copy the errors back into the double array:
 //	printf("Residuals:\n");
@@ -86,6 +93,127 @@ void CMinimizer_levmar::ErrorFunc(double * params, double * output, int nParams,
 	}
 }
 
+/// Computes the Jacobian, jacobian[i * nParams + j] = d output[i] / d params[j].  In BROYDEN
+/// mode the previous Jacobian is updated if possible (see BroydenUpdate), otherwise it is
+/// computed using forward differences (see FiniteDifferences).
+void CMinimizer_levmar::JacobianFunc(double * params, double * jacobian, int nParams, int nOutput, void * misc)
+{
+	CMinimizer_levmar * minimizer = reinterpret_cast<CMinimizer_levmar*>(misc);
+
+	if(!minimizer->mRun)
+	{
+		for(int i = 0; i < nOutput * nParams; i++)
+			jacobian[i] = 0;
+		return;
+	}
+
+	if(minimizer->mJacobianMode == BROYDEN && minimizer->BroydenUpdate(params, jacobian, nParams, nOutput))
+		return;
+
+	minimizer->FiniteDifferences(params, jacobian, nParams, nOutput);
+}
+
+/// Updates the previous Jacobian to params with Broyden's rank-one (secant) update,
+///  J += ((f - f_0) - J s) s^T / (s^T s), where s = params - params_0,
+/// which needs no renders.  Returns false if finite differences are required instead: at the
+/// start, every mBroydenRefresh Jacobians, and whenever levmar rejected a step since the last
+/// Jacobian (i.e. the linear model was poor).
+bool CMinimizer_levmar::BroydenUpdate(const double * params, double * jacobian, int nParams, int nOutput)
+{
+	if(mJacobian.size() != nOutput * nParams || mNBroydenUpdates + 1 >= mBroydenRefresh)
+		return false;
+
+	// Exactly one (accepted) evaluation since the last Jacobian, at params.
+	if(mNErrorRenders != mErrorRendersAtJacobian + 1 || mLastResiduals.size() != nOutput ||
+		!equal(params, params + nParams, mLastParams.begin()))
+		return false;
+
+	vector<double> s(nParams);
+	double s2 = 0;
+	for(int j = 0; j < nParams; j++)
+	{
+		s[j] = params[j] - mJacobianAt[j];
+		s2 += s[j] * s[j];
+	}
+
+	if(s2 == 0)
+		return false;
+
+	double r;
+	for(int i = 0; i < nOutput; i++)
+	{
+		double * row = &mJacobian[i * nParams];
+		r = double(mLastResiduals[i]) - double(mJacobianAtResiduals[i]);
+		for(int j = 0; j < nParams; j++)
+			r -= row[j] * s[j];
+
+		r /= s2;
+		for(int j = 0; j < nParams; j++)
+			row[j] += r * s[j];
+	}
+
+	copy(mJacobian.begin(), mJacobian.end(), jacobian);
+	mJacobianAt.assign(params, params + nParams);
+	mJacobianAtResiduals = mLastResiduals;
+	mNBroydenUpdates += 1;
+	mErrorRendersAtJacobian = mNErrorRenders;
+	mNJacobians += 1;
+	mNBroydenJacobians += 1;
+	return true;
+}
+
+/// Computes the Jacobian using forward differences.  The perturbed models (and the
+/// unperturbed model, unless ErrorFunc just computed it) are submitted to the rendering
+/// thread as a single batch.  The step follows levmar's own rule
+/// (max(1E-4 |p_j|, LM_DIFF_DELTA)) and is reversed when it would leave the upper bound.
+void CMinimizer_levmar::FiniteDifferences(const double * params, double * jacobian, int nParams, int nOutput)
+{
+	// Vector j + offset has parameter j perturbed, vector 0 is the unperturbed model if needed.
+	bool have_f0 = mLastResiduals.size() == nOutput && equal(params, params + nParams, mLastParams.begin());
+	int offset = (have_f0) ? 0 : 1;
+	int n_vectors = nParams + offset;
+	vector<double> & batch = mJacobianParams;
+	vector<float> & residuals = mJacobianResiduals;
+	batch.resize(n_vectors * nParams);
+	residuals.resize(n_vectors * nOutput);
+	vector<double> steps(nParams);
+
+	for(int k = 0; k < n_vectors; k++)
+		copy(params, params + nParams, batch.begin() + k * nParams);
+
+	for(int j = 0; j < nParams; j++)
+	{
+		steps[j] = max(fabs(1E-4 * params[j]), LM_DIFF_DELTA);
+		if(params[j] + steps[j] > mUpperBounds[j])
+			steps[j] = -steps[j];
+
+		batch[(j + offset) * nParams + j] += steps[j];
+	}
+
+	mCLThread->GetChiBatch(&batch[0], n_vectors, nParams, false, &residuals[0], mWeightSet);
+	mNJacobianRenders += n_vectors;
+	mNJacobians += 1;
+
+	const float * f0 = (have_f0) ? &mLastResiduals[0] : &residuals[0];
+	const float * fj;
+	for(int j = 0; j < nParams; j++)
+	{
+		fj = &residuals[(j + offset) * nOutput];
+		for(int i = 0; i < nOutput; i++)
+			jacobian[i * nParams + j] = (double(fj[i]) - double(f0[i])) / steps[j];
+	}
+
+	// Save the Jacobian for Broyden updates.
+	if(mJacobianMode == BROYDEN)
+	{
+		mJacobian.assign(jacobian, jacobian + nOutput * nParams);
+		mJacobianAt.assign(params, params + nParams);
+		mJacobianAtResiduals.assign(f0, f0 + nOutput);
+		mNBroydenUpdates = 0;
+		mErrorRendersAtJacobian = mNErrorRenders;
+	}
+}
+
 void CMinimizer_levmar::Init()
 {
 	CMinimizer::Init();
@@ -96,6 +224,103 @@ void CMinimizer_levmar::Init()
 	{
 		mResiduals[i] = 0;
 	}
+
+	vector< pair<double, double> > min_max = mCLThread->GetFreeParamMinMaxes();
+	mLowerBounds.resize(mNParams);
+	mUpperBounds.resize(mNParams);
+	for(int i = 0; i < mNParams; i++)
+	{
+		mLowerBounds[i] = min_max[i].first;
+		mUpperBounds[i] = min_max[i].second;
+	}
+}
+
+/// Runs levmar from params, which are replaced by the best-fit parameters.  Nothing is
+/// printed or exported, so several instances may fit concurrently (each with its own
+/// weight set, see SetWeightSet).  Returns the number of iterations.
+int CMinimizer_levmar::Fit(double * params, valarray<double> & info, valarray<double> & covar,
+		void (*error_func)(double *p, double *hx, int m, int n, void *adata),
+		void (*jacobian_func)(double *p, double *j, int m, int n, void *adata))
+{
+	int max_iterations = 50;
+	int nData = mCLThread->GetNDataAllocated();
+	valarray<double> x(nData);
+	valarray<double> opts(LM_INFO_SZ);
+	info.resize(LM_INFO_SZ);
+	covar.resize(mNParams * mNParams);
+
+	// Setup the options (LM_* from levmar.h):
+	// info[1-4]=[ ||e||_2, ||J^T e||_inf,  ||Dp||_2, mu/max[J^T J]_ii ], all computed at estimated p.
+	// \tau: scale factor for initial \mu
+	//  opts[0] = |e||_2 				= LM_INIT_MU = 1E-03
+	// \epsilon1: stopping thresholds for ||J^T e||_inf
+	//  opts[1] = ||J^T e||_inf 		= LM_STOP_THRESH = 1E-15;
+	// \epsilon2: stopping thresholds for ||Dp||_2
+	//  opts[2] = ||Dp||_2 				= LM_STOP_THRESH = 1E-15;
+	// \epsilon3: stopping thresholds for ||e||_2
+	//  opts[3] = mu/max[J^T J]_ii ] 	= LM_STOP_THRESH * LM_STOP_THRESH = 1E-17 * 1E-17;
+	// \delta, step used in difference approximation to the Jacobian.  \delta < 0 => central difference instead of forward difference used
+	//  opts[4]= LM_DIFF_DELTA;
+	opts[0]= 1;
+	opts[1]= 1E-4;
+	opts[2]= 1E-4;
+	opts[3]= 1E-12;
+	opts[4]= LM_DIFF_DELTA;
+
+	mLastParams.clear();
+	mLastResiduals.clear();
+	mJacobian.clear();
+	mNErrorRenders = 0;
+	mNJacobianRenders = 0;
+	mNJacobians = 0;
+	mNBroydenJacobians = 0;
+
+	if(mJacobianMode == SERIAL)
+		return dlevmar_bc_dif(error_func, params, &x[0], mNParams, nData, &mLowerBounds[0], &mUpperBounds[0], NULL, max_iterations, &opts[0], &info[0], NULL, &covar[0], (void*)this);
+
+	// NOTE: JacobianFunc evaluates CMinimizer_levmar::ErrorFunc's residuals, error_func
+	// must produce the same residuals for the batched Jacobian to be used.  jacobian_func
+	// may wrap JacobianFunc (levmar calls it only at accepted points).
+	int iterations = dlevmar_bc_der(error_func, jacobian_func, params, &x[0], mNParams, nData, &mLowerBounds[0], &mUpperBounds[0], NULL, max_iterations, &opts[0], &info[0], NULL, &covar[0], (void*)this);
+
+	// A Broyden Jacobian may satisfy the gradient (1) or step size (2) criteria prematurely,
+	// levmar is restarted (with finite differences) until the result is confirmed.
+	while(mJacobianMode == BROYDEN && mRun && mNBroydenUpdates > 0 && iterations < max_iterations &&
+		(int(info[6]) == 1 || int(info[6]) == 2))
+	{
+		mJacobian.clear();
+		iterations += dlevmar_bc_der(error_func, jacobian_func, params, &x[0], mNParams, nData, &mLowerBounds[0], &mUpperBounds[0], NULL, max_iterations - iterations, &opts[0], &info[0], NULL, &covar[0], (void*)this);
+	}
+
+	// Otherwise levmar's covariance was computed from a Broyden Jacobian, recompute it
+	// from a finite difference Jacobian at the best-fit parameters.
+	if(mJacobianMode == BROYDEN && mRun && mNBroydenUpdates > 0 && int(info[6]) != 7)
+		ComputeCovariance(params, info[1], nData, covar);
+
+	return iterations;
+}
+
+/// Computes the covariance of the parameters, sumsq / (n - m) (J^T J)^-1, using a finite
+/// difference Jacobian at params.  sumsq is ||e||_2^2 at params (i.e. info[1] from levmar).
+void CMinimizer_levmar::ComputeCovariance(const double * params, double sumsq, int nData, valarray<double> & covar)
+{
+	vector<double> jacobian(nData * mNParams);
+	vector<double> JtJ(mNParams * mNParams, 0);
+	FiniteDifferences(params, &jacobian[0], mNParams, nData);
+
+	const double * row;
+	for(int i = 0; i < nData; i++)
+	{
+		row = &jacobian[i * mNParams];
+		for(int j = 0; j < mNParams; j++)
+		{
+			for(int k = 0; k < mNParams; k++)
+				JtJ[j * mNParams + k] += row[j] * row[k];
+		}
+	}
+
+	covar.resize(mNParams * mNParams);
+	dlevmar_covar(&JtJ[0], &covar[0], sumsq, mNParams, nData);
 }
 
 string CMinimizer_levmar::GetExitString(int exit_num)
@@ -153,7 +378,7 @@ void CMinimizer_levmar::printresult(double * x, int n_pars, int n_data, vector<s
 	{
 		nData = mCLThread->GetNDataAllocated(data_set);
 		mCLThread->SetTime(mCLThread->GetDataAveJD(data_set));
-		mCLThread->EnqueueOperation(GLT_RenderModels);
+		mCLThread->EnqueueOperation(GLT_RenderOffscreen);
 		chi2r = mCLThread->GetChi2(data_set) / (nData - mNParams - 1);
 		chi2r_total += chi2r;
 		printf("  Data Set %i chi2r: %f\n", data_set, chi2r);
@@ -192,10 +417,22 @@ void CMinimizer_levmar::printresult(double * x, int n_pars, int n_data, vector<s
 
 }
 
+/// Prints the number of models rendered during the last fit.
+void CMinimizer_levmar::printrenders()
+{
+	printf("Rendered %lu models: %lu residuals, %lu for %lu Jacobians", mNErrorRenders + mNJacobianRenders,
+			mNErrorRenders, mNJacobianRenders, mNJacobians);
+
+	if(mJacobianMode == BROYDEN)
+		printf(" (%lu Broyden updates)", mNBroydenJacobians);
+
+	printf(".\n");
+}
+
 int CMinimizer_levmar::run()
 {
 	// Run the minimizer using this instance of CMinimizer_levmar
-	run(&CMinimizer_levmar::ErrorFunc);
+	return run(&CMinimizer_levmar::ErrorFunc);
 }
 
 int CMinimizer_levmar::run(void (*error_func)(double *p, double *hx, int m, int n, void *adata))
@@ -204,59 +441,41 @@ int CMinimizer_levmar::run(void (*error_func)(double *p, double *hx, int m, int
 	if(mResiduals == NULL)
 		return -1;
 
-	// Create a member function pointer
 	int iterations = 0;
-	int max_iterations = 50;
 	int nData = mCLThread->GetNDataAllocated();
-	valarray<double> x(nData);
-	valarray<double> lb(mNParams);
-	valarray<double> ub(mNParams);
 	valarray<double> info(LM_INFO_SZ);
-	valarray<double> opts(LM_INFO_SZ);
 	valarray<double> covar(mNParams * mNParams);
 
-	// Setup the options (LM_* from levmar.h):
-	// info[1-4]=[ ||e||_2, ||J^T e||_inf,  ||Dp||_2, mu/max[J^T J]_ii ], all computed at estimated p.
-	// \tau: scale factor for initial \mu
-	//  opts[0] = |e||_2 				= LM_INIT_MU = 1E-03
-	// \epsilon1: stopping thresholds for ||J^T e||_inf
-	//  opts[1] = ||J^T e||_inf 		= LM_STOP_THRESH = 1E-15;
-	// \epsilon2: stopping thresholds for ||Dp||_2
-	//  opts[2] = ||Dp||_2 				= LM_STOP_THRESH = 1E-15;
-	// \epsilon3: stopping thresholds for ||e||_2
-	//  opts[3] = mu/max[J^T J]_ii ] 	= LM_STOP_THRESH * LM_STOP_THRESH = 1E-17 * 1E-17;
-	// \delta, step used in difference approximation to the Jacobian.  \delta < 0 => central difference instead of forward difference used
-	//  opts[4]= LM_DIFF_DELTA;
-	opts[0]= 1;
-	opts[1]= 1E-4;
-	opts[2]= 1E-4;
-	opts[3]= 1E-12;
-	opts[4]= LM_DIFF_DELTA;
-
 	// Copy out the initial values for the parameters:
 	mCLThread->GetFreeParameters(mParams, mNParams, true);
 	vector<string> names = mCLThread->GetFreeParamNames();
-	vector< pair<double, double> > min_max = mCLThread->GetFreeParamMinMaxes();
-
-	// Init parameter500 values
-	for(int i = 0; i < mNParams; i++)
-	{
-		lb[i] = min_max[i].first;
-		ub[i] = min_max[i].second;
-	}
 
 	printf("Starting levmar...\n");
 
-	mIsRunning = true;
-
 	// Call levmar.  Note, the results are saved in mParams upon completion.
-	iterations = dlevmar_bc_dif(error_func, mParams, &x[0], mNParams, nData, &lb[0], &ub[0], NULL, max_iterations, &opts[0], &info[0], NULL, &covar[0], (void*)this);
-
+	mIsRunning = true;
+	iterations = Fit(mParams, info, covar, error_func);
 	mIsRunning = false;
 
 	printf("Levmar executed %i iterations.\n", iterations);
+	printrenders();
 	printresult(mParams, mNParams, nData, names, info, covar);
 	ExportResults(mParams, mNParams);
 
 	return iterations;
 }
+
+/// Selects the method used to compute the Jacobian.
+void CMinimizer_levmar::SetJacobianMode(JacobianModes mode)
+{
+	if(mode >= SERIAL && mode < LAST_VALUE)
+		mJacobianMode = mode;
+}
+
+/// Selects the method used to compute the Jacobian by minimizers created hereafter
+/// (including the fitters created by the Bootstrap and Multi-start minimizers).
+void CMinimizer_levmar::SetDefaultJacobianMode(JacobianModes mode)
+{
+	if(mode >= SERIAL && mode < LAST_VALUE)
+		mDefaultJacobianMode = mode;
+}
@@ -34,6 +34,7 @@
 #define CMINIMIZER_LEVMAR_H_
 
 #include <valarray>
+#include <vector>
 
 using namespace std;
 
@@ -41,23 +42,75 @@ using namespace std;
 
 class CMinimizer_levmar: public CMinimizer
 {
+public:
+	/// Methods used to compute the Jacobian
+	enum JacobianModes
+	{
+		SERIAL,		// levmar's internal finite differences, one evaluation at a time
+		BATCHED,	// forward differences submitted as a single batch
+		BROYDEN,	// rank-one (secant) updates, batched forward differences when required
+		LAST_VALUE	// must be the last value in this list.
+	};
+
 protected:
 	float * mResiduals;
 
+	static JacobianModes mDefaultJacobianMode;
+	JacobianModes mJacobianMode;
+	vector<double> mJacobianParams;
+	vector<float> mJacobianResiduals;
+
+	// The residuals of the last ErrorFunc evaluation, reused by JacobianFunc.
+	vector<double> mLastParams;
+	vector<float> mLastResiduals;
+
+	// The last Jacobian, the point at which it was computed and the residuals there (Broyden).
+	vector<double> mJacobian;
+	vector<double> mJacobianAt;
+	vector<float> mJacobianAtResiduals;
+	unsigned int mBroydenRefresh;	// finite differences at least every mBroydenRefresh Jacobians
+	unsigned int mNBroydenUpdates;	// since the last finite difference Jacobian
+	unsigned long mErrorRendersAtJacobian;
+
+	// Models rendered during the last fit.
+	unsigned long mNErrorRenders;
+	unsigned long mNJacobianRenders;
+	unsigned long mNJacobians;
+	unsigned long mNBroydenJacobians;
+	vector<double> mLowerBounds;
+	vector<double> mUpperBounds;
+	unsigned int mWeightSet;	// data weights used for the residuals, see CCL_GLThread::SetDataWeights
+
 public:
 	CMinimizer_levmar(CCL_GLThread * cl_gl_thread);
 	virtual ~CMinimizer_levmar();
 
 	static void ErrorFunc(double * params, double * output, int nParams, int nOutput, void * misc);
+	static void JacobianFunc(double * params, double * jacobian, int nParams, int nOutput, void * misc);
+protected:
+	bool BroydenUpdate(const double * params, double * jacobian, int nParams, int nOutput);
+	void ComputeCovariance(const double * params, double sumsq, int nData, valarray<double> & covar);
+	void FiniteDifferences(const double * params, double * jacobian, int nParams, int nOutput);
+public:
+
+	int Fit(double * params, valarray<double> & info, valarray<double> & covar,
+			void (*error_func)(double *p, double *hx, int m, int n, void *adata),
+			void (*jacobian_func)(double *p, double *j, int m, int n, void *adata) = &CMinimizer_levmar::JacobianFunc);
 
 	string GetExitString(int exit_num);
 
 	virtual void Init();
 
 	void printresult(double * x, int n_pars, int n_data, vector<string> names, valarray<double> & info, valarray<double> & covar);
+	void printrenders();
 
 	virtual int run();
 	int run(void (*error_func)(double *p, double *hx, int m, int n, void *adata));
+
+	void SetBroydenRefresh(unsigned int n_jacobians) { mBroydenRefresh = max(n_jacobians, 1u); };
+	static void SetDefaultJacobianMode(JacobianModes mode);
+	void SetJacobianMode(JacobianModes mode);
+	void SetWeightSet(unsigned int weight_set) { mWeightSet = weight_set; };
 };
 
 #endif /* CMINIMIZER_LEVMAR_H_ */
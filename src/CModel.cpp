@@ -43,6 +43,9 @@
 #include "CPosition.h"
 #include "CPositionXY.h"
 #include "CPositionOrbit.h"
+#include "CRasterizer.h"
+#include "CMesh.h"
+#include "CAnalyticDisk.h"
 //#include "CFeature.h"
 //#include "CFeatureList.h"
 
@@ -58,6 +61,8 @@ CModel::CModel(int n_params)
 	mShader = NULL;
 	mShaderLoaded = false;
 
+	mRasterizer = NULL;
+
 	// Init the yaw, pitch, and roll to be zero and fixed.  Set their names:
 	mParamNames.push_back("Inclination");
 	SetParam(0, 0);
@@ -170,15 +175,90 @@ double CModel::GetFreePriorProd()
 	return tmp;
 }
 
+/// Returns the most recent generation of this model, its position and shader.  The value
+/// changes whenever anything which affects the rendered image changes.
+unsigned int CModel::GetGeneration()
+{
+	unsigned int generation = mGeneration;
+	if(mPosition != NULL)
+		generation = max(generation, mPosition->GetGeneration());
+	if(mShader != NULL)
+		generation = max(generation, mShader->GetGeneration());
+
+	return generation;
+}
+
+/// Appends the values of the fixed parameters of this model, its position and shader.  The
+/// angles copied from an orbit (see SetAnglesFromPosition) follow the position and are skipped.
+void CModel::GetFixedParameters(vector<double> & values)
+{
+	int n_derived = (mPosition != NULL && mPosition->GetType() == CPosition::ORBIT) ? 2 : 0;
+	for(int k = n_derived; k < mNParams; k++)
+	{
+		if(!IsFree(k))
+			values.push_back(mParams[k]);
+	}
+
+	CParameters * owners[2] = {mPosition, mShader.get()};
+	for(unsigned int j = 0; j < 2; j++)
+	{
+		if(owners[j] == NULL)
+			continue;
+
+		for(int k = 0; k < owners[j]->GetNParams(); k++)
+		{
+			if(!owners[j]->IsFree(k))
+				values.push_back(owners[j]->GetParam(k));
+		}
+	}
+}
+
+/// Returns the most recent free generation (see CParameters::GetFreeGeneration) of this model,
+/// its position and shader.  The value changes whenever the layout of the free parameters changes.
+unsigned int CModel::GetTotalFreeGeneration()
+{
+	unsigned int generation = mFreeGeneration;
+	if(mPosition != NULL)
+		generation = max(generation, mPosition->GetFreeGeneration());
+	if(mShader != NULL)
+		generation = max(generation, mShader->GetFreeGeneration());
+
+	return generation;
+}
+
 int CModel::GetTotalFreeParameters()
 {
 	// Sum up the free parameters from the model, position, and features
 	return this->GetNModelFreeParameters() + this->GetNPositionFreeParameters() + this->GetNShaderFreeParameters() + this->GetNFeatureFreeParameters();
 }
 
+/// Returns true if the image of this model changes with time (see SetTime).
+bool CModel::IsTimeDependent()
+{
+	return (mPosition != NULL && mPosition->GetType() == CPosition::ORBIT);
+}
+
+/// Equivalent to glBegin, routed to the software rasterizer when one is active.
+void CModel::Begin(GLenum mode)
+{
+	if(mRasterizer != NULL)
+		mRasterizer->Begin(mode);
+	else
+		glBegin(mode);
+}
+
 void CModel::Color()
 {
-	glColor4d(mParams[3], 0.0, 0.0, 1.0);
+	Color4d(mParams[3], 0.0, 0.0, 1.0);
+}
+
+/// Equivalent to glColor4d, routed to the software rasterizer when one is active.
+void CModel::Color4d(double red, double green, double blue, double alpha)
+{
+	if(mRasterizer != NULL)
+		mRasterizer->Color4d(red, green, blue, alpha);
+	else
+		glColor4d(red, green, blue, alpha);
 }
 
 /// Creates a lookup table of sine and cosine values for use in drawing
@@ -203,12 +283,170 @@ void CModel::CircleTable( double * sint, double * cost, const int n )
     cost[ size ] = cost[ 0 ];
 }
 
+/// Enables or disables depth testing for the current render back end.
+void CModel::DepthTest(bool enable)
+{
+	if(mRasterizer != NULL)
+	{
+		if(enable)
+			mRasterizer->Enable(GL_DEPTH_TEST);
+		else
+			mRasterizer->Disable(GL_DEPTH_TEST);
+	}
+	else
+	{
+		if(enable)
+			glEnable(GL_DEPTH_TEST);
+		else
+			glDisable(GL_DEPTH_TEST);
+	}
+}
+
+/// Draws the triangles in mesh, using the software rasterizer when one is active.
+void CModel::DrawMesh(CMesh & mesh)
+{
+	if(mRasterizer != NULL)
+		mRasterizer->DrawElements(mesh.GetVertices(), mesh.GetNormals(), mesh.GetColors(), mesh.GetNVertices(), mesh.GetIndices(), mesh.GetNIndices());
+	else
+		mesh.Render();
+}
+
+/// Equivalent to glEnd, routed to the software rasterizer when one is active.
+void CModel::End()
+{
+	if(mRasterizer != NULL)
+		mRasterizer->End();
+	else
+		glEnd();
+}
+
+/// Sets the position, color and limb darkening of disk from this model.  Returns false if
+/// the shader has no closed-form visibility.
+bool CModel::InitAnalyticDisk(CAnalyticDisk & disk)
+{
+	double x, y, z;
+	mPosition->GetXYZ(x, y, z);
+
+	// Same transformation as SetupMatrix: (x,y,z) -> (-y, x, -z) on the image.
+	disk.x = -y;
+	disk.y = x;
+	disk.color = mParams[3];
+
+	CGLShaderList::ShaderTypes type = CGLShaderList::NONE;
+	if(mShader != NULL)
+		type = mShader->GetType();
+
+	// Expand the limb darkening laws (see CRasterizer::RasterizeSpan) into powers of mu.
+	double a1 = 0, a2 = 0, a3 = 0, a4 = 0;
+	if(mShader != NULL)
+	{
+		int n = mShader->GetNParams();
+		a1 = (n > 0) ? mShader->GetParam(0) : 0;
+		a2 = (n > 1) ? mShader->GetParam(1) : 0;
+		a3 = (n > 2) ? mShader->GetParam(2) : 0;
+		a4 = (n > 3) ? mShader->GetParam(3) : 0;
+	}
+
+	switch(type)
+	{
+	case CGLShaderList::NONE:
+		disk.AddTerm(0, 1);
+		break;
+
+	case CGLShaderList::LDL_POWERLAW:
+		disk.AddTerm(a1, 1);
+		break;
+
+	case CGLShaderList::LDL_CLARET2000:
+		disk.AddTerm(0, 1 - a1 - a2 - a3 - a4);
+		disk.AddTerm(0.5, a1);
+		disk.AddTerm(1, a2);
+		disk.AddTerm(1.5, a3);
+		disk.AddTerm(2, a4);
+		break;
+
+	case CGLShaderList::LDL_SQUARE_ROOT:
+		disk.AddTerm(0, 1 - a1 - a2);
+		disk.AddTerm(0.5, a2);
+		disk.AddTerm(1, a1);
+		break;
+
+	case CGLShaderList::LDL_QUADRATIC:
+		disk.AddTerm(0, 1 - a1 - a2);
+		disk.AddTerm(1, a1 + 2 * a2);
+		disk.AddTerm(2, -a2);
+		break;
+
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+/// Equivalent to glNormal3d, routed to the software rasterizer when one is active.
+void CModel::Normal3d(double x, double y, double z)
+{
+	if(mRasterizer != NULL)
+		mRasterizer->Normal3d(x, y, z);
+	else
+		glNormal3d(x, y, z);
+}
+
+/// Equivalent to glPopMatrix, routed to the software rasterizer when one is active.
+void CModel::PopMatrix()
+{
+	if(mRasterizer != NULL)
+		mRasterizer->PopMatrix();
+	else
+		glPopMatrix();
+}
+
+/// Equivalent to glPushMatrix, routed to the software rasterizer when one is active.
+void CModel::PushMatrix()
+{
+	if(mRasterizer != NULL)
+		mRasterizer->PushMatrix();
+	else
+		glPushMatrix();
+}
+
+/// Renders the model using the software rasterizer.  The image is not complete
+/// until rasterizer->Finish() is called.
+void CModel::Rasterize(CRasterizer * rasterizer)
+{
+	mRasterizer = rasterizer;
+	DrawModel();
+	mRasterizer = NULL;
+}
+
+/// Renders the model to the specified OpenGL framebuffer object.
+void CModel::Render(GLuint framebuffer_object, int width, int height)
+{
+	// NOTE: When rendering assume that the framebuffer has already been cleared.
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
+
+	DrawModel();
+
+	// Return to the default framebuffer before leaving.
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	CCL_GLThread::CheckOpenGLError("CModel::Render()");
+}
+
 void CModel::Rotate()
 {
 	// Rotations are implemented in the standard way, namely
 	//  R_x(gamma) * R_y(beta) * R_z(alpha)
 	// where gamma = pitch, beta = roll, alpha = yaw.
 
+	if(mRasterizer != NULL)
+	{
+		mRasterizer->Rotated(float(mParams[0]), 1, 0, 0);	// inclination
+		mRasterizer->Rotated(float(mParams[1]), 0, 1, 0); // position angle
+		mRasterizer->Rotated(float(mParams[2]), 0, 0, 1); // roll
+		return;
+	}
+
 	glRotatef(mParams[0], 1, 0, 0);	// inclination
 	glRotatef(mParams[1], 0, 1, 0); // position angle
 	glRotatef(mParams[2], 0, 0, 1); // roll
@@ -248,6 +486,14 @@ void CModel::SetupMatrix()
 {
     // Rotate from (x,y,z) to (North, East, Away).  Note, we are following the (x,y,z)
     // convention of the orbital equations here.
+	if(mRasterizer != NULL)
+	{
+		mRasterizer->LoadIdentity();
+		mRasterizer->Rotated(90, 0, 0, 1);
+		mRasterizer->Scaled(1, 1, -1);
+		return;
+	}
+
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 	glRotatef(90, 0, 0, 1);
@@ -281,37 +527,13 @@ void CModel::SetAnglesFromPosition()
 	{
 		// Inclination
 		if(!this->IsFree(0))
-			mParams[0] = mPosition->GetParam(0);
+			SetParam(0, mPosition->GetParam(0));
 
 		// Omega / Position angle
 		// TODO: Is this right?
 		if(!this->IsFree(1))
-			mParams[1] = mPosition->GetParam(1);
-	}
-}
-
-/// Sets the parameters for this model, the position, shader, and all features.
-void CModel::SetFreeParameters(double * in_params, int n_params, bool scale_params)
-{
-	// Here we use pointer math to advance the position of the array passed to the functions
-	// that set the parameters.  First assign values to this model (use pull_params):
-	int n = 0;
-	SetFreeParams(in_params, n_params, scale_params);
-	n += mNFreeParams;
-	// Now set the values for the position object
-	mPosition->SetFreeParams(in_params + n, n_params - n, scale_params);
-	n += mPosition->GetNFreeParams();
-	// Then the shader.
-	if(mShader != NULL)
-	{
-		mShader->SetFreeParams(in_params + n, n_params - n, scale_params);
-		n += mShader->GetNFreeParams();
+			SetParam(1, mPosition->GetParam(1));
 	}
-	// Lastly the features
-	//features->SetParams(in_params + n, n_params - n);
-
-	// Now copy angles over from the orbit object (if they are not free)
-	SetAnglesFromPosition();
 }
 
 /// Assigns and initializes a position type.
@@ -322,6 +544,8 @@ void CModel::SetPositionType(CPosition::PositionTypes type)
 		return;
 
 	mPosition = CPosition::GetPosition(type);
+	UpdateGeneration();
+	UpdateFreeGeneration();
 }
 
 void CModel::SetTime(double time)
@@ -337,6 +561,8 @@ void CModel::SetTime(double time)
 void CModel::SetShader(CGLShaderWrapperPtr shader)
 {
 	mShader = shader;
+	UpdateGeneration();
+	UpdateFreeGeneration();
 }
 
 void CModel::Translate()
@@ -345,14 +571,37 @@ void CModel::Translate()
 	mPosition->GetXYZ(x, y, z);
 
 	// Call the translation routines.  Use the double-precision call.
+	if(mRasterizer != NULL)
+	{
+		mRasterizer->Translated(float(x), float(y), float(z));
+		return;
+	}
+
 	glTranslatef(x, y, z);
 	CCL_GLThread::CheckOpenGLError("CModel::Translate()");
 }
 
 void CModel::UseShader(double min_xyz[3], double max_xyz[3])
 {
+	if(mRasterizer != NULL)
+	{
+		if(mShader != NULL)
+			mShader->UseShader(mRasterizer, min_xyz, max_xyz);
+
+		return;
+	}
+
 	if(mShader != NULL)
 		mShader->UseShader(min_xyz, max_xyz);
 
 	CCL_GLThread::CheckOpenGLError("CModel::UseShader()");
 }
+
+/// Equivalent to glVertex3d, routed to the software rasterizer when one is active.
+void CModel::Vertex3d(double x, double y, double z)
+{
+	if(mRasterizer != NULL)
+		mRasterizer->Vertex3d(x, y, z);
+	else
+		glVertex3d(x, y, z);
+}
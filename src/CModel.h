@@ -63,7 +63,10 @@
 
 using namespace std;
 
+class CAnalyticDisk;
+class CMesh;
 class CPosition;
+class CRasterizer;
 //class CFeature;
 //class CFeatureList;
 class CGLShaderWrapper;
@@ -85,20 +88,37 @@ protected:
 	bool mShaderLoaded;
 	double mScale;
 
+	// The software rasterizer, non-NULL only while executing Rasterize()
+	CRasterizer * mRasterizer;
+
 protected:
+	// Drawing functions which are routed to either OpenGL or the software rasterizer.
+	void Begin(GLenum mode);
 	void Color();
+	void Color4d(double red, double green, double blue, double alpha);
+	void DepthTest(bool enable);
+	void DrawMesh(CMesh & mesh);
+	void End();
+	bool InitAnalyticDisk(CAnalyticDisk & disk);
+	void Normal3d(double x, double y, double z);
+	void PopMatrix();
+	void PushMatrix();
 	void Rotate();
 	void Translate();
+	void Vertex3d(double x, double y, double z);
 
 public:
 	static void CircleTable( double * sint, double * cost, const int n );
 
+	virtual bool GetAnalyticDisk(CAnalyticDisk & disk) { return false; };
+
 	// Set the parameters in this model, scaling from a uniform hypercube to physical units as necessary.
 	void GetFreeParameters(double * params, int n_params, bool scale_params);
 	vector<string> GetFreeParameterNames();
 	double GetFreePriorProd();
 	vector< pair<double, double> > GetFreeParamMinMaxes();
-	void SetFreeParameters(double * params, int n_params, bool scale_params);
+	void GetFixedParameters(vector<double> & values);
+	unsigned int GetGeneration();
 	void GetAllParameters(double * params, int n_params);
 
 public:
@@ -114,11 +134,18 @@ public:
 	int GetNShaderFreeParameters() { return mShader->GetNFreeParams(); };
 	CPosition * GetPosition(void) { return mPosition; };
 	CGLShaderWrapperPtr GetShader(void) { return mShader; };
+	unsigned int GetTotalFreeGeneration();
 	int GetTotalFreeParameters();
 	CModelList::ModelTypes GetType(void) { return mType; };
 
-	virtual void Render(GLuint framebuffer_object, int width, int height) = 0;
+	bool IsTimeDependent();
+
+protected:
+	virtual void DrawModel() = 0;
+
 public:
+	void Rasterize(CRasterizer * rasterizer);
+	void Render(GLuint framebuffer_object, int width, int height);
 	void Restore(Json::Value input, CGLShaderList * shader_list);
 
 public:
@@ -38,6 +38,8 @@
 #include "CCL_GLThread.h"
 #include "CPosition.h"
 #include "CGLShaderList.h"
+#include "CRasterizer.h"
+#include "CAnalyticDisk.h"
 
 // Models
 #include "CModel.h"
@@ -54,6 +56,9 @@ CModelList::CModelList()
 {
 	mTime = 0;
 	mTimestep = 0;
+	mGeneration = CParameters::NextGeneration();
+	mDrawOrderGeneration = 0;
+	mFreeGeneration = 0;
 }
 
 CModelList::~CModelList()
@@ -94,21 +99,37 @@ CModelPtr CModelList::AddNewModel(ModelTypes model_id)
 	}
 
 	mModels.push_back(tmp);
+	mGeneration = CParameters::NextGeneration();
 	return mModels.back();
 }
 
-/// Returns the total number of free parameters in the models
-int CModelList::GetNFreeParameters()
+/// Describes the models as disks with closed-form visibilities.  Returns false if any model
+/// cannot be described this way, which depends only on the types of the models and shaders.
+/// The disks are summed, so they must not overlap (occlude each other).  This is not checked
+/// because the result would then change with the parameters during a fit.
+bool CModelList::GetAnalyticDisks(vector<CAnalyticDisk> & disks)
 {
-    int n = 0;
+	disks.clear();
+	if(mModels.size() == 0)
+		return false;
 
-    // Now call render on all of the models:
-    for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
-    {
-    	n +=(*it)->GetTotalFreeParameters();
-    }
+	for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
+	{
+		CAnalyticDisk disk;
+		if(!(*it)->GetAnalyticDisk(disk))
+			return false;
+
+		disks.push_back(disk);
+	}
+
+	return true;
+}
 
-    return n;
+/// Returns the total number of free parameters in the models
+int CModelList::GetNFreeParameters()
+{
+	UpdateFreeParameterTable();
+	return mFreeOwners.size();
 }
 
 void CModelList::GetAllParameters(double * params, int n_params)
@@ -123,48 +144,95 @@ void CModelList::GetAllParameters(double * params, int n_params)
     }
 }
 
-vector< pair<double, double> > CModelList::GetFreeParamMinMaxes()
+/// Returns the (min, max) values of all of the free parameters.
+const vector< pair<double, double> > & CModelList::GetFreeParamMinMaxes()
 {
-    vector< pair<double, double> > tmp1;
-    vector< pair<double, double> > tmp2;
-
-    // Now call render on all of the models:
-    for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
-    {
-    	tmp2 = (*it)->GetFreeParamMinMaxes();
-    	tmp1.insert( tmp1.end(), tmp2.begin(), tmp2.end() );
-    }
-
-    return tmp1;
+	UpdateFreeParameterTable();
+	return mFreeMinMaxes;
 }
 
-/// Gets the values for all of the free parameters.
+/// Gets the values for all of the free parameters in a:
+///  scale_params = false => uniform hypercube (x = [0...1])
+///  scale_params = true => native values (x = [param.min... param.max])
 void CModelList::GetFreeParameters(double * params, int n_params, bool scale_params)
 {
-    int n = 0;
+	UpdateFreeParameterTable();
 
-    // Now call render on all of the models:
-    for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
-    {
-    	(*it)->GetFreeParameters(params + n, n_params - n, scale_params);
-    	n += (*it)->GetTotalFreeParameters();
-    }
+	int n = min(n_params, int(mFreeOwners.size()));
+	for(int i = 0; i < n; i++)
+	{
+		params[i] = mFreeOwners[i]->GetParam(mFreeIndices[i]);
+		if(!scale_params)
+			params[i] = (params[i] - mFreeMin[i]) / mFreeScale[i];
+	}
 }
 
 /// Returns a vector of string containing the parameter names.
-vector<string> CModelList::GetFreeParamNames()
+const vector<string> & CModelList::GetFreeParamNames()
+{
+	UpdateFreeParameterTable();
+	return mFreeNames;
+}
+
+/// Returns the models in the order in which they are drawn, farthest (largest z) first.
+/// The positions are evaluated once per model and the order is only recomputed when a
+/// position, or the list of models, has changed.
+const vector<CModelPtr> & CModelList::GetDrawOrder()
 {
-    vector<string> tmp1;
-    vector<string> tmp2;
+	unsigned int generation = mGeneration;
+	for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
+		generation = max(generation, (*it)->GetPosition()->GetGeneration());
 
-    // Now call render on all of the models:
-    for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
-    {
-    	tmp2 = (*it)->GetFreeParameterNames();
-    	tmp1.insert( tmp1.end(), tmp2.begin(), tmp2.end() );
-    }
+	if(generation == mDrawOrderGeneration && mDrawOrder.size() == mModels.size())
+		return mDrawOrder;
+
+	// Sort (-z, index) pairs, the index keeps the order of models at equal depth stable.
+	double x, y, z;
+	vector< pair<double, unsigned int> > depths(mModels.size());
+	for(unsigned int i = 0; i < mModels.size(); i++)
+	{
+		mModels[i]->GetPosition()->GetXYZ(x, y, z);
+		depths[i] = make_pair(-z, i);
+	}
+
+	sort(depths.begin(), depths.end());
+
+	mDrawOrder.resize(mModels.size());
+	for(unsigned int i = 0; i < depths.size(); i++)
+		mDrawOrder[i] = mModels[depths[i].second];
+
+	mDrawOrderGeneration = generation;
+	return mDrawOrder;
+}
+
+/// Returns the values of the fixed parameters of all models (see CModel::GetFixedParameters).
+void CModelList::GetFixedParameters(vector<double> & values)
+{
+	values.clear();
+	for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
+		(*it)->GetFixedParameters(values);
+}
+
+/// Returns a value which changes whenever models are added or removed, or the layout of the
+/// free parameters (which are free, their ranges, the position and shader types) changes.
+unsigned int CModelList::GetFreeGeneration()
+{
+	unsigned int generation = mGeneration;
+	for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
+		generation = max(generation, (*it)->GetTotalFreeGeneration());
+
+	return generation;
+}
 
-    return tmp1;
+/// Returns a value which changes whenever anything affecting the rendered image changes:
+/// the list of models, or the parameters, position (including time) or shader of any model.
+unsigned int CModelList::GetGeneration()
+{
+	unsigned int generation = mGeneration;
+	for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
+		generation = max(generation, (*it)->GetGeneration());
+
+	return generation;
 }
 
 /// Returns a pair of model names, and their enumerated types
@@ -184,12 +252,13 @@ vector< pair<CModelList::ModelTypes, string> > CModelList::GetTypes(void)
 /// Returns the product of priors from all models
 double CModelList::GetFreeParameterPriorProduct()
 {
-	double tmp = 1;
+	UpdateFreeParameterTable();
 
-    for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
-    	tmp *= (*it)->GetFreePriorProd();
+	double tmp = 1;
+	for(unsigned int i = 0; i < mFreeOwners.size(); i++)
+		tmp *= mFreeOwners[i]->GetPrior(mFreeIndices[i]);
 
-    return tmp;
+	return tmp;
 }
 
 /// Increments the time by the set timestep value.
@@ -198,13 +267,68 @@ void CModelList::IncrementTime()
 	SetTime(mTime + mTimestep);
 }
 
+/// Returns true if any model changes with time.  If not, a single image serves every data set.
+bool CModelList::IsTimeDependent()
+{
+    for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
+    {
+    	if((*it)->IsTimeDependent())
+    		return true;
+    }
+
+	return false;
+}
+
+/// Computes the positions of all models at the specified times (e.g. the epochs of the data)
+/// in one pass, see CPosition::Precompute.
+void CModelList::PrecomputePositions(const vector<double> & times)
+{
+    for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
+    	(*it)->GetPosition()->Precompute(times);
+}
+
+/// Render the image using the software rasterizer.  On return the image
+/// is available from rasterizer->GetImage().
+void CModelList::Rasterize(CRasterizer * rasterizer)
+{
+	// Same depth ordering as CModelList::Render
+	const vector<CModelPtr> & models = GetDrawOrder();
+
+	// With several models, each model is drawn to its own layer which is only redrawn when
+	// the model changes (e.g. while the Jacobian perturbs a single model).
+	if(models.size() > 1)
+	{
+		vector<const void *> keys;
+		for(auto model : models)
+		{
+			unsigned int generation = model->GetGeneration();
+			if(!rasterizer->HasLayer(model.get(), generation))
+			{
+				rasterizer->Clear();
+				model->Rasterize(rasterizer);
+				rasterizer->FinishLayer(model.get(), generation);
+			}
+
+			keys.push_back(model.get());
+		}
+
+		rasterizer->Composite(keys);
+		return;
+	}
+
+	rasterizer->Clear();
+
+	for(auto model : models)
+		model->Rasterize(rasterizer);
+
+	rasterizer->Finish();
+}
+
 // Render the image to the specified OpenGL framebuffer object.
 void CModelList::Render(GLuint fbo, int width, int height)
 {
 	// We render the models in order by depth (i.e. z-direction).
-	// To do this, we do a shallow copy of the model vector, then sort by z.
-	vector<CModelPtr> models = mModels;
-	sort(models.begin(), models.end(), SortByZ);
+	const vector<CModelPtr> & models = GetDrawOrder();
 
 	// First clear the buffer.
     glBindFramebuffer(GL_FRAMEBUFFER, fbo);
@@ -230,6 +354,8 @@ void CModelList::Restore(Json::Value input, CGLShaderList * shader_list)
 	if(mModels.size() > 0)
 		mModels.clear();
 
+	mGeneration = CParameters::NextGeneration();
+
 	CModelList::ModelTypes type = CModelList::NONE;
 	CModelPtr model;
 	Json::Value tmp;
@@ -270,17 +396,32 @@ Json::Value CModelList::Serialize()
     return output;
 }
 
-/// Sets all of the free parameter values
-void CModelList::SetFreeParameters(double * params, unsigned int n_params, bool scale_params)
+/// Sets all of the free parameter values.  If scale_params = true the values are scaled from
+/// x = [0...1] into [param.min ... param.max].  Only objects whose values change are marked as changed.
+void CModelList::SetFreeParameters(const double * params, unsigned int n_params, bool scale_params)
 {
-	unsigned int n = 0;
+	UpdateFreeParameterTable();
 
-    // Now call render on all of the models:
-    for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
-    {
-    	(*it)->SetFreeParameters(params + n, n_params - n, scale_params);
-    	n += (*it)->GetTotalFreeParameters();
-    }
+	// Remember the position generations so we can tell which positions moved.
+	mPositionGenerations.resize(mModels.size());
+	for(unsigned int i = 0; i < mModels.size(); i++)
+		mPositionGenerations[i] = mModels[i]->GetPosition()->GetGeneration();
+
+	unsigned int n = min(n_params, (unsigned int) mFreeOwners.size());
+	for(unsigned int i = 0; i < n; i++)
+	{
+		if(scale_params)
+			mFreeOwners[i]->SetParam(mFreeIndices[i], mFreeScale[i] * params[i] + mFreeMin[i]);
+		else
+			mFreeOwners[i]->SetParam(mFreeIndices[i], params[i]);
+	}
+
+	// Now copy angles over from the orbit objects (if they are not free)
+	for(unsigned int i = 0; i < mModels.size(); i++)
+	{
+		if(mModels[i]->GetPosition()->GetGeneration() != mPositionGenerations[i])
+			mModels[i]->SetAnglesFromPosition();
+	}
 }
 
 void CModelList::SetPositionType(unsigned int model_id, CPosition::PositionTypes pos_type)
@@ -310,16 +451,48 @@ void CModelList::SetTimestep(double dt)
 	mTimestep = dt;
 }
 
-bool CModelList::SortByZ(const CModelPtr & A, const CModelPtr & B)
+/// Rebuilds the flattened table of free parameters if the models, or which of their
+/// parameters are free (or the ranges of these parameters), have changed.  The order of the
+/// table matches CModel::GetFreeParameters: the model, its position, and then its shader.
+void CModelList::UpdateFreeParameterTable()
 {
-	double ax, ay, az;
-	double bx, by, bz;
+	unsigned int generation = GetFreeGeneration();
+	if(generation == mFreeGeneration)
+		return;
 
-	A->GetPosition()->GetXYZ(ax, ay, az);
-	B->GetPosition()->GetXYZ(bx, by, bz);
+	mFreeOwners.clear();
+	mFreeIndices.clear();
+	for(vector<CModelPtr>::iterator it = mModels.begin(); it != mModels.end(); ++it)
+	{
+		CParameters * owners[3] = {it->get(), (*it)->GetPosition(), (*it)->GetShader().get()};
+		for(unsigned int j = 0; j < 3; j++)
+		{
+			if(owners[j] == NULL)
+				continue;
+
+			for(int k = 0; k < owners[j]->GetNParams(); k++)
+			{
+				if(!owners[j]->IsFree(k))
+					continue;
+
+				mFreeOwners.push_back(owners[j]);
+				mFreeIndices.push_back(k);
+			}
+		}
+	}
 
-	if(az > bz)
-		return true;
+	unsigned int n = mFreeOwners.size();
+	mFreeMin.resize(n);
+	mFreeScale.resize(n);
+	mFreeMinMaxes.resize(n);
+	mFreeNames.resize(n);
+	for(unsigned int i = 0; i < n; i++)
+	{
+		mFreeMin[i] = mFreeOwners[i]->GetMin(mFreeIndices[i]);
+		mFreeScale[i] = mFreeOwners[i]->GetMax(mFreeIndices[i]) - mFreeMin[i];
+		mFreeMinMaxes[i] = pair<double, double>(mFreeMin[i], mFreeOwners[i]->GetMax(mFreeIndices[i]));
+		mFreeNames[i] = mFreeOwners[i]->GetName() + '.' + mFreeOwners[i]->GetParamName(mFreeIndices[i]);
+	}
 
-	return false;
+	mFreeGeneration = generation;
 }
@@ -45,9 +45,12 @@ using namespace std;
 #include "enumerations.h"
 #include "CPosition.h"
 
+class CAnalyticDisk;
 class CModel;
+class CParameters;
 class CGLShaderWrapper;
 class CGLShaderList;
+class CRasterizer;
 
 typedef shared_ptr<CModel> CModelPtr;
 typedef shared_ptr<CGLShaderWrapper> CGLShaderWrapperPtr;
@@ -77,6 +80,22 @@ public:
 protected:
 	double mTime;
 	double mTimestep;
+	unsigned int mGeneration;	// changes when models are added or removed
+
+	// The models sorted by depth, valid while no position has changed.
+	vector<CModelPtr> mDrawOrder;
+	unsigned int mDrawOrderGeneration;
+
+	// The free parameters of all models flattened into the order used by the minimizers.
+	// Entry i is parameter mFreeIndices[i] of mFreeOwners[i], see UpdateFreeParameterTable.
+	vector<CParameters*> mFreeOwners;
+	vector<int> mFreeIndices;
+	vector<double> mFreeMin;
+	vector<double> mFreeScale;	// max - min
+	vector< pair<double, double> > mFreeMinMaxes;
+	vector<string> mFreeNames;
+	unsigned int mFreeGeneration;
+	vector<unsigned int> mPositionGenerations;	// scratch for SetFreeParameters
 
 public:
 	CModelList();
@@ -84,32 +103,44 @@ public:
 
 	CModelPtr AddNewModel(ModelTypes model_id);
 
+	bool GetAnalyticDisks(vector<CAnalyticDisk> & disks);
 	int GetNFreeParameters();
 	void GetAllParameters(double * params, int n_params);
-	vector< pair<double, double> > GetFreeParamMinMaxes();
+	const vector< pair<double, double> > & GetFreeParamMinMaxes();
 	void GetFreeParameters(double * params, int n_params, bool scale_params);
 	void GetFreeParametersScaled(double * params, int n_params);
 	double GetFreeParameterPriorProduct();
-	vector<string> GetFreeParamNames();
+	const vector<string> & GetFreeParamNames();
+	unsigned int GetFreeGeneration();
+	void GetFixedParameters(vector<double> & values);
+protected:
+	const vector<CModelPtr> & GetDrawOrder();
+public:
+	unsigned int GetGeneration();
 	CModelPtr GetModel(int i) { return mModels.at(i); };
 	double GetTime() { return mTime; };
 
 	static vector< pair<ModelTypes, string> > GetTypes(void);
 
 	void IncrementTime();
+	bool IsTimeDependent();
 
+	void PrecomputePositions(const vector<double> & times);
+
+	void Rasterize(CRasterizer * rasterizer);
 	void Render(GLuint fbo, int width, int height);
 	void Restore(Json::Value input, CGLShaderList * shader_list);
 
 	Json::Value Serialize();
-	void SetFreeParameters(double * params, unsigned int n_params, bool scale_params);
+	void SetFreeParameters(const double * params, unsigned int n_params, bool scale_params);
 	void SetPositionType(unsigned int model_id, CPosition::PositionTypes pos_type);
 	void SetShader(unsigned int model_id, CGLShaderWrapperPtr shader);
 	void SetTime(double t);
 	void SetTimestep(double dt);
 	unsigned int size() { return mModels.size(); };
 
-	static bool SortByZ(const CModelPtr & A, const CModelPtr & B);
+protected:
+	void UpdateFreeParameterTable();
 
 };
 
@@ -40,6 +40,8 @@
 // A number after which we consider a parameter to be zero.
 #define ZERO_COMP 1E-8
 
+atomic<unsigned int> CParameters::sLastGeneration(0);
+
 CParameters::CParameters(int n_params)
 {
 	// Init the parameter storage location
@@ -50,6 +52,8 @@ CParameters::CParameters(int n_params)
 	mScales = new double[mNParams];
 	mMinMax = new pair<double,double>[mNParams];
 	mName = "";
+	mGeneration = NextGeneration();
+	mFreeGeneration = NextGeneration();
 
 	// Init parameter values.
 	for(int i = 0; i < mNParams; i++)
@@ -78,6 +82,8 @@ void CParameters::CountFree(void)
 		if(mFreeParams[i])
 			mNFreeParams += 1;
 	}
+
+	UpdateFreeGeneration();
 }
 
 /// Returns the maximum allowable value of the specified parameter, -1 if param_num is out of bounds.
@@ -221,6 +227,13 @@ bool CParameters::IsFree(int param_num)
 	return false;
 }
 
+/// Returns a new, globally unique, generation number.  Generation numbers are used to
+/// detect whether anything affecting a rendered image has changed since it was rendered.
+unsigned int CParameters::NextGeneration()
+{
+	return ++sLastGeneration;
+}
+
 /// Restores parameters values from the JSON value
 void CParameters::Restore(Json::Value input)
 {
@@ -241,6 +254,7 @@ void CParameters::Restore(Json::Value input)
 	}
 
 	CountFree();
+	UpdateGeneration();
 }
 
 /// Toggles the state of all variables to free (is_free = true) or fixed (is_free = false)
@@ -257,21 +271,31 @@ void CParameters::SetAllFree(bool is_free)
 /// otherwise if scale_params = false the parameters are assumed to be scaled.
 void CParameters::SetFreeParams(double * in_params, int n_params, bool scale_params)
 {
-	// Set the parameter values
-	push_params(in_params, n_params, mParams, mNParams, mFreeParams);
-
-	// If the parameters do not need to be scaled, we are done.
-	if(!(scale_params))
-		return;
-
-	// Scale the parameters into regular units
+	// Set the parameter values, scaling them into regular units if requested:
 	// f(x) = (x - min) / (max - min) // the scaled value (see GetFreeParams)
 	// x = f(x) * (max - min) + min   // restore the original value.
-	for(int i = 0; i < mNParams; i++)
+	// Compare as we go so we can tell whether anything changed.
+	bool changed = false;
+	int j = 0;
+	for(int i = 0; i < mNParams && j < n_params; i++)
 	{
-		if(mFreeParams[i])
-			mParams[i] = (mMinMax[i].second - mMinMax[i].first) * mParams[i] + mMinMax[i].first;
+		if(!mFreeParams[i])
+			continue;
+
+		double value = in_params[j];
+		j++;
+		if(scale_params)
+			value = (mMinMax[i].second - mMinMax[i].first) * value + mMinMax[i].first;
+
+		if(mParams[i] != value)
+		{
+			mParams[i] = value;
+			changed = true;
+		}
 	}
+
+	if(changed)
+		UpdateGeneration();
 }
 
 /// Sets the specified parameter as free (is_free = true) or fixed (is_free = false)
@@ -288,22 +312,31 @@ void CParameters::SetFree(int param_num, bool is_free)
 void CParameters::SetMin(int param_num, double value)
 {
 	if(param_num < mNParams)
+	{
 		mMinMax[param_num].first = value;
+		UpdateFreeGeneration();
+	}
 }
 
 /// Sets the specified paramter's maximum value.
 void CParameters::SetMax(int param_num, double value)
 {
 	if(param_num < mNParams)
+	{
 		mMinMax[param_num].second = value;
+		UpdateFreeGeneration();
+	}
 }
 
 /// Sets the specified parameter to the indicated value.
 /// Note, scaling from the unit hypercube is not applied.
 void CParameters::SetParam(int n_param, double value)
 {
-	if(n_param < mNParams)
+	if(n_param < mNParams && mParams[n_param] != value)
+	{
 		mParams[n_param] = value;
+		UpdateGeneration();
+	}
 }
 
 /// Serializes the parameters to a Json::Value object
@@ -38,6 +38,7 @@
 #include <vector>
 #include <string>
 #include <utility>
+#include <atomic>
 #include "json/json.h"
 
 using namespace std;
@@ -56,6 +57,13 @@ protected:
 
 	string mName;
 
+	// Changes whenever a parameter value changes (see UpdateGeneration).
+	unsigned int mGeneration;
+	static atomic<unsigned int> sLastGeneration;
+
+	// Changes whenever the set of free parameters, or their ranges, change.
+	unsigned int mFreeGeneration;
+
 public:
 	CParameters(int n_params);
 	virtual ~CParameters();
@@ -63,6 +71,8 @@ public:
 protected:
 	void CountFree(void);
 	void CalculateScale(int param_num);
+	void UpdateFreeGeneration() { mFreeGeneration = NextGeneration(); };
+	void UpdateGeneration() { mGeneration = NextGeneration(); };
 
 public:
 	void GetFreeParams(double * params, int n_param, bool scale_params);
@@ -73,7 +83,9 @@ public:
 	int GetNParams(void) { return mNParams; };
 	double GetMax(int param_num);
 	double GetMin(int param_num);
+	unsigned int GetFreeGeneration() { return mFreeGeneration; };
 	vector< pair<double, double> > GetFreeMinMaxes();
+	unsigned int GetGeneration() { return mGeneration; };
 	void GetParams(double * params, unsigned int n_params);
 	double GetParam(int i);
 	double GetPrior(int i);
@@ -83,6 +95,8 @@ public:
 
 	bool IsFree(int param_num);
 
+	static unsigned int NextGeneration();
+
 	virtual void Restore(Json::Value input);
 
 	void SetAllFree(bool is_free);
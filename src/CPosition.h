@@ -63,6 +63,8 @@ public:
 
 	// Computes the (X,Y,Z) position of an object.  Z should be set to zero if not computed.
 	virtual void GetXYZ(double & x, double & y, double & z);
+	// Prepares the positions at the specified times in advance (e.g. the epochs of the data).
+	virtual void Precompute(const vector<double> & times) {};
 	static CPosition * GetPosition(CPosition::PositionTypes type);
 	static vector< pair<CPosition::PositionTypes, string> > GetTypes();
 };
@@ -34,6 +34,7 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <cstdio>
+#include <algorithm>
 
 #ifdef M_PI
 #define PI M_PI
@@ -76,57 +77,47 @@ double CPositionOrbit::ComputeM(double tau, double n, double t)
     return n*(t - tau);
 }
 
-double CPositionOrbit::ComputeE(double M, double e)
+/// Solves Kepler's equation, M = E - e sin(E), for n mean anomalies at once using the
+/// Newton-Raphson method.  The epochs are iterated together and iteration stops once every
+/// epoch has converged.  Note, the loops call the scalar (double precision) sin and cos and
+/// reduce the largest step, so they are not vectorized; there is one epoch per data set so
+/// the saving comes from solving once per parameter vector (see Precompute), not from SIMD.
+void CPositionOrbit::ComputeE(const double * M, double e, double * E, unsigned int n)
 {
     /*
-    Solve Kepler's equation, M = E - e sin(E), using a Newton-Raphson method:
-
     TODO: This function could be rewritten to use Laguerre polynomials:
     http://www.springerlink.com/content/p122000960815647/
     as it has been shown to converge for all e, and faster than the Newton-Raphson
     method used below.
-
-    TODO: Possibly try memoization of of E given (M, e).  Should help speed things up
-    a little, especially if M and e are held constant.
     */
 
-    int i = 0;
-
-    //printf("M %f \n", M);
-    // Initial guess (from Smith (1979))
-    double E = M + e * sin(M) / (1 - sin(M + e) + sin(M));
-    double E_old = 0;
-    //printf("E0 %f \n", E);
-
-    // Below we are using the Newton-Raphson solution.  The second term is the derivative
-    // of Kepler's equation.
-    if(e > 0.5)
+    // Initial guess (from Danby (1988)), which converges for all e < 1 once M is reduced
+    // to [-pi, pi].  Only sin(E) and cos(E) are used, so E need not be restored.
+    vector<double> M_r(n);
+    for(unsigned int k = 0; k < n; k++)
     {
-		do
-		{
-			i++;
-			E_old = E;
-			E = E_old + (M + e * sin(E_old) - E_old) / (1 - e * cos(E_old));
-			//printf("E %f \n", E);
-		}
-		while ((i < ORBIT_MAX_ITERATIONS) && ((E - E_old) > ORBIT_THRESH));
+        M_r[k] = M[k] - 2 * PI * floor(M[k] / (2 * PI) + 0.5);
+        E[k] = M_r[k] + 0.85 * e * ((sin(M_r[k]) < 0) ? -1 : 1);
     }
-    else
+
+    double delta, max_delta;
+    for(int i = 0; i < ORBIT_MAX_ITERATIONS; i++)
     {
-		do
-		{
-			i++;
-			E_old = E;
-			E = M + e * sin(E);
-		} while ((i < ORBIT_MAX_ITERATIONS) && ((E - E_old) > ORBIT_THRESH));
+        // The second term is the derivative of Kepler's equation.
+        max_delta = 0;
+        for(unsigned int k = 0; k < n; k++)
+        {
+            delta = (M_r[k] + e * sin(E[k]) - E[k]) / (1 - e * cos(E[k]));
+            E[k] += delta;
+            max_delta = max(max_delta, fabs(delta));
+        }
+
+        if(max_delta < ORBIT_THRESH)
+            break;
     }
 
-//    if(i == (MAX_ITERATIONS - 1))
+//    if(max_delta >= ORBIT_THRESH)
 //        printf("WARNING: Failed to Solve Kepler's Equation!");
-
-    //printf("Ef %f \n", E);
-
-    return E;
 }
 
 // Computes the coefficients, L1, L2, M1, M2, N1, N2 for the orbital equations
@@ -160,7 +151,8 @@ void CPositionOrbit::Compute_xyz(double a, double beta, double e,
     z = a * (n1 * cos_E + beta * n2 * sin_E - e * n1);
 }
 
-void CPositionOrbit::GetXYZ(double & x, double & y, double & z)
+/// Computes the positions at the n times t.
+void CPositionOrbit::ComputeXYZ(const double * t, unsigned int n, XYZ * xyz)
 {
 	// Local variables (mostly renaming mParams variables for convenience).
 	// Remember to convert the angular parameters into radians.
@@ -172,18 +164,83 @@ void CPositionOrbit::GetXYZ(double & x, double & y, double & z)
     double e = mParams[4];
     double tau = mParams[5];
     double T = mParams[6];
-    double t = mTime;
 
 	// Pre-compute a few values
-    double n = ComputeN(T);
-    double M = ComputeM(tau, n, t);
-    double E = ComputeE(M, e);
-
-    double cos_E = cos(E);
-    double sin_E = sin(E);
+    double mean_motion = ComputeN(T);
     double beta = sqrt(1 - e*e);
+    vector<double> M(n);
+    vector<double> E(n);
+
+    for(unsigned int k = 0; k < n; k++)
+    	M[k] = ComputeM(tau, mean_motion, t[k]);
+
+    ComputeE(&M[0], e, &E[0], n);
 
     // Now compute the orbital coefficients
     Compute_Coefficients(Omega, inc, omega, l1, m1, n1, l2, m2, n2);
-    Compute_xyz(alpha, beta, e, l1, l2, m1, m2, n1, n2, cos_E, sin_E, x, y, z);
+    for(unsigned int k = 0; k < n; k++)
+    	Compute_xyz(alpha, beta, e, l1, l2, m1, m2, n1, n2, cos(E[k]), sin(E[k]), xyz[k].x, xyz[k].y, xyz[k].z);
+}
+
+/// Returns the position at the current time.  Positions are cached, so repeated calls
+/// (e.g. from CModelList::GetDrawOrder) only solve Kepler's equation once per epoch.
+void CPositionOrbit::GetXYZ(double & x, double & y, double & z)
+{
+	UpdateCache();
+
+	map<double, XYZ>::iterator it = mCache.find(mTime);
+	if(it == mCache.end())
+	{
+		XYZ xyz;
+		ComputeXYZ(&mTime, 1, &xyz);
+		it = mCache.insert(make_pair(mTime, xyz)).first;
+	}
+
+	x = it->second.x;
+	y = it->second.y;
+	z = it->second.z;
+}
+
+/// Computes the positions at all of the specified times in one pass.
+void CPositionOrbit::Precompute(const vector<double> & times)
+{
+	UpdateCache();
+
+	vector<double> t;
+	for(auto time : times)
+	{
+		if(mCache.find(time) == mCache.end())
+			t.push_back(time);
+	}
+
+	if(t.size() == 0)
+		return;
+
+	vector<XYZ> xyz(t.size());
+	ComputeXYZ(&t[0], t.size(), &xyz[0]);
+
+	for(unsigned int k = 0; k < t.size(); k++)
+		mCache[t[k]] = xyz[k];
+}
+
+/// Sets the time at which the position is computed.
+void CPositionOrbit::SetTime(double t)
+{
+	if(mTime != t)
+	{
+		mTime = t;
+		UpdateGeneration();
+	}
+}
+
+/// Discards the cached positions if the orbital parameters have changed (or if the cache
+/// has grown too large, e.g. during animation).
+void CPositionOrbit::UpdateCache()
+{
+	bool changed = (mCacheParams.size() != (unsigned int) mNParams) || !equal(mCacheParams.begin(), mCacheParams.end(), mParams);
+	if(changed || mCache.size() > sMaxCacheSize)
+	{
+		mCache.clear();
+		mCacheParams.assign(mParams, mParams + mNParams);
+	}
 }
@@ -37,12 +37,29 @@
 double const ORBIT_THRESH = 1E-8;
 int const ORBIT_MAX_ITERATIONS = 50;
 
+#include <map>
+#include <vector>
 #include "CPosition.h"
 
+using namespace std;
+
 class CPositionOrbit: public CPosition
 {
 protected:
-	float mTime;
+	/// A position on the orbit
+	struct XYZ
+	{
+		double x;
+		double y;
+		double z;
+	};
+
+	double mTime;
+
+	// Positions computed for the current orbital parameters (mCacheParams), keyed by time.
+	map<double, XYZ> mCache;
+	vector<double> mCacheParams;
+	static const unsigned int sMaxCacheSize = 4096;
 
 public:
 	CPositionOrbit();
@@ -51,18 +68,22 @@ public:
 protected:
 	double ComputeN(double T);
 	double ComputeM(double tau, double n, double t);
-	double ComputeE(double M, double e);
+	void ComputeE(const double * M, double e, double * E, unsigned int n);
 	void Compute_Coefficients(double Omega, double inc, double omega,
 			double & L1, double & M1, double & N1, double & L2, double & M2, double & N2);
 	void Compute_xyz(double a, double beta, double e,
 			double l1, double l2, double m1, double m2, double n1, double n2,
 			double cos_E, double sin_E,
 			double & x, double & y, double & z);
+	void ComputeXYZ(const double * t, unsigned int n, XYZ * xyz);
+	void UpdateCache();
 
 public:
 	void GetXYZ(double & x, double & y, double & z);
 
-	void SetTime(double t) { mTime = t; };
+	void Precompute(const vector<double> & times);
+
+	void SetTime(double t);
 };
 
 #endif /* CPOSITIONORBIT_H_ */
@@ -0,0 +1,755 @@
+/*
+ * CRasterizer.cpp
+ *
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include "CRasterizer.h"
+#include "CThreadPool.h"
+
+#ifndef PI
+#ifdef M_PI
+#define PI M_PI
+#else
+#define PI 3.1415926535897932384626433832795028841968
+#endif // M_PI
+#endif // PI
+
+CRasterizer::CRasterizer(CThreadPool * thread_pool)
+{
+	mThreadPool = thread_pool;
+
+	mWidth = 0;
+	mHeight = 0;
+	mScale = 0.01;
+	mAreaDepth = 100;
+	// 2x2 samples per pixel approximates the 4x multisampling used by the OpenGL path.
+	mSupersample = 2;
+	mSampleWidth = 0;
+	mSampleHeight = 0;
+	mBandHeight = 8 * mSupersample;
+
+	unsigned int n_threads = 1;
+	if(mThreadPool != NULL)
+		n_threads = mThreadPool->GetNThreads();
+	mScratch.resize(n_threads);
+
+	// Default OpenGL state.
+	mMatrixStack.resize(1);
+	LoadIdentity();
+	Color4d(1, 1, 1, 1);
+	Normal3d(0, 0, 1);
+	mState.shader = CGLShaderList::NONE;
+	for(int i = 0; i < 4; i++)
+		mState.params[i] = 0;
+	mState.depth_test = true;
+	mStateChanged = true;
+	mMaxZ = 1;
+	mPrimitive = GL_TRIANGLES;
+
+	SetImageInfo(1, 1, mScale, mAreaDepth);
+}
+
+CRasterizer::~CRasterizer()
+{
+
+}
+
+/// Converts a triangle to window coordinates and appends it to the render queue.
+void CRasterizer::AddTriangle(const Vertex & v0, const Vertex & v1, const Vertex & v2)
+{
+	Triangle tri;
+	tri.x[0] = v0.x;
+	tri.x[1] = v1.x;
+	tri.x[2] = v2.x;
+	tri.y[0] = v0.y;
+	tri.y[1] = v1.y;
+	tri.y[2] = v2.y;
+
+	// Skip degenerate (zero area) triangles, they cover no samples.
+	double area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+	if(fabs(area) < 1E-12)
+		return;
+
+	tri.y_min = min(tri.y[0], min(tri.y[1], tri.y[2]));
+	tri.y_max = max(tri.y[0], max(tri.y[1], tri.y[2]));
+	if(tri.y_max < 0 || tri.y_min > mSampleHeight)
+		return;
+
+	tri.depth = GetPlane(tri, v0.z, v1.z, v2.z);
+	tri.red = GetPlane(tri, v0.red, v1.red, v2.red);
+	tri.alpha = GetPlane(tri, v0.alpha, v1.alpha, v2.alpha);
+	tri.normal_z = GetPlane(tri, v0.normal_z, v1.normal_z, v2.normal_z);
+	tri.transparency = GetPlane(tri, v0.transparency, v1.transparency, v2.transparency);
+
+	if(mStateChanged)
+	{
+		mStates.push_back(mState);
+		mStateChanged = false;
+	}
+	tri.state = mStates.size() - 1;
+
+	mTriangles.push_back(tri);
+}
+
+/// Equivalent to glBegin
+void CRasterizer::Begin(GLenum mode)
+{
+	mPrimitive = mode;
+	mVertices.clear();
+}
+
+/// Clears the color and depth buffers and discards any queued geometry.
+void CRasterizer::Clear()
+{
+	fill(mSampleRed.begin(), mSampleRed.end(), 0.0f);
+	fill(mSampleDepth.begin(), mSampleDepth.end(), 1.0f);
+	fill(mSampleTransmission.begin(), mSampleTransmission.end(), 1.0f);
+	mTriangles.clear();
+	mStates.clear();
+	mStateChanged = true;
+}
+
+/// Equivalent to glColor4d.  Only the red and alpha channels are used.
+void CRasterizer::Color4d(double red, double green, double blue, double alpha)
+{
+	mColor[0] = red;
+	mColor[1] = green;
+	mColor[2] = blue;
+	mColor[3] = alpha;
+}
+
+/// Composites the layers, in order from back to front, into the image.  Each layer is
+/// depth tested against the layers before it as a whole, so the result matches Finish()
+/// unless the surfaces of two layers intersect.  Layers not listed are discarded.
+void CRasterizer::Composite(const vector<const void *> & keys)
+{
+	// Discard the layers of objects which are no longer drawn.
+	for(auto it = mLayers.begin(); it != mLayers.end(); )
+	{
+		if(find(keys.begin(), keys.end(), it->first) == keys.end())
+			it = mLayers.erase(it);
+		else
+			++it;
+	}
+
+	vector<const Layer *> layers;
+	for(const void * key : keys)
+	{
+		auto it = mLayers.find(key);
+		if(it != mLayers.end())
+			layers.push_back(&it->second);
+	}
+
+	unsigned int n_bands = (mSampleHeight + mBandHeight - 1) / mBandHeight;
+
+	if(mThreadPool != NULL)
+	{
+		mThreadPool->ParallelFor(n_bands, [this, &layers](unsigned int band, unsigned int thread_id)
+		{
+			CompositeBand(band, layers);
+			Resolve(band);
+		});
+	}
+	else
+	{
+		for(unsigned int band = 0; band < n_bands; band++)
+		{
+			CompositeBand(band, layers);
+			Resolve(band);
+		}
+	}
+}
+
+/// Blends the layers into the samples of one band.
+void CRasterizer::CompositeBand(unsigned int band, const vector<const Layer *> & layers)
+{
+	const int row_min = band * mBandHeight;
+	const int row_max = min(row_min + mBandHeight, mSampleHeight);
+	const unsigned int start = row_min * mSampleWidth;
+	const unsigned int end = row_max * mSampleWidth;
+
+	float * out_red = &mSampleRed[0];
+	float * out_depth = &mSampleDepth[0];
+
+	for(unsigned int k = start; k < end; k++)
+	{
+		out_red[k] = 0;
+		out_depth[k] = 1;
+	}
+
+	for(const Layer * layer : layers)
+	{
+		const float * red = &layer->red[0];
+		const float * transmission = &layer->transmission[0];
+		const float * depth = &layer->depth[0];
+
+		for(unsigned int k = start; k < end; k++)
+		{
+			// Layers which wrote no depth were drawn without depth testing and always blend.
+			if(depth[k] < 1)
+			{
+				if(!(depth[k] < out_depth[k]))
+					continue;
+
+				out_depth[k] = depth[k];
+			}
+
+			out_red[k] = red[k] + out_red[k] * transmission[k];
+		}
+	}
+}
+
+/// Equivalent to glDisable. Only GL_DEPTH_TEST is supported.
+void CRasterizer::Disable(GLenum cap)
+{
+	if(cap == GL_DEPTH_TEST && mState.depth_test)
+	{
+		mState.depth_test = false;
+		mStateChanged = true;
+	}
+}
+
+/// Equivalent to glDrawElements(GL_TRIANGLES, ...) with vertex, normal and color arrays
+/// (see CMesh).  Each vertex is transformed once, however many triangles share it.
+void CRasterizer::DrawElements(const GLfloat * vertices, const GLfloat * normals, const GLfloat * colors, unsigned int n_vertices, const GLuint * indices, unsigned int n_indices)
+{
+	vector<Vertex> transformed(n_vertices);
+	for(unsigned int i = 0; i < n_vertices; i++)
+	{
+		const GLfloat * v = vertices + 3 * i;
+		const GLfloat * n = normals + 3 * i;
+		const GLfloat * c = colors + 4 * i;
+		transformed[i] = TransformVertex(v[0], v[1], v[2], n[0], n[1], n[2], c[0], c[3]);
+	}
+
+	for(unsigned int i = 0; i + 2 < n_indices; i += 3)
+		AddTriangle(transformed[indices[i]], transformed[indices[i + 1]], transformed[indices[i + 2]]);
+}
+
+/// Equivalent to glEnable. Only GL_DEPTH_TEST is supported.
+void CRasterizer::Enable(GLenum cap)
+{
+	if(cap == GL_DEPTH_TEST && !mState.depth_test)
+	{
+		mState.depth_test = true;
+		mStateChanged = true;
+	}
+}
+
+/// Equivalent to glEnd, converts the current primitive into triangles.
+void CRasterizer::End()
+{
+	const unsigned int n = mVertices.size();
+
+	switch(mPrimitive)
+	{
+	case GL_TRIANGLES:
+		for(unsigned int i = 0; i + 2 < n; i += 3)
+			AddTriangle(mVertices[i], mVertices[i + 1], mVertices[i + 2]);
+		break;
+
+	case GL_TRIANGLE_STRIP:
+		for(unsigned int i = 0; i + 2 < n; i++)
+			AddTriangle(mVertices[i], mVertices[i + 1], mVertices[i + 2]);
+		break;
+
+	case GL_QUADS:
+		for(unsigned int i = 0; i + 3 < n; i += 4)
+		{
+			AddTriangle(mVertices[i], mVertices[i + 1], mVertices[i + 2]);
+			AddTriangle(mVertices[i], mVertices[i + 2], mVertices[i + 3]);
+		}
+		break;
+
+	case GL_QUAD_STRIP:
+		for(unsigned int i = 0; i + 3 < n; i += 2)
+		{
+			AddTriangle(mVertices[i], mVertices[i + 1], mVertices[i + 2]);
+			AddTriangle(mVertices[i + 1], mVertices[i + 3], mVertices[i + 2]);
+		}
+		break;
+
+	default:
+		// Other primitives are not used by the models.
+		break;
+	}
+
+	mVertices.clear();
+}
+
+/// Rasterizes all queued geometry and resolves the samples into the output image.
+/// Equivalent to glFinish.
+void CRasterizer::Finish()
+{
+	unsigned int n_bands = (mSampleHeight + mBandHeight - 1) / mBandHeight;
+
+	if(mThreadPool != NULL)
+	{
+		mThreadPool->ParallelFor(n_bands, [this](unsigned int band, unsigned int thread_id) { RasterizeBand(band, thread_id); });
+		mThreadPool->ParallelFor(n_bands, [this](unsigned int band, unsigned int thread_id) { Resolve(band); });
+	}
+	else
+	{
+		for(unsigned int band = 0; band < n_bands; band++)
+		{
+			RasterizeBand(band, 0);
+			Resolve(band);
+		}
+	}
+
+	mTriangles.clear();
+	mStates.clear();
+	mStateChanged = true;
+}
+
+/// Rasterizes the queued geometry and stores the result as the layer for key (see
+/// Composite).  Clear() should be called before the layer is drawn.
+void CRasterizer::FinishLayer(const void * key, unsigned int generation)
+{
+	unsigned int n_bands = (mSampleHeight + mBandHeight - 1) / mBandHeight;
+
+	if(mThreadPool != NULL)
+		mThreadPool->ParallelFor(n_bands, [this](unsigned int band, unsigned int thread_id) { RasterizeBand(band, thread_id); });
+	else
+	{
+		for(unsigned int band = 0; band < n_bands; band++)
+			RasterizeBand(band, 0);
+	}
+
+	Layer & layer = mLayers[key];
+	layer.generation = generation;
+	layer.red = mSampleRed;
+	layer.transmission = mSampleTransmission;
+	layer.depth = mSampleDepth;
+
+	mTriangles.clear();
+	mStates.clear();
+	mStateChanged = true;
+}
+
+/// Computes the coefficients needed to linearly interpolate f across the triangle.
+CRasterizer::Plane CRasterizer::GetPlane(const Triangle & tri, float f0, float f1, float f2)
+{
+	const double dx1 = tri.x[1] - tri.x[0];
+	const double dy1 = tri.y[1] - tri.y[0];
+	const double dx2 = tri.x[2] - tri.x[0];
+	const double dy2 = tri.y[2] - tri.y[0];
+	const double area = dx1 * dy2 - dx2 * dy1;
+
+	Plane plane;
+	plane.f0 = f0;
+	plane.dfdx = ((f1 - f0) * dy2 - (f2 - f0) * dy1) / area;
+	plane.dfdy = ((f2 - f0) * dx1 - (f1 - f0) * dx2) / area;
+	return plane;
+}
+
+/// Returns true if a layer drawn for key at the specified generation is cached.
+bool CRasterizer::HasLayer(const void * key, unsigned int generation)
+{
+	auto it = mLayers.find(key);
+	return (it != mLayers.end() && it->second.generation == generation);
+}
+
+/// Equivalent to glLoadIdentity
+void CRasterizer::LoadIdentity()
+{
+	Matrix & matrix = mMatrixStack.back();
+	for(int i = 0; i < 16; i++)
+		matrix.m[i] = (i % 5 == 0) ? 1 : 0;
+}
+
+/// Right-multiplies the current matrix by the specified matrix (as OpenGL does).
+void CRasterizer::MultMatrix(const Matrix & matrix)
+{
+	Matrix & current = mMatrixStack.back();
+	Matrix result;
+
+	for(int col = 0; col < 4; col++)
+	{
+		for(int row = 0; row < 4; row++)
+		{
+			result.m[4*col + row] = 0;
+			for(int k = 0; k < 4; k++)
+				result.m[4*col + row] += current.m[4*k + row] * matrix.m[4*col + k];
+		}
+	}
+
+	current = result;
+}
+
+/// Equivalent to glNormal3d
+void CRasterizer::Normal3d(double x, double y, double z)
+{
+	mNormal[0] = x;
+	mNormal[1] = y;
+	mNormal[2] = z;
+}
+
+/// Equivalent to glPopMatrix
+void CRasterizer::PopMatrix()
+{
+	if(mMatrixStack.size() > 1)
+		mMatrixStack.pop_back();
+}
+
+/// Equivalent to glPushMatrix
+void CRasterizer::PushMatrix()
+{
+	mMatrixStack.push_back(mMatrixStack.back());
+}
+
+/// Rasterizes all queued triangles which intersect the band of sample rows
+/// [band * mBandHeight, (band + 1) * mBandHeight).  Each band is owned by exactly
+/// one thread and triangles are processed in submission order so the results of
+/// blending are identical to a serial render.
+void CRasterizer::RasterizeBand(unsigned int band, unsigned int thread_id)
+{
+	const int row_min = band * mBandHeight;
+	const int row_max = min(row_min + mBandHeight, mSampleHeight);
+	float * scratch = &mScratch[thread_id][0];
+
+	double xs[3];
+	int n_xs;
+	double x0, y0, x1, y1, yc, x_left, x_right;
+	int i_start, i_end;
+	int row_start, row_end;
+
+	for(const Triangle & tri : mTriangles)
+	{
+		// Rows whose sample centers lie within [y_min, y_max)
+		row_start = max(int(ceil(tri.y_min - 0.5)), row_min);
+		row_end = min(int(ceil(tri.y_max - 0.5)), row_max);
+
+		for(int row = row_start; row < row_end; row++)
+		{
+			yc = row + 0.5;
+
+			// Find the intersections of this row with the edges of the triangle.  The edges
+			// are evaluated in a canonical direction so that edges shared by two triangles produce
+			// identical results and no sample is covered (and blended) twice.
+			n_xs = 0;
+			for(int e = 0; e < 3; e++)
+			{
+				int a = e;
+				int b = (e + 1) % 3;
+				if(tri.y[b] < tri.y[a] || (tri.y[b] == tri.y[a] && tri.x[b] < tri.x[a]))
+					swap(a, b);
+
+				x0 = tri.x[a];
+				y0 = tri.y[a];
+				x1 = tri.x[b];
+				y1 = tri.y[b];
+
+				if(y0 <= yc && yc < y1 && n_xs < 3)
+					xs[n_xs++] = x0 + (yc - y0) * (x1 - x0) / (y1 - y0);
+			}
+
+			if(n_xs < 2)
+				continue;
+
+			x_left = min(xs[0], xs[1]);
+			x_right = max(xs[0], xs[1]);
+
+			// Sample centers in [x_left, x_right)
+			i_start = max(int(ceil(x_left - 0.5)), 0);
+			i_end = min(int(ceil(x_right - 0.5)), mSampleWidth);
+
+			if(i_start < i_end)
+				RasterizeSpan(tri, row, i_start, i_end, scratch);
+		}
+	}
+}
+
+/// Shades and blends the samples [i_start, i_end) on the specified row.
+/// Attributes are first evaluated into contiguous scratch arrays so the inner loops vectorize.
+void CRasterizer::RasterizeSpan(const Triangle & tri, int row, int i_start, int i_end, float * scratch)
+{
+	const int n = i_end - i_start;
+	const FragmentState & state = mStates[tri.state];
+
+	float * depth = scratch;
+	float * red = scratch + mSampleWidth;
+	float * alpha = scratch + 2 * mSampleWidth;
+	float * mu = scratch + 3 * mSampleWidth;
+
+	// Values at the center of the first sample.
+	const double dx = i_start + 0.5 - tri.x[0];
+	const double dy = row + 0.5 - tri.y[0];
+	const float depth0 = tri.depth.f0 + tri.depth.dfdx * dx + tri.depth.dfdy * dy;
+	const float red0 = tri.red.f0 + tri.red.dfdx * dx + tri.red.dfdy * dy;
+	const float depth_dx = tri.depth.dfdx;
+	const float red_dx = tri.red.dfdx;
+
+	for(int k = 0; k < n; k++)
+	{
+		depth[k] = depth0 + depth_dx * k;
+		red[k] = red0 + red_dx * k;
+	}
+
+	// Emulate the fragment shaders.
+	if(state.shader == CGLShaderList::POWER_LAW_Z)
+	{
+		const float t0 = tri.transparency.f0 + tri.transparency.dfdx * dx + tri.transparency.dfdy * dy;
+		const float t_dx = tri.transparency.dfdx;
+		for(int k = 0; k < n; k++)
+			alpha[k] = t0 + t_dx * k;
+	}
+	else
+	{
+		const float a0 = tri.alpha.f0 + tri.alpha.dfdx * dx + tri.alpha.dfdy * dy;
+		const float a_dx = tri.alpha.dfdx;
+		for(int k = 0; k < n; k++)
+			alpha[k] = a0 + a_dx * k;
+
+		if(state.shader != CGLShaderList::NONE)
+		{
+			const float n0 = tri.normal_z.f0 + tri.normal_z.dfdx * dx + tri.normal_z.dfdy * dy;
+			const float n_dx = tri.normal_z.dfdx;
+			for(int k = 0; k < n; k++)
+				mu[k] = fabs(n0 + n_dx * k);
+
+			const float a1 = state.params[0];
+			const float a2 = state.params[1];
+			const float a3 = state.params[2];
+			const float a4 = state.params[3];
+
+			switch(state.shader)
+			{
+			case CGLShaderList::LDL_POWERLAW:
+				for(int k = 0; k < n; k++)
+					alpha[k] *= pow(mu[k], a1);
+				break;
+
+			case CGLShaderList::LDL_CLARET2000:
+				for(int k = 0; k < n; k++)
+					alpha[k] *= 1 - a1 * (1 - sqrt(mu[k])) - a2 * (1 - mu[k])
+						- a3 * (1 - pow(mu[k], 1.5f)) - a4 * (1 - mu[k] * mu[k]);
+				break;
+
+			case CGLShaderList::LDL_SQUARE_ROOT:
+				for(int k = 0; k < n; k++)
+					alpha[k] *= 1 - a1 * (1 - mu[k]) - a2 * (1 - sqrt(mu[k]));
+				break;
+
+			case CGLShaderList::LDL_QUADRATIC:
+				for(int k = 0; k < n; k++)
+					alpha[k] *= 1 - a1 * (1 - mu[k]) - a2 * (1 - mu[k]) * (1 - mu[k]);
+				break;
+
+			case CGLShaderList::LDL_LOGARITHMIC:
+				for(int k = 0; k < n; k++)
+					alpha[k] *= 1 - a1 * (1 - mu[k]) - a2 * mu[k] * log(mu[k]);
+				break;
+
+			default:
+				break;
+			}
+		}
+	}
+
+	// Depth test and blend using (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+	float * out_red = &mSampleRed[row * mSampleWidth + i_start];
+	float * out_depth = &mSampleDepth[row * mSampleWidth + i_start];
+	float * out_transmission = &mSampleTransmission[row * mSampleWidth + i_start];
+	if(state.depth_test)
+	{
+		for(int k = 0; k < n; k++)
+		{
+			if(depth[k] < 0 || depth[k] > 1 || !(depth[k] < out_depth[k]))
+				continue;
+
+			out_depth[k] = depth[k];
+			out_red[k] = red[k] * alpha[k] + out_red[k] * (1 - alpha[k]);
+			out_transmission[k] *= 1 - alpha[k];
+		}
+	}
+	else
+	{
+		for(int k = 0; k < n; k++)
+		{
+			// Samples outside of the near/far planes are clipped.
+			float a = (depth[k] < 0 || depth[k] > 1) ? 0 : alpha[k];
+			out_red[k] = red[k] * a + out_red[k] * (1 - a);
+			out_transmission[k] *= 1 - a;
+		}
+	}
+}
+
+/// Averages the samples in the specified band into the output image.
+void CRasterizer::Resolve(unsigned int band)
+{
+	const int rows_per_band = mBandHeight / mSupersample;
+	const int y_min = band * rows_per_band;
+	const int y_max = min(y_min + rows_per_band, mHeight);
+	const float norm = 1.0 / (mSupersample * mSupersample);
+
+	for(int y = y_min; y < y_max; y++)
+	{
+		float * out = &mImage[y * mWidth];
+		for(int x = 0; x < mWidth; x++)
+			out[x] = 0;
+
+		for(int sy = 0; sy < mSupersample; sy++)
+		{
+			const float * in = &mSampleRed[(y * mSupersample + sy) * mSampleWidth];
+			for(int x = 0; x < mWidth; x++)
+			{
+				for(int sx = 0; sx < mSupersample; sx++)
+					out[x] += in[x * mSupersample + sx];
+			}
+		}
+
+		for(int x = 0; x < mWidth; x++)
+			out[x] *= norm;
+	}
+}
+
+/// Equivalent to glRotated
+void CRasterizer::Rotated(double angle, double x, double y, double z)
+{
+	double norm = sqrt(x*x + y*y + z*z);
+	if(norm == 0)
+		return;
+
+	x /= norm;
+	y /= norm;
+	z /= norm;
+
+	const double c = cos(angle * PI / 180);
+	const double s = sin(angle * PI / 180);
+	const double t = 1 - c;
+
+	Matrix rot = {{ x*x*t + c,   y*x*t + z*s, x*z*t - y*s, 0,
+	                x*y*t - z*s, y*y*t + c,   y*z*t + x*s, 0,
+	                x*z*t + y*s, y*z*t - x*s, z*z*t + c,   0,
+	                0,           0,           0,           1 }};
+	MultMatrix(rot);
+}
+
+/// Equivalent to glScaled
+void CRasterizer::Scaled(double x, double y, double z)
+{
+	Matrix scale = {{ x, 0, 0, 0,
+	                  0, y, 0, 0,
+	                  0, 0, z, 0,
+	                  0, 0, 0, 1 }};
+	MultMatrix(scale);
+}
+
+/// Sets the size of the image, the scale (in units per pixel), and the depth
+/// of the viewing volume.  The projection matches the orthographic projection used by CCL_GLThread.
+void CRasterizer::SetImageInfo(int width, int height, double scale, double area_depth)
+{
+	mScale = scale;
+	mAreaDepth = area_depth;
+
+	// Cached layers were drawn with the old geometry.
+	mLayers.clear();
+
+	if(width == mWidth && height == mHeight)
+		return;
+
+	mWidth = width;
+	mHeight = height;
+	mSampleWidth = mWidth * mSupersample;
+	mSampleHeight = mHeight * mSupersample;
+
+	mSampleRed.resize(mSampleWidth * mSampleHeight);
+	mSampleDepth.resize(mSampleWidth * mSampleHeight);
+	mSampleTransmission.resize(mSampleWidth * mSampleHeight);
+	mImage.assign(mWidth * mHeight, 0.0f);
+
+	for(auto & scratch : mScratch)
+		scratch.resize(4 * mSampleWidth);
+
+	Clear();
+}
+
+/// Equivalent to glTranslated
+void CRasterizer::Translated(double x, double y, double z)
+{
+	Matrix translate = {{ 1, 0, 0, 0,
+	                      0, 1, 0, 0,
+	                      0, 0, 1, 0,
+	                      x, y, z, 1 }};
+	MultMatrix(translate);
+}
+
+/// Emulates CGLShader::UseShader by selecting the CPU implementation of the specified shader.
+void CRasterizer::UseShader(CGLShaderList::ShaderTypes shader, double * params, unsigned int n_params, double min_xyz[3], double max_xyz[3])
+{
+	mState.shader = shader;
+	for(unsigned int i = 0; i < 4; i++)
+		mState.params[i] = (i < n_params) ? float(params[i]) : 0;
+
+	mMaxZ = max_xyz[2];
+	mStateChanged = true;
+}
+
+/// Transforms a vertex by the current model view matrix and the orthographic projection,
+/// then emulates the per-vertex stage of the shaders.
+CRasterizer::Vertex CRasterizer::TransformVertex(double x, double y, double z, double nx, double ny, double nz, float red, float alpha)
+{
+	const double * m = mMatrixStack.back().m;
+	const double half_width = mWidth * mScale / 2;
+
+	// Eye coordinates
+	const double ex = m[0] * x + m[4] * y + m[8] * z + m[12];
+	const double ey = m[1] * x + m[5] * y + m[9] * z + m[13];
+	const double ez = m[2] * x + m[6] * y + m[10] * z + m[14];
+
+	// Window coordinates (in samples), depth in [0, 1].  Note that OpenGL
+	// uses the half width for both axes, so we do too.
+	Vertex vertex;
+	vertex.x = (ex / half_width + 1) * 0.5 * mSampleWidth;
+	vertex.y = (ey / half_width + 1) * 0.5 * mSampleHeight;
+	vertex.z = (-ez / mAreaDepth + 1) * 0.5;
+	vertex.red = red;
+	vertex.alpha = alpha;
+
+	// The model view matrices used are orthogonal, so the normal matrix is simply
+	// the upper 3x3 block.  The limb darkening shaders exclude the back faces.
+	vertex.normal_z = m[2] * nx + m[6] * ny + m[10] * nz;
+	if(vertex.normal_z < 0)
+		vertex.normal_z = 0;
+
+	vertex.transparency = 1;
+	if(mState.shader == CGLShaderList::POWER_LAW_Z)
+		vertex.transparency = 1 - pow(fabs(z) / mMaxZ, double(mState.params[0]));
+
+	return vertex;
+}
+
+/// Equivalent to glVertex3d
+void CRasterizer::Vertex3d(double x, double y, double z)
+{
+	mVertices.push_back(TransformVertex(x, y, z, mNormal[0], mNormal[1], mNormal[2], mColor[0], mColor[3]));
+}
@@ -0,0 +1,193 @@
+/*
+ * CRasterizer.h
+ *
+ *  A software (CPU) implementation of the subset of immediate-mode OpenGL used
+ *  by the models.  Images are rendered into a floating point buffer using
+ *  multiple threads and are intended to match the OpenGL render path.
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CRASTERIZER_H_
+#define CRASTERIZER_H_
+
+#include <GL/gl.h>
+#include <map>
+#include <vector>
+
+#include "CGLShaderList.h"
+
+using namespace std;
+
+class CThreadPool;
+
+class CRasterizer
+{
+protected:
+	/// A 4x4 matrix stored in column-major (OpenGL) order.
+	struct Matrix
+	{
+		double m[16];
+	};
+
+	/// A vertex after transformation to (supersampled) window coordinates.
+	struct Vertex
+	{
+		double x;
+		double y;
+		double z;
+		float red;
+		float alpha;
+		float normal_z;
+		float transparency;
+	};
+
+	/// Interpolated values are evaluated as f = f0 + dfdx * (x - x0) + dfdy * (y - y0)
+	struct Plane
+	{
+		float f0;
+		float dfdx;
+		float dfdy;
+	};
+
+	/// Shader and depth state used when the triangle was submitted.
+	struct FragmentState
+	{
+		CGLShaderList::ShaderTypes shader;
+		float params[4];
+		bool depth_test;
+	};
+
+	struct Triangle
+	{
+		double x[3];
+		double y[3];
+		double y_min;
+		double y_max;
+		Plane depth;
+		Plane red;
+		Plane alpha;
+		Plane normal_z;
+		Plane transparency;
+		unsigned int state;
+	};
+
+	/// The samples of a single model, rendered against an empty background, which may be
+	/// composited with other layers (see Composite).
+	struct Layer
+	{
+		unsigned int generation;
+		vector<float> red;				// color, premultiplied by alpha
+		vector<float> transmission;		// fraction of the background which is visible
+		vector<float> depth;			// nearest depth written, 1 if none
+	};
+
+	CThreadPool * mThreadPool;
+
+	// Image properties
+	int mWidth;
+	int mHeight;
+	double mScale;
+	double mAreaDepth;
+	int mSupersample;	// samples per pixel, per axis.
+	int mSampleWidth;
+	int mSampleHeight;
+	int mBandHeight;
+
+	// Buffers
+	vector<float> mSampleRed;
+	vector<float> mSampleDepth;
+	vector<float> mSampleTransmission;
+	vector<float> mImage;
+	vector< vector<float> > mScratch;
+
+	// Matrix stack, the current (model view) matrix is the last element.
+	vector<Matrix> mMatrixStack;
+
+	// Current OpenGL-like state
+	double mColor[4];
+	double mNormal[3];
+	FragmentState mState;
+	bool mStateChanged;
+	double mMaxZ;
+	GLenum mPrimitive;
+	vector<Vertex> mVertices;
+
+	// Geometry queued for rendering
+	vector<FragmentState> mStates;
+	vector<Triangle> mTriangles;
+
+	// Cached layers, keyed by the object which drew them.
+	map<const void *, Layer> mLayers;
+
+public:
+	CRasterizer(CThreadPool * thread_pool);
+	virtual ~CRasterizer();
+
+	// OpenGL-like drawing interface:
+	void Begin(GLenum mode);
+	void Color4d(double red, double green, double blue, double alpha);
+	void Disable(GLenum cap);
+	void DrawElements(const GLfloat * vertices, const GLfloat * normals, const GLfloat * colors, unsigned int n_vertices, const GLuint * indices, unsigned int n_indices);
+	void Enable(GLenum cap);
+	void End();
+	void LoadIdentity();
+	void Normal3d(double x, double y, double z);
+	void PopMatrix();
+	void PushMatrix();
+	void Rotated(double angle, double x, double y, double z);
+	void Scaled(double x, double y, double z);
+	void Translated(double x, double y, double z);
+	void UseShader(CGLShaderList::ShaderTypes shader, double * params, unsigned int n_params, double min_xyz[3], double max_xyz[3]);
+	void Vertex3d(double x, double y, double z);
+
+	// Frame control
+	void Clear();
+	void Finish();
+
+	// Layered rendering
+	void Composite(const vector<const void *> & keys);
+	void FinishLayer(const void * key, unsigned int generation);
+	bool HasLayer(const void * key, unsigned int generation);
+
+	const float * GetImage() { return &mImage[0]; };
+	int GetImageHeight() { return mHeight; };
+	int GetImageWidth() { return mWidth; };
+
+	void SetImageInfo(int width, int height, double scale, double area_depth);
+
+protected:
+	void AddTriangle(const Vertex & v0, const Vertex & v1, const Vertex & v2);
+	void CompositeBand(unsigned int band, const vector<const Layer *> & layers);
+	static Plane GetPlane(const Triangle & tri, float f0, float f1, float f2);
+	void MultMatrix(const Matrix & matrix);
+	void RasterizeBand(unsigned int band, unsigned int thread_id);
+	void RasterizeSpan(const Triangle & tri, int row, int i_start, int i_end, float * scratch);
+	void Resolve(unsigned int band);
+	Vertex TransformVertex(double x, double y, double z, double nx, double ny, double nz, float red, float alpha);
+};
+
+#endif /* CRASTERIZER_H_ */
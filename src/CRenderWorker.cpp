@@ -0,0 +1,160 @@
+/*
+ * CRenderWorker.cpp
+ *
+ *  A self-contained render and likelihood worker.
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include "CRenderWorker.h"
+#include "CModelList.h"
+#include "CRasterizer.h"
+#include "CVisibilityEngine_CPU.h"
+
+CRenderWorker::CRenderWorker()
+{
+	// Workers run in parallel with each other, so they do not use a thread pool themselves.
+	mModelList = new CModelList();
+	mRasterizer = new CRasterizer(NULL);
+	mEngine = new CVisibilityEngine_CPU(NULL);
+	mAnalytic = false;
+}
+
+CRenderWorker::~CRenderWorker()
+{
+	delete mEngine;
+	delete mRasterizer;
+	delete mModelList;
+}
+
+/// Sets the parameters and computes the chi elements for every data set.  output must hold
+/// GetNDataAllocated() values, data sets are stored consecutively.
+void CRenderWorker::GetChi(const double * params, unsigned int n_params, bool scale_params, float * output)
+{
+	SetFreeParameters(params, n_params, scale_params);
+
+	unsigned int offset = 0;
+	unsigned int n_data_sets = mEngine->GetNDataSets();
+	for(unsigned int data_set = 0; data_set < n_data_sets; data_set++)
+	{
+		Render(data_set);
+		mEngine->ImageToChi(data_set, output + offset, mEngine->GetNDataAllocated(data_set));
+		offset += mEngine->GetNDataAllocated(data_set);
+	}
+}
+
+/// Sets the parameters and computes the chi2 for every data set (one value per data set).
+void CRenderWorker::GetChi2(const double * params, unsigned int n_params, bool scale_params, double * output)
+{
+	SetFreeParameters(params, n_params, scale_params);
+
+	unsigned int n_data_sets = mEngine->GetNDataSets();
+	for(unsigned int data_set = 0; data_set < n_data_sets; data_set++)
+	{
+		Render(data_set);
+		output[data_set] = mEngine->ImageToChi2(data_set);
+	}
+}
+
+/// Sets the parameters and computes the log likelihood for every data set (one value per data set).
+void CRenderWorker::GetLogLike(const double * params, unsigned int n_params, bool scale_params, double * output)
+{
+	SetFreeParameters(params, n_params, scale_params);
+
+	unsigned int n_data_sets = mEngine->GetNDataSets();
+	for(unsigned int data_set = 0; data_set < n_data_sets; data_set++)
+	{
+		Render(data_set);
+		output[data_set] = mEngine->ImageToLogLike(data_set);
+	}
+}
+
+/// Renders the models at the average time of data_num and copies the image (or the analytic
+/// model) to the engine.
+/// Models which do not change with time are only rendered for the first data set.
+void CRenderWorker::Render(unsigned int data_num)
+{
+	if(data_num > 0 && !mModelList->IsTimeDependent())
+		return;
+
+	mModelList->SetTime(mEngine->GetDataAveJD(data_num));
+
+	// If enabled, models with closed-form visibilities are not rendered at all.
+	vector<CAnalyticDisk> disks;
+	if(mAnalytic && mModelList->GetAnalyticDisks(disks))
+	{
+		mEngine->SetAnalyticModel(disks);
+		return;
+	}
+
+	mModelList->Rasterize(mRasterizer);
+	mEngine->CopyImageToBuffer(0);
+}
+
+/// Selects the set of data weights used to compute chi values (see CVisibilityEngine_CPU::SetDataWeights).
+void CRenderWorker::SelectWeights(unsigned int weight_set)
+{
+	mEngine->SelectWeights(weight_set);
+}
+
+/// Shares the data sets loaded in source with this worker.
+void CRenderWorker::SetData(const CVisibilityEngine_CPU & source)
+{
+	mEngine->ShareData(source);
+}
+
+void CRenderWorker::SetFreeParameters(const double * params, unsigned int n_params, bool scale_params)
+{
+	mModelList->SetFreeParameters(params, n_params, scale_params);
+
+	// Solve for the positions at every epoch at once.
+	if(mModelList->IsTimeDependent())
+	{
+		vector<double> epochs;
+		for(int data_set = 0; data_set < mEngine->GetNDataSets(); data_set++)
+			epochs.push_back(mEngine->GetDataAveJD(data_set));
+
+		mModelList->PrecomputePositions(epochs);
+	}
+}
+
+/// Sets the image size (pixels), scale (mas/pixel) and depth of the viewing region.
+void CRenderWorker::SetImageInfo(int width, int height, double scale, double area_depth)
+{
+	mRasterizer->SetImageInfo(width, height, scale, area_depth);
+	mEngine->SetImageInfo(width, height, 1, scale);
+
+	// The image buffer may have been reallocated.
+	mEngine->SetImageSource(mRasterizer->GetImage());
+}
+
+/// Replaces the models with the serialized models (see CModelList::Serialize).
+void CRenderWorker::SetModels(const Json::Value & models, CGLShaderList * shader_list)
+{
+	mModelList->Restore(models, shader_list);
+}
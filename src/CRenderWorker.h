@@ -0,0 +1,81 @@
+/*
+ * CRenderWorker.h
+ *
+ *  A self-contained render and likelihood worker.  Several workers may evaluate
+ *  independent parameter vectors concurrently (see CCL_GLThread::RunBatch).
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CRENDERWORKER_H_
+#define CRENDERWORKER_H_
+
+#include <memory>
+#include "json/json.h"
+
+using namespace std;
+
+class CGLShaderList;
+class CModelList;
+class CRasterizer;
+class CVisibilityEngine_CPU;
+
+class CRenderWorker;
+typedef shared_ptr<CRenderWorker> CRenderWorkerPtr;
+
+/// Renders a private copy of the model list with the software rasterizer and reduces the
+/// image with its own CPU visibility engine.  The data sets are shared (read-only) with
+/// another CVisibilityEngine_CPU.  A worker is not thread safe, but distinct workers may
+/// be used from different threads at the same time.
+class CRenderWorker
+{
+protected:
+	CModelList * mModelList;
+	CRasterizer * mRasterizer;
+	CVisibilityEngine_CPU * mEngine;
+	bool mAnalytic;	// use closed-form visibilities when possible, see Render
+
+public:
+	CRenderWorker();
+	virtual ~CRenderWorker();
+
+	void 	GetChi(const double * params, unsigned int n_params, bool scale_params, float * output);
+	void 	GetChi2(const double * params, unsigned int n_params, bool scale_params, double * output);
+	void 	GetLogLike(const double * params, unsigned int n_params, bool scale_params, double * output);
+
+protected:
+	void 	Render(unsigned int data_num);
+	void 	SetFreeParameters(const double * params, unsigned int n_params, bool scale_params);
+
+public:
+	void 	SelectWeights(unsigned int weight_set);
+	void 	SetAnalytic(bool analytic) { mAnalytic = analytic; };
+	void 	SetData(const CVisibilityEngine_CPU & source);
+	void 	SetImageInfo(int width, int height, double scale, double area_depth);
+	void 	SetModels(const Json::Value & models, CGLShaderList * shader_list);
+};
+
+#endif /* CRENDERWORKER_H_ */
@@ -0,0 +1,153 @@
+/*
+ * CThreadPool.cpp
+ *
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CThreadPool.h"
+
+/// Creates a pool with n_threads threads (including the calling thread).
+/// If n_threads is zero, the number of hardware threads is used.
+CThreadPool::CThreadPool(unsigned int n_threads)
+{
+	if(n_threads == 0)
+		n_threads = GetDefaultNThreads();
+
+	mNThreads = n_threads;
+	mTask = NULL;
+	mNTasks = 0;
+	mNextTask = 0;
+	mNBusy = 0;
+	mGeneration = 0;
+	mStop = false;
+
+	// Thread zero is the caller of ParallelFor, start the remainder here.
+	for(unsigned int i = 1; i < mNThreads; i++)
+		mThreads.push_back(thread(&CThreadPool::WorkerLoop, this, i));
+}
+
+CThreadPool::~CThreadPool()
+{
+	{
+		unique_lock<mutex> lock(mMutex);
+		mStop = true;
+	}
+	mWorkCondition.notify_all();
+
+	for(auto & worker : mThreads)
+		worker.join();
+}
+
+/// Returns the number of hardware threads, or one if this cannot be determined.
+unsigned int CThreadPool::GetDefaultNThreads()
+{
+	unsigned int n_threads = thread::hardware_concurrency();
+	if(n_threads < 1)
+		n_threads = 1;
+
+	return n_threads;
+}
+
+/// Executes task(i, thread_id) for i = [0 ... n_tasks) across all threads in the pool,
+/// blocking until every task has completed.  Tasks are handed out dynamically so
+/// uneven workloads are balanced automatically.
+void CThreadPool::ParallelFor(unsigned int n_tasks, const TaskFunction & task)
+{
+	if(n_tasks == 0)
+		return;
+
+	// Serial execution for trivial cases.
+	if(mNThreads == 1 || n_tasks == 1)
+	{
+		for(unsigned int i = 0; i < n_tasks; i++)
+			task(i, 0);
+
+		return;
+	}
+
+	// Only one loop may be executing in the pool at a time.
+	unique_lock<mutex> call_lock(mCallMutex);
+
+	{
+		unique_lock<mutex> lock(mMutex);
+		mTask = &task;
+		mNTasks = n_tasks;
+		mNextTask = 0;
+		mNBusy = mNThreads - 1;
+		mGeneration++;
+	}
+	mWorkCondition.notify_all();
+
+	// The calling thread works too.
+	RunTasks(0);
+
+	// Wait for the other threads to finish their last tasks.
+	unique_lock<mutex> lock(mMutex);
+	while(mNBusy > 0)
+		mDoneCondition.wait(lock);
+
+	mTask = NULL;
+}
+
+/// Pulls tasks from the current loop until none remain.
+void CThreadPool::RunTasks(unsigned int thread_id)
+{
+	unsigned int i = mNextTask++;
+	while(i < mNTasks)
+	{
+		(*mTask)(i, thread_id);
+		i = mNextTask++;
+	}
+}
+
+/// Main loop for threads [1 ... mNThreads) in the pool.
+void CThreadPool::WorkerLoop(unsigned int thread_id)
+{
+	unsigned int generation = 0;
+
+	while(true)
+	{
+		{
+			unique_lock<mutex> lock(mMutex);
+			while(!mStop && generation == mGeneration)
+				mWorkCondition.wait(lock);
+
+			if(mStop)
+				return;
+
+			generation = mGeneration;
+		}
+
+		RunTasks(thread_id);
+
+		{
+			unique_lock<mutex> lock(mMutex);
+			mNBusy--;
+		}
+		mDoneCondition.notify_one();
+	}
+}
@@ -0,0 +1,84 @@
+/*
+ * CThreadPool.h
+ *
+ *  A minimal pool of worker threads used to parallelize CPU-side loops
+ *  (software rasterization, visibility computations, etc.).
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CTHREADPOOL_H_
+#define CTHREADPOOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+using namespace std;
+
+/// A fixed-size pool of threads which executes parallel-for style loops.
+/// The calling thread participates in the work as thread zero, so a pool
+/// created with one thread simply executes loops serially.
+class CThreadPool
+{
+public:
+	/// The signature for tasks executed by ParallelFor: (task index, thread index)
+	typedef function<void (unsigned int, unsigned int)> TaskFunction;
+
+protected:
+	vector<thread> mThreads;
+	unsigned int mNThreads;
+
+	mutex mMutex;
+	mutex mCallMutex;
+	condition_variable mWorkCondition;
+	condition_variable mDoneCondition;
+
+	const TaskFunction * mTask;
+	unsigned int mNTasks;
+	atomic<unsigned int> mNextTask;
+	unsigned int mNBusy;
+	unsigned int mGeneration;
+	bool mStop;
+
+public:
+	CThreadPool(unsigned int n_threads = 0);
+	virtual ~CThreadPool();
+
+	static unsigned int GetDefaultNThreads();
+	unsigned int GetNThreads() { return mNThreads; };
+
+	void ParallelFor(unsigned int n_tasks, const TaskFunction & task);
+
+protected:
+	void RunTasks(unsigned int thread_id);
+	void WorkerLoop(unsigned int thread_id);
+};
+
+#endif /* CTHREADPOOL_H_ */
@@ -0,0 +1,70 @@
+/*
+ * CVisibilityEngine.cpp
+ *
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CVisibilityEngine.h"
+#include "CVisibilityEngine_CPU.h"
+#include "CVisibilityEngine_OpenCL.h"
+
+CVisibilityEngine::CVisibilityEngine()
+{
+	mType = OPENCL;
+}
+
+CVisibilityEngine::~CVisibilityEngine()
+{
+
+}
+
+/// Creates the requested visibility engine.  The thread pool is only used by the CPU engine.
+CVisibilityEngine * CVisibilityEngine::GetVisibilityEngine(EngineTypes type, CThreadPool * thread_pool)
+{
+	CVisibilityEngine * tmp;
+	switch(type)
+	{
+	case CPU:
+		tmp = new CVisibilityEngine_CPU(thread_pool);
+		break;
+
+	default:
+	case OPENCL:
+		tmp = new CVisibilityEngine_OpenCL();
+		break;
+	}
+
+	return tmp;
+}
+
+vector< pair<CVisibilityEngine::EngineTypes, string> > CVisibilityEngine::GetTypes(void)
+{
+	vector< pair<CVisibilityEngine::EngineTypes, string> > tmp;
+	tmp.push_back(pair<CVisibilityEngine::EngineTypes, string> (CVisibilityEngine::OPENCL, "OpenCL (liboi)"));
+	tmp.push_back(pair<CVisibilityEngine::EngineTypes, string> (CVisibilityEngine::CPU, "CPU"));
+	return tmp;
+}
@@ -0,0 +1,112 @@
+/*
+ * CVisibilityEngine.h
+ *
+ *  Abstract interface for the objects which convert rendered images into
+ *  interferometric quantities (V2, T3) and compare them with data.
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CVISIBILITYENGINE_H_
+#define CVISIBILITYENGINE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <GL/gl.h>
+
+#include "oi_file.hpp"
+#include "CAnalyticDisk.h"
+
+using namespace std;
+using namespace ccoifits;
+
+class CThreadPool;
+
+/// The public interface follows that of liboi::CLibOI so that CCL_GLThread
+/// may use any engine interchangeably.
+class CVisibilityEngine
+{
+public:
+	enum EngineTypes
+	{
+		OPENCL = 0,
+		CPU = 1,
+		LAST_VALUE	// this must always be the last value in this enum.
+	};
+
+protected:
+	EngineTypes mType;
+
+public:
+	CVisibilityEngine();
+	virtual ~CVisibilityEngine();
+
+	static CVisibilityEngine * GetVisibilityEngine(EngineTypes type, CThreadPool * thread_pool);
+	static vector< pair<EngineTypes, string> > GetTypes(void);
+	EngineTypes GetType() { return mType; };
+
+	virtual void 	CopyImageToBuffer(int layer) = 0;
+	virtual void 	ExportImage(float * image, unsigned int width, unsigned int height, unsigned int depth) = 0;
+
+	virtual void 	GetCalibrationScales(int data_num, double old_diameter, double new_diameter, float * output, unsigned int n) {};
+	virtual OIDataList GetData(unsigned int data_num) = 0;
+	virtual double 	GetDataAveJD(unsigned int data_num) = 0;
+	virtual int 	GetNData() = 0;
+	virtual int 	GetNDataAllocated() = 0;
+	virtual int 	GetNDataAllocated(int data_num) = 0;
+	virtual int 	GetNDataSets() = 0;
+	virtual int 	GetNT3(int data_num) = 0;
+	virtual int 	GetNV2(int data_num) = 0;
+
+	virtual void 	ImageToChi(int data_num, float * output, unsigned int n) = 0;
+	virtual double 	ImageToChi2(int data_num) = 0;
+	virtual void 	ImageToChi2(int data_num, float * output, unsigned int n) = 0;
+	virtual double 	ImageToLogLike(int data_num) = 0;
+	virtual void 	Init() = 0;
+
+	virtual void 	LoadData(string filename) = 0;
+	virtual void 	LoadData(const OIDataList & data) = 0;
+
+	virtual void 	RemoveData(int data_num) = 0;
+	virtual void 	ReplaceData(unsigned int data_num, const OIDataList & data) = 0;
+	virtual void 	RunVerification(int data_num) = 0;
+
+	virtual void 	SaveImage(string filename) = 0;
+	virtual void 	SelectWeights(unsigned int weight_set) {};
+	virtual void 	SetAnalyticModel(const vector<CAnalyticDisk> & disks) {};
+	virtual void 	SetDataWeights(int data_num, unsigned int weight_set, const float * weights, const float * scales, unsigned int n) {};
+	virtual void 	SetImageInfo(unsigned int width, unsigned int height, unsigned int depth, double scale) = 0;
+	virtual void 	SetImageSource(GLuint texture) = 0;
+	virtual void 	SetImageSource(const float * image) = 0;
+	virtual void 	SetKernelSourcePath(string path) {};
+	virtual bool 	SupportsAnalyticModels() { return false; };
+	virtual bool 	SupportsDataWeights() { return false; };
+
+	virtual double 	TotalFlux(bool compute_sum) = 0;
+};
+
+#endif /* CVISIBILITYENGINE_H_ */
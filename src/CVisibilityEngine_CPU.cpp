@@ -0,0 +1,1001 @@
+/*
+ * CVisibilityEngine_CPU.cpp
+ *
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "CVisibilityEngine_CPU.h"
+#include "CThreadPool.h"
+
+#ifndef PI
+#ifdef M_PI
+#define PI M_PI
+#else
+#define PI 3.1415926535897932384626433832795028841968
+#endif // M_PI
+#endif // PI
+
+/// Milliarcseconds to radians
+static const double sMasToRad = PI / (180.0 * 3600.0 * 1000.0);
+
+/// Upper limit on the size of the separable DFT tables for a single data set.
+const size_t CVisibilityEngine_CPU::sMaxTwiddleBytes = size_t(512) * 1024 * 1024;
+
+// Taylor coefficients for sin(x), cos(x) on [-pi/2, pi/2], absolute error < 1E-7.
+static const float sSin3 = -1.0f / 6.0f;
+static const float sSin5 = 1.0f / 120.0f;
+static const float sSin7 = -1.0f / 5040.0f;
+static const float sSin9 = 1.0f / 362880.0f;
+static const float sSin11 = -1.0f / 39916800.0f;
+static const float sCos2 = -1.0f / 2.0f;
+static const float sCos4 = 1.0f / 24.0f;
+static const float sCos6 = -1.0f / 720.0f;
+static const float sCos8 = 1.0f / 40320.0f;
+static const float sCos10 = -1.0f / 3628800.0f;
+static const float sCos12 = 1.0f / 479001600.0f;
+
+/// Computes sin(2 pi t) and cos(2 pi t).  The argument is reduced to [-1/4, 1/4] turns
+/// so a short polynomial is sufficient.  The SIMD kernels below use the same algorithm.
+static inline void SinCos2Pi(float t, float & s, float & c)
+{
+	float r = t - nearbyintf(t);	// [-1/2, 1/2]
+	float sign = 1;
+	if(fabs(r) > 0.25f)
+	{
+		r = copysignf(0.5f, r) - r;
+		sign = -1;
+	}
+
+	const float x = float(2 * PI) * r;
+	const float x2 = x * x;
+	s = x * (1 + x2 * (sSin3 + x2 * (sSin5 + x2 * (sSin7 + x2 * (sSin9 + x2 * sSin11)))));
+	c = sign * (1 + x2 * (sCos2 + x2 * (sCos4 + x2 * (sCos6 + x2 * (sCos8 + x2 * (sCos10 + x2 * sCos12))))));
+}
+
+#if defined(__AVX512F__)
+static inline void SinCos2Pi(__m512 t, __m512 & s, __m512 & c)
+{
+	const __m512 quarter = _mm512_set1_ps(0.25f);
+	const __m512 half = _mm512_set1_ps(0.5f);
+	const __m512i sign_bit = _mm512_set1_epi32(0x80000000);
+
+	__m512 r = _mm512_sub_ps(t, _mm512_roundscale_ps(t, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+	__m512i r_sign = _mm512_and_epi32(_mm512_castps_si512(r), sign_bit);
+	__m512 abs_r = _mm512_castsi512_ps(_mm512_andnot_epi32(sign_bit, _mm512_castps_si512(r)));
+	__mmask16 flip = _mm512_cmp_ps_mask(abs_r, quarter, _CMP_GT_OQ);
+	__m512 signed_half = _mm512_castsi512_ps(_mm512_or_epi32(_mm512_castps_si512(half), r_sign));
+	r = _mm512_mask_sub_ps(r, flip, signed_half, r);
+
+	const __m512 x = _mm512_mul_ps(r, _mm512_set1_ps(float(2 * PI)));
+	const __m512 x2 = _mm512_mul_ps(x, x);
+
+	__m512 ps = _mm512_set1_ps(sSin11);
+	ps = _mm512_fmadd_ps(ps, x2, _mm512_set1_ps(sSin9));
+	ps = _mm512_fmadd_ps(ps, x2, _mm512_set1_ps(sSin7));
+	ps = _mm512_fmadd_ps(ps, x2, _mm512_set1_ps(sSin5));
+	ps = _mm512_fmadd_ps(ps, x2, _mm512_set1_ps(sSin3));
+	ps = _mm512_fmadd_ps(ps, x2, _mm512_set1_ps(1));
+	s = _mm512_mul_ps(ps, x);
+
+	__m512 pc = _mm512_set1_ps(sCos12);
+	pc = _mm512_fmadd_ps(pc, x2, _mm512_set1_ps(sCos10));
+	pc = _mm512_fmadd_ps(pc, x2, _mm512_set1_ps(sCos8));
+	pc = _mm512_fmadd_ps(pc, x2, _mm512_set1_ps(sCos6));
+	pc = _mm512_fmadd_ps(pc, x2, _mm512_set1_ps(sCos4));
+	pc = _mm512_fmadd_ps(pc, x2, _mm512_set1_ps(sCos2));
+	pc = _mm512_fmadd_ps(pc, x2, _mm512_set1_ps(1));
+	c = _mm512_mask_sub_ps(pc, flip, _mm512_setzero_ps(), pc);
+}
+#elif defined(__AVX2__) && defined(__FMA__)
+static inline void SinCos2Pi(__m256 t, __m256 & s, __m256 & c)
+{
+	const __m256 quarter = _mm256_set1_ps(0.25f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 sign_bit = _mm256_set1_ps(-0.0f);
+
+	__m256 r = _mm256_sub_ps(t, _mm256_round_ps(t, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+	__m256 abs_r = _mm256_andnot_ps(sign_bit, r);
+	__m256 flip = _mm256_cmp_ps(abs_r, quarter, _CMP_GT_OQ);
+	__m256 signed_half = _mm256_or_ps(half, _mm256_and_ps(r, sign_bit));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(signed_half, r), flip);
+
+	const __m256 x = _mm256_mul_ps(r, _mm256_set1_ps(float(2 * PI)));
+	const __m256 x2 = _mm256_mul_ps(x, x);
+
+	__m256 ps = _mm256_set1_ps(sSin11);
+	ps = _mm256_fmadd_ps(ps, x2, _mm256_set1_ps(sSin9));
+	ps = _mm256_fmadd_ps(ps, x2, _mm256_set1_ps(sSin7));
+	ps = _mm256_fmadd_ps(ps, x2, _mm256_set1_ps(sSin5));
+	ps = _mm256_fmadd_ps(ps, x2, _mm256_set1_ps(sSin3));
+	ps = _mm256_fmadd_ps(ps, x2, _mm256_set1_ps(1));
+	s = _mm256_mul_ps(ps, x);
+
+	__m256 pc = _mm256_set1_ps(sCos12);
+	pc = _mm256_fmadd_ps(pc, x2, _mm256_set1_ps(sCos10));
+	pc = _mm256_fmadd_ps(pc, x2, _mm256_set1_ps(sCos8));
+	pc = _mm256_fmadd_ps(pc, x2, _mm256_set1_ps(sCos6));
+	pc = _mm256_fmadd_ps(pc, x2, _mm256_set1_ps(sCos4));
+	pc = _mm256_fmadd_ps(pc, x2, _mm256_set1_ps(sCos2));
+	pc = _mm256_fmadd_ps(pc, x2, _mm256_set1_ps(1));
+	c = _mm256_xor_ps(pc, _mm256_and_ps(flip, sign_bit));
+}
+#endif
+
+/// Computes the (unnormalized) visibility sum_k flux[k] * exp(-2 pi i (u x[k] + v y[k]))
+/// where u and v are in turns per pixel.  n must be a multiple of sSIMDWidth.
+static void DFT(const float * x, const float * y, const float * flux, unsigned int n,
+		float u, float v, float & re, float & im)
+{
+#if defined(__AVX512F__)
+	const __m512 vu = _mm512_set1_ps(u);
+	const __m512 vv = _mm512_set1_ps(v);
+	__m512 sum_re = _mm512_setzero_ps();
+	__m512 sum_im = _mm512_setzero_ps();
+	__m512 s, c;
+
+	for(unsigned int k = 0; k < n; k += 16)
+	{
+		__m512 t = _mm512_fmadd_ps(vu, _mm512_loadu_ps(x + k), _mm512_mul_ps(vv, _mm512_loadu_ps(y + k)));
+		__m512 f = _mm512_loadu_ps(flux + k);
+		SinCos2Pi(t, s, c);
+		sum_re = _mm512_fmadd_ps(f, c, sum_re);
+		sum_im = _mm512_fnmadd_ps(f, s, sum_im);
+	}
+
+	re = _mm512_reduce_add_ps(sum_re);
+	im = _mm512_reduce_add_ps(sum_im);
+#elif defined(__AVX2__) && defined(__FMA__)
+	const __m256 vu = _mm256_set1_ps(u);
+	const __m256 vv = _mm256_set1_ps(v);
+	__m256 sum_re = _mm256_setzero_ps();
+	__m256 sum_im = _mm256_setzero_ps();
+	__m256 s, c;
+
+	for(unsigned int k = 0; k < n; k += 8)
+	{
+		__m256 t = _mm256_fmadd_ps(vu, _mm256_loadu_ps(x + k), _mm256_mul_ps(vv, _mm256_loadu_ps(y + k)));
+		__m256 f = _mm256_loadu_ps(flux + k);
+		SinCos2Pi(t, s, c);
+		sum_re = _mm256_fmadd_ps(f, c, sum_re);
+		sum_im = _mm256_fnmadd_ps(f, s, sum_im);
+	}
+
+	float tmp_re[8];
+	float tmp_im[8];
+	_mm256_storeu_ps(tmp_re, sum_re);
+	_mm256_storeu_ps(tmp_im, sum_im);
+	re = im = 0;
+	for(int i = 0; i < 8; i++)
+	{
+		re += tmp_re[i];
+		im += tmp_im[i];
+	}
+#else
+	float s, c;
+	re = im = 0;
+	for(unsigned int k = 0; k < n; k++)
+	{
+		SinCos2Pi(u * x[k] + v * y[k], s, c);
+		re += flux[k] * c;
+		im -= flux[k] * s;
+	}
+#endif
+}
+
+/// Computes the two dot products sum_k a[k] * b[k] and sum_k a[k] * c[k].
+static void Dot2(const float * a, const float * b, const float * c, unsigned int n, float & ab, float & ac)
+{
+	unsigned int k = 0;
+	ab = ac = 0;
+
+#if defined(__AVX512F__)
+	__m512 sum_b = _mm512_setzero_ps();
+	__m512 sum_c = _mm512_setzero_ps();
+	for(; k + 16 <= n; k += 16)
+	{
+		__m512 va = _mm512_loadu_ps(a + k);
+		sum_b = _mm512_fmadd_ps(va, _mm512_loadu_ps(b + k), sum_b);
+		sum_c = _mm512_fmadd_ps(va, _mm512_loadu_ps(c + k), sum_c);
+	}
+	ab = _mm512_reduce_add_ps(sum_b);
+	ac = _mm512_reduce_add_ps(sum_c);
+#elif defined(__AVX2__) && defined(__FMA__)
+	__m256 sum_b = _mm256_setzero_ps();
+	__m256 sum_c = _mm256_setzero_ps();
+	for(; k + 8 <= n; k += 8)
+	{
+		__m256 va = _mm256_loadu_ps(a + k);
+		sum_b = _mm256_fmadd_ps(va, _mm256_loadu_ps(b + k), sum_b);
+		sum_c = _mm256_fmadd_ps(va, _mm256_loadu_ps(c + k), sum_c);
+	}
+
+	float tmp_b[8];
+	float tmp_c[8];
+	_mm256_storeu_ps(tmp_b, sum_b);
+	_mm256_storeu_ps(tmp_c, sum_c);
+	for(int i = 0; i < 8; i++)
+	{
+		ab += tmp_b[i];
+		ac += tmp_c[i];
+	}
+#endif
+
+	for(; k < n; k++)
+	{
+		ab += a[k] * b[k];
+		ac += a[k] * c[k];
+	}
+}
+
+/// Wraps a phase (radians) to [-pi, pi]
+static inline float WrapPhase(float phase)
+{
+	return phase - float(2 * PI) * nearbyintf(phase / float(2 * PI));
+}
+
+CVisibilityEngine_CPU::CVisibilityEngine_CPU(CThreadPool * thread_pool)
+{
+	mType = CPU;
+	mThreadPool = thread_pool;
+	mSharedData = false;
+
+	mImageWidth = 1;
+	mImageHeight = 1;
+	mImageDepth = 1;
+	mImageScale = 0.01;
+	mImageTexture = 0;
+	mImageHost = NULL;
+	mFlux = 0;
+	mAnalytic = false;
+	mWeightSet = 0;
+}
+
+CVisibilityEngine_CPU::~CVisibilityEngine_CPU()
+{
+
+}
+
+/// Computes the separable DFT tables for the current image size and scale.  If the tables
+/// would exceed sMaxTwiddleBytes they are left empty and the direct DFT is used instead.
+void CVisibilityEngine_CPU::BuildTwiddles(DataSet & data)
+{
+	const unsigned int n_uv = data.u.size();
+	const unsigned int width = mImageWidth;
+	const unsigned int height = mImageHeight;
+	const double scale = mImageScale * sMasToRad;	// radians / pixel
+	const double x0 = width / 2.0 - 0.5;
+	const double y0 = height / 2.0 - 0.5;
+
+	data.twiddle_width = width;
+	data.twiddle_height = height;
+	data.twiddle_scale = mImageScale;
+	data.col_re.clear();
+	data.col_im.clear();
+	data.row_re.clear();
+	data.row_im.clear();
+
+	if(size_t(n_uv) * (width + height) * 2 * sizeof(float) > sMaxTwiddleBytes)
+		return;
+
+	data.col_re.resize(n_uv * width);
+	data.col_im.resize(n_uv * width);
+	data.row_re.resize(n_uv * height);
+	data.row_im.resize(n_uv * height);
+
+	double phase;
+	for(unsigned int i = 0; i < n_uv; i++)
+	{
+		for(unsigned int x = 0; x < width; x++)
+		{
+			phase = -2 * PI * data.u[i] * scale * (x - x0);
+			data.col_re[i * width + x] = cos(phase);
+			data.col_im[i * width + x] = sin(phase);
+		}
+
+		for(unsigned int y = 0; y < height; y++)
+		{
+			phase = -2 * PI * data.v[i] * scale * (y - y0);
+			data.row_re[i * height + y] = cos(phase);
+			data.row_im[i * height + y] = sin(phase);
+		}
+	}
+}
+
+/// Computes the chi elements for the current visibilities:
+///  [V2_0 ... V2_n, T3amp_0, T3phi_0, ... T3amp_m, T3phi_m]
+void CVisibilityEngine_CPU::ComputeChi(const DataSet & data, float * output, unsigned int n)
+{
+	const unsigned int n_v2 = data.v2.size();
+	const unsigned int n_t3 = data.t3_amp.size();
+	unsigned int j;
+	float re, im, model;
+	float re1, im1, re2, im2, re3, im3, bis_re, bis_im;
+	const bool weighted = mWeightSet < data.chi_weight.size() && !data.chi_weight[mWeightSet].empty();
+	const float * data_scale = (weighted) ? &data.data_scale[mWeightSet][0] : NULL;
+
+	for(unsigned int i = 0; i < n_v2 && i < n; i++)
+	{
+		j = data.v2_uv[i];
+		model = mVisRe[j] * mVisRe[j] + mVisIm[j] * mVisIm[j];
+		// (s * data - model) / (s * err) for a measurement scaled by s.
+		if(weighted)
+			model /= data_scale[i];
+		output[i] = (data.v2[i] - model) / data.v2_err[i];
+	}
+
+	for(unsigned int i = 0; i < n_t3 && n_v2 + 2*i + 1 < n; i++)
+	{
+		re1 = mVisRe[data.t3_uv1[i]];
+		im1 = mVisIm[data.t3_uv1[i]];
+		re2 = mVisRe[data.t3_uv2[i]];
+		im2 = mVisIm[data.t3_uv2[i]];
+		// conjugate of the third visibility
+		re3 = mVisRe[data.t3_uv3[i]];
+		im3 = -mVisIm[data.t3_uv3[i]];
+
+		re = re1 * re2 - im1 * im2;
+		im = re1 * im2 + im1 * re2;
+		bis_re = re * re3 - im * im3;
+		bis_im = re * im3 + im * re3;
+
+		model = sqrt(bis_re * bis_re + bis_im * bis_im);
+		if(weighted)
+			model /= data_scale[n_v2 + 2*i];
+		output[n_v2 + 2*i] = (data.t3_amp[i] - model) / data.t3_amp_err[i];
+		model = atan2(bis_im, bis_re);
+		output[n_v2 + 2*i + 1] = WrapPhase(data.t3_phi[i] - model) / data.t3_phi_err[i];
+	}
+
+	if(!weighted)
+		return;
+
+	const vector<float> & chi_weight = data.chi_weight[mWeightSet];
+	for(unsigned int i = 0; i < n && i < chi_weight.size(); i++)
+		output[i] *= chi_weight[i];
+}
+
+/// Computes the normalized visibilities of the current image at every uv point in data.
+/// The separable tables are used whenever they fit in memory.  The data are only read, so
+/// engines sharing them may call this concurrently.
+void CVisibilityEngine_CPU::ComputeVisibilities(const DataSet & data)
+{
+	if(mAnalytic)
+	{
+		ComputeVisibilitiesAnalytic(data);
+		return;
+	}
+
+	// The tables are built by the engine owning the data whenever the image geometry
+	// changes (see SetImageInfo), engines sharing the data must use the same geometry.
+	bool tables_valid = data.twiddle_width == mImageWidth && data.twiddle_height == mImageHeight && data.twiddle_scale == mImageScale;
+	assert(tables_valid);
+
+	if(tables_valid && (data.col_re.size() > 0 || data.u.size() == 0))
+		ComputeVisibilitiesSeparable(data);
+	else
+		ComputeVisibilitiesDFT(data);
+}
+
+/// Computes the visibilities of the disks set by SetAnalyticModel.
+void CVisibilityEngine_CPU::ComputeVisibilitiesAnalytic(const DataSet & data)
+{
+	const unsigned int n_uv = data.u.size();
+	const unsigned int block_size = 64;
+	const unsigned int n_blocks = (n_uv + block_size - 1) / block_size;
+
+	double flux = 0;
+	for(auto & disk : mDisks)
+		flux += disk.GetFlux();
+
+	const double norm = (flux != 0) ? 1.0 / flux : 0;
+
+	mVisRe.resize(n_uv);
+	mVisIm.resize(n_uv);
+
+	CThreadPool::TaskFunction task = [&](unsigned int block, unsigned int thread_id)
+	{
+		const unsigned int end = min(n_uv, (block + 1) * block_size);
+		double sum_re, sum_im, re, im;
+		for(unsigned int i = block * block_size; i < end; i++)
+		{
+			sum_re = sum_im = 0;
+			for(auto & disk : mDisks)
+			{
+				disk.GetVisibility(data.u[i], data.v[i], re, im);
+				sum_re += re;
+				sum_im += im;
+			}
+
+			mVisRe[i] = sum_re * norm;
+			mVisIm[i] = sum_im * norm;
+		}
+	};
+
+	if(mThreadPool != NULL)
+		mThreadPool->ParallelFor(n_blocks, task);
+	else
+	{
+		for(unsigned int block = 0; block < n_blocks; block++)
+			task(block, 0);
+	}
+}
+
+/// Computes the visibilities using a direct DFT over the non-zero pixels.
+void CVisibilityEngine_CPU::ComputeVisibilitiesDFT(const DataSet & data)
+{
+	const unsigned int n_uv = data.u.size();
+	const unsigned int n_pixels = mPixelFlux.size();
+	const unsigned int block_size = 64;
+	const unsigned int n_blocks = (n_uv + block_size - 1) / block_size;
+	const double scale = mImageScale * sMasToRad;	// radians / pixel
+	const float norm = (mFlux != 0) ? 1.0 / mFlux : 0;
+
+	mVisRe.resize(n_uv);
+	mVisIm.resize(n_uv);
+
+	CThreadPool::TaskFunction task = [&](unsigned int block, unsigned int thread_id)
+	{
+		const unsigned int end = min(n_uv, (block + 1) * block_size);
+		float re, im;
+		for(unsigned int i = block * block_size; i < end; i++)
+		{
+			DFT(&mPixelX[0], &mPixelY[0], &mPixelFlux[0], n_pixels,
+					data.u[i] * scale, data.v[i] * scale, re, im);
+			mVisRe[i] = re * norm;
+			mVisIm[i] = im * norm;
+		}
+	};
+
+	if(n_pixels == 0)
+	{
+		fill(mVisRe.begin(), mVisRe.end(), 0.0f);
+		fill(mVisIm.begin(), mVisIm.end(), 0.0f);
+	}
+	else if(mThreadPool != NULL)
+		mThreadPool->ParallelFor(n_blocks, task);
+	else
+	{
+		for(unsigned int block = 0; block < n_blocks; block++)
+			task(block, 0);
+	}
+}
+
+/// Computes the visibilities using the separable tables:
+///   V(u,v) = sum_y exp(-2 pi i v y) * [ sum_x I(x,y) exp(-2 pi i u x) ]
+/// The inner sum is a matrix-vector product of the image with the column table, the
+/// outer sum a second (short) product with the row table.  Each thread processes a block
+/// of uv points one image row at a time so the row stays in cache.
+void CVisibilityEngine_CPU::ComputeVisibilitiesSeparable(const DataSet & data)
+{
+	const unsigned int n_uv = data.u.size();
+	const unsigned int width = mImageWidth;
+	const unsigned int height = mImageHeight;
+	const unsigned int block_size = 16;
+	const unsigned int n_blocks = (n_uv + block_size - 1) / block_size;
+	const float norm = (mFlux != 0) ? 1.0 / mFlux : 0;
+
+	mVisRe.resize(n_uv);
+	mVisIm.resize(n_uv);
+
+	CThreadPool::TaskFunction task = [&](unsigned int block, unsigned int thread_id)
+	{
+		const unsigned int start = block * block_size;
+		const unsigned int end = min(n_uv, start + block_size);
+		double vis_re[block_size];
+		double vis_im[block_size];
+		float sum_re, sum_im, row_re, row_im;
+		unsigned int x0, n;
+
+		for(unsigned int i = start; i < end; i++)
+			vis_re[i - start] = vis_im[i - start] = 0;
+
+		for(unsigned int y = 0; y < height; y++)
+		{
+			x0 = mRowStart[y];
+			n = mRowEnd[y] - x0;
+			if(n == 0)
+				continue;
+
+			const float * image_row = &mImage[y * width + x0];
+			for(unsigned int i = start; i < end; i++)
+			{
+				Dot2(image_row, &data.col_re[i * width + x0], &data.col_im[i * width + x0], n, sum_re, sum_im);
+				row_re = data.row_re[i * height + y];
+				row_im = data.row_im[i * height + y];
+				vis_re[i - start] += row_re * sum_re - row_im * sum_im;
+				vis_im[i - start] += row_re * sum_im + row_im * sum_re;
+			}
+		}
+
+		for(unsigned int i = start; i < end; i++)
+		{
+			mVisRe[i] = vis_re[i - start] * norm;
+			mVisIm[i] = vis_im[i - start] * norm;
+		}
+	};
+
+	if(mThreadPool != NULL)
+		mThreadPool->ParallelFor(n_blocks, task);
+	else
+	{
+		for(unsigned int block = 0; block < n_blocks; block++)
+			task(block, 0);
+	}
+}
+
+/// Copies the image from the image source and extracts the non-zero pixels.
+void CVisibilityEngine_CPU::CopyImageToBuffer(int layer)
+{
+	const unsigned int size = mImageWidth * mImageHeight;
+	mImage.resize(size);
+	mAnalytic = false;
+
+	if(mImageHost != NULL)
+		copy(mImageHost, mImageHost + size, mImage.begin());
+	else
+	{
+		glBindTexture(GL_TEXTURE_2D, mImageTexture);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, &mImage[0]);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	// Pixel coordinates are measured from the center of the image, which is the point
+	// where the model coordinate system origin lands.
+	const float x0 = mImageWidth / 2.0f - 0.5f;
+	const float y0 = mImageHeight / 2.0f - 0.5f;
+
+	mPixelX.clear();
+	mPixelY.clear();
+	mPixelFlux.clear();
+	mRowStart.assign(mImageHeight, 0);
+	mRowEnd.assign(mImageHeight, 0);
+	mFlux = 0;
+
+	float value;
+	for(unsigned int y = 0; y < mImageHeight; y++)
+	{
+		for(unsigned int x = 0; x < mImageWidth; x++)
+		{
+			value = mImage[y * mImageWidth + x];
+			if(value == 0)
+				continue;
+
+			if(mRowEnd[y] == 0)
+				mRowStart[y] = x;
+			mRowEnd[y] = x + 1;
+
+			mPixelX.push_back(x - x0);
+			mPixelY.push_back(y - y0);
+			mPixelFlux.push_back(value);
+			mFlux += value;
+		}
+	}
+
+	// Pad to the SIMD width with zero flux pixels.
+	while(mPixelFlux.size() % sSIMDWidth != 0)
+	{
+		mPixelX.push_back(0);
+		mPixelY.push_back(0);
+		mPixelFlux.push_back(0);
+	}
+}
+
+void CVisibilityEngine_CPU::ExportImage(float * image, unsigned int width, unsigned int height, unsigned int depth)
+{
+	if(width != mImageWidth || height != mImageHeight || mImage.size() < width * height)
+		return;
+
+	copy(mImage.begin(), mImage.begin() + width * height, image);
+}
+
+/// Computes the factors by which the calibrated amplitudes in data set data_num change if the
+/// (uniform disk) calibrator diameter changes from old_diameter to new_diameter (mas), one
+/// per chi element (see SetDataWeights).  The factors for closure phases are one.
+void CVisibilityEngine_CPU::GetCalibrationScales(int data_num, double old_diameter, double new_diameter, float * output, unsigned int n)
+{
+	DataSetPtr data = GetDataSet(data_num);
+	const unsigned int n_v2 = data->v2.size();
+	const unsigned int n_t3 = data->t3_amp.size();
+
+	CAnalyticDisk old_cal;
+	CAnalyticDisk new_cal;
+	old_cal.diameter = old_diameter;
+	new_cal.diameter = new_diameter;
+	old_cal.AddTerm(0, 1);
+	new_cal.AddTerm(0, 1);
+	const double old_flux = old_cal.GetFlux();
+	const double new_flux = new_cal.GetFlux();
+
+	// The calibrated visibility is proportional to the calibrator's model visibility.
+	vector<float> ratio(data->u.size());
+	double old_re, new_re, im;
+	for(unsigned int j = 0; j < ratio.size(); j++)
+	{
+		old_cal.GetVisibility(data->u[j], data->v[j], old_re, im);
+		new_cal.GetVisibility(data->u[j], data->v[j], new_re, im);
+		ratio[j] = (old_re != 0) ? fabs((new_re / new_flux) / (old_re / old_flux)) : 1;
+	}
+
+	for(unsigned int i = 0; i < n_v2 && i < n; i++)
+		output[i] = ratio[data->v2_uv[i]] * ratio[data->v2_uv[i]];
+
+	for(unsigned int i = 0; i < n_t3 && n_v2 + 2*i + 1 < n; i++)
+	{
+		output[n_v2 + 2*i] = ratio[data->t3_uv1[i]] * ratio[data->t3_uv2[i]] * ratio[data->t3_uv3[i]];
+		output[n_v2 + 2*i + 1] = 1;
+	}
+}
+
+/// Converts an OIDataList into a DataSet, discarding flagged points.
+CVisibilityEngine_CPU::DataSetPtr CVisibilityEngine_CPU::FlattenData(const OIDataList & data)
+{
+	DataSetPtr output(new DataSet());
+	output->data = data;
+	output->twiddle_width = 0;
+	output->twiddle_height = 0;
+	output->twiddle_scale = 0;
+
+	double jd_sum = 0;
+	unsigned int n_rows = 0;
+	double lambda;
+
+	for(auto row : data)
+	{
+		jd_sum += row->mMJD;
+		n_rows++;
+
+		shared_ptr<COIV2Row> v2 = dynamic_pointer_cast<COIV2Row>(row);
+		if(v2 != NULL)
+		{
+			for(unsigned int k = 0; k < v2->mVis2Data.size(); k++)
+			{
+				if(v2->mFlag[k])
+					continue;
+
+				lambda = v2->mWave->mEffWave[k];
+				output->v2_uv.push_back(output->u.size());
+				output->u.push_back(v2->mUCoord / lambda);
+				output->v.push_back(v2->mVCoord / lambda);
+				output->v2.push_back(v2->mVis2Data[k]);
+				output->v2_err.push_back(v2->mVis2Err[k]);
+			}
+		}
+
+		shared_ptr<COIT3Row> t3 = dynamic_pointer_cast<COIT3Row>(row);
+		if(t3 != NULL)
+		{
+			for(unsigned int k = 0; k < t3->mT3Amp.size(); k++)
+			{
+				if(t3->mFlag[k])
+					continue;
+
+				lambda = t3->mWave->mEffWave[k];
+				output->t3_uv1.push_back(output->u.size());
+				output->u.push_back(t3->mU1Coord / lambda);
+				output->v.push_back(t3->mV1Coord / lambda);
+				output->t3_uv2.push_back(output->u.size());
+				output->u.push_back(t3->mU2Coord / lambda);
+				output->v.push_back(t3->mV2Coord / lambda);
+				output->t3_uv3.push_back(output->u.size());
+				output->u.push_back((t3->mU1Coord + t3->mU2Coord) / lambda);
+				output->v.push_back((t3->mV1Coord + t3->mV2Coord) / lambda);
+
+				output->t3_amp.push_back(t3->mT3Amp[k]);
+				output->t3_amp_err.push_back(t3->mT3AmpErr[k]);
+				// OIFITS phases are in degrees.
+				output->t3_phi.push_back(t3->mT3Phi[k] * PI / 180);
+				output->t3_phi_err.push_back(t3->mT3PhiErr[k] * PI / 180);
+			}
+		}
+	}
+
+	// MJD -> JD
+	output->ave_jd = 0;
+	if(n_rows > 0)
+		output->ave_jd = jd_sum / n_rows + 2400000.5;
+
+	return output;
+}
+
+OIDataList CVisibilityEngine_CPU::GetData(unsigned int data_num)
+{
+	return GetDataSet(data_num)->data;
+}
+
+double CVisibilityEngine_CPU::GetDataAveJD(unsigned int data_num)
+{
+	return GetDataSet(data_num)->ave_jd;
+}
+
+CVisibilityEngine_CPU::DataSetPtr CVisibilityEngine_CPU::GetDataSet(unsigned int data_num)
+{
+	if(data_num >= mDataSets.size())
+		throw out_of_range("Data set index is out of range.");
+
+	return mDataSets[data_num];
+}
+
+/// Returns the total number of data points (V2 + T3 amplitudes + T3 phases)
+int CVisibilityEngine_CPU::GetNData()
+{
+	int n = 0;
+	for(unsigned int i = 0; i < mDataSets.size(); i++)
+		n += GetNDataAllocated(i);
+
+	return n;
+}
+
+int CVisibilityEngine_CPU::GetNDataAllocated()
+{
+	return GetNData();
+}
+
+int CVisibilityEngine_CPU::GetNDataAllocated(int data_num)
+{
+	if(data_num < 0 || data_num >= int(mDataSets.size()))
+		return 0;
+
+	return GetNV2(data_num) + 2 * GetNT3(data_num);
+}
+
+int CVisibilityEngine_CPU::GetNDataSets()
+{
+	return mDataSets.size();
+}
+
+int CVisibilityEngine_CPU::GetNT3(int data_num)
+{
+	return GetDataSet(data_num)->t3_amp.size();
+}
+
+int CVisibilityEngine_CPU::GetNV2(int data_num)
+{
+	return GetDataSet(data_num)->v2.size();
+}
+
+void CVisibilityEngine_CPU::ImageToChi(int data_num, float * output, unsigned int n)
+{
+	DataSetPtr data = GetDataSet(data_num);
+	ComputeVisibilities(*data);
+	ComputeChi(*data, output, n);
+}
+
+double CVisibilityEngine_CPU::ImageToChi2(int data_num)
+{
+	DataSetPtr data = GetDataSet(data_num);
+	unsigned int n = GetNDataAllocated(data_num);
+	vector<float> chi(n);
+	ComputeVisibilities(*data);
+	ComputeChi(*data, &chi[0], n);
+
+	double chi2 = 0;
+	for(unsigned int i = 0; i < n; i++)
+		chi2 += double(chi[i]) * chi[i];
+
+	return chi2;
+}
+
+void CVisibilityEngine_CPU::ImageToChi2(int data_num, float * output, unsigned int n)
+{
+	ImageToChi(data_num, output, n);
+
+	n = min(n, (unsigned int) GetNDataAllocated(data_num));
+	for(unsigned int i = 0; i < n; i++)
+		output[i] *= output[i];
+}
+
+/// Returns the log-likelihood, -chi2 / 2, of the current image.
+double CVisibilityEngine_CPU::ImageToLogLike(int data_num)
+{
+	return -0.5 * ImageToChi2(data_num);
+}
+
+void CVisibilityEngine_CPU::Init()
+{
+	// Nothing to compile or allocate.
+}
+
+void CVisibilityEngine_CPU::LoadData(string filename)
+{
+	COIFile file;
+	file.open(filename);
+	OIDataList data = file.read();
+	file.close();
+
+	LoadData(data);
+}
+
+void CVisibilityEngine_CPU::LoadData(const OIDataList & data)
+{
+	mDataSets.push_back(FlattenData(data));
+	BuildTwiddles(*mDataSets.back());
+}
+
+void CVisibilityEngine_CPU::RemoveData(int data_num)
+{
+	if(data_num >= 0 && data_num < int(mDataSets.size()))
+		mDataSets.erase(mDataSets.begin() + data_num);
+}
+
+void CVisibilityEngine_CPU::ReplaceData(unsigned int data_num, const OIDataList & data)
+{
+	GetDataSet(data_num);
+	mDataSets[data_num] = FlattenData(data);
+	BuildTwiddles(*mDataSets[data_num]);
+}
+
+void CVisibilityEngine_CPU::RunVerification(int data_num)
+{
+	printf("Verification routines are only implemented for the OpenCL visibility engine.\n");
+}
+
+/// Saves the current image as a (32-bit floating point) FITS file.
+void CVisibilityEngine_CPU::SaveImage(string filename)
+{
+	const unsigned int block = 2880;
+	const unsigned int card = 80;
+	stringstream header;
+	char tmp[card + 1];
+
+	snprintf(tmp, card + 1, "%-8s= %20s", "SIMPLE", "T");
+	header << left << setw(card) << tmp;
+	snprintf(tmp, card + 1, "%-8s= %20i", "BITPIX", -32);
+	header << left << setw(card) << tmp;
+	snprintf(tmp, card + 1, "%-8s= %20i", "NAXIS", 2);
+	header << left << setw(card) << tmp;
+	snprintf(tmp, card + 1, "%-8s= %20u", "NAXIS1", mImageWidth);
+	header << left << setw(card) << tmp;
+	snprintf(tmp, card + 1, "%-8s= %20u", "NAXIS2", mImageHeight);
+	header << left << setw(card) << tmp;
+	header << left << setw(card) << "END";
+
+	string output = header.str();
+	output.resize(block * ((output.size() + block - 1) / block), ' ');
+
+	// FITS data are big endian.
+	const unsigned int size = mImageWidth * mImageHeight;
+	string data(4 * size, '\0');
+	unsigned char * bytes;
+	for(unsigned int i = 0; i < size && i < mImage.size(); i++)
+	{
+		bytes = reinterpret_cast<unsigned char *>(&mImage[i]);
+		for(int j = 0; j < 4; j++)
+			data[4*i + j] = bytes[3 - j];
+	}
+	data.resize(block * ((data.size() + block - 1) / block), '\0');
+
+	ofstream outfile(filename.c_str(), ios::binary);
+	outfile << output << data;
+	outfile.close();
+}
+
+/// Computes visibilities from the disks, rather than the image, until the next call to
+/// CopyImageToBuffer.
+void CVisibilityEngine_CPU::SetAnalyticModel(const vector<CAnalyticDisk> & disks)
+{
+	mDisks = disks;
+	mAnalytic = true;
+
+	// The flux the disks would have in the image (pixel units).
+	mFlux = 0;
+	for(auto & disk : mDisks)
+		mFlux += disk.GetFlux() / (mImageScale * mImageScale);
+}
+
+/// Weights the chi elements of data set data_num (V2, then T3 amplitude and phase pairs) by
+/// weights[i] (e.g. bootstrap multiplicities) and scales the measured amplitudes, and their
+/// uncertainties, by scales[i].  The data are otherwise unchanged.  Several sets of weights
+/// may be stored, the one used is chosen by SelectWeights.  Passing weights = NULL clears
+/// the set.  Applies to every engine sharing the data (see ShareData).
+void CVisibilityEngine_CPU::SetDataWeights(int data_num, unsigned int weight_set, const float * weights, const float * scales, unsigned int n)
+{
+	DataSetPtr data = GetDataSet(data_num);
+	if(data->chi_weight.size() <= weight_set)
+	{
+		data->chi_weight.resize(weight_set + 1);
+		data->data_scale.resize(weight_set + 1);
+	}
+
+	vector<float> & chi_weight = data->chi_weight[weight_set];
+	vector<float> & data_scale = data->data_scale[weight_set];
+	if(weights == NULL)
+	{
+		chi_weight.clear();
+		data_scale.clear();
+		return;
+	}
+
+	const unsigned int size = GetNDataAllocated(data_num);
+	chi_weight.assign(size, 1);
+	data_scale.assign(size, 1);
+	for(unsigned int i = 0; i < n && i < size; i++)
+	{
+		chi_weight[i] = sqrt(weights[i]);
+		if(scales != NULL)
+			data_scale[i] = scales[i];
+	}
+}
+
+void CVisibilityEngine_CPU::SetImageInfo(unsigned int width, unsigned int height, unsigned int depth, double scale)
+{
+	mImageWidth = width;
+	mImageHeight = height;
+	mImageDepth = depth;
+	mImageScale = scale;
+
+	// The DFT tables depend on the image size and scale.  Shared data sets are kept up to
+	// date by the engine owning them.
+	if(mSharedData)
+		return;
+
+	for(auto data : mDataSets)
+	{
+		if(data->twiddle_width != width || data->twiddle_height != height || data->twiddle_scale != scale)
+			BuildTwiddles(*data);
+	}
+}
+
+/// Read images from the specified OpenGL texture (GL_R32F)
+void CVisibilityEngine_CPU::SetImageSource(GLuint texture)
+{
+	mImageTexture = texture;
+	mImageHost = NULL;
+}
+
+/// Read images directly from the specified array in host memory.
+void CVisibilityEngine_CPU::SetImageSource(const float * image)
+{
+	mImageHost = image;
+}
+
+/// Shares the data sets loaded in source with this engine, which only reads them.  The data
+/// sets are not copied, so they (including their weights and DFT tables) may only be changed
+/// through source, from the render thread, while no batch is running.  This engine must use
+/// the same image geometry as source.
+void CVisibilityEngine_CPU::ShareData(const CVisibilityEngine_CPU & source)
+{
+	mDataSets = source.mDataSets;
+	mSharedData = true;
+}
+
+double CVisibilityEngine_CPU::TotalFlux(bool compute_sum)
+{
+	return mFlux;
+}
@@ -0,0 +1,175 @@
+/*
+ * CVisibilityEngine_CPU.h
+ *
+ *  A native (CPU) visibility engine.  Computes the discrete Fourier transform
+ *  of the rendered image at the uv points of each data set using SIMD kernels
+ *  and a thread pool, then reduces to chi, chi2, and log-likelihood values.
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CVISIBILITYENGINE_CPU_H_
+#define CVISIBILITYENGINE_CPU_H_
+
+#include <memory>
+#include "CVisibilityEngine.h"
+
+class CVisibilityEngine_CPU : public CVisibilityEngine
+{
+protected:
+	/// A data set flattened into arrays.  The uv points are in units of wavelengths,
+	/// phases are in radians.  T3 values are formed from the bispectrum
+	///   V(uv1) * V(uv2) * conj(V(uv3)), with uv3 = uv1 + uv2.
+	struct DataSet
+	{
+		OIDataList data;
+		double ave_jd;
+
+		vector<float> u;
+		vector<float> v;
+
+		vector<unsigned int> v2_uv;
+		vector<float> v2;
+		vector<float> v2_err;
+
+		vector<unsigned int> t3_uv1;
+		vector<unsigned int> t3_uv2;
+		vector<unsigned int> t3_uv3;
+		vector<float> t3_amp;
+		vector<float> t3_amp_err;
+		vector<float> t3_phi;
+		vector<float> t3_phi_err;
+
+		// Sets of per chi element weights (stored as sqrt(weight)) and scale factors for the
+		// measured amplitudes, see SetDataWeights.  Empty sets leave the data unweighted.
+		vector< vector<float> > chi_weight;
+		vector< vector<float> > data_scale;
+
+		// Separable DFT tables, exp(-2 pi i u x) and exp(-2 pi i v y), for every uv point.
+		// Valid for images of size twiddle_width x twiddle_height at twiddle_scale.
+		unsigned int twiddle_width;
+		unsigned int twiddle_height;
+		double twiddle_scale;
+		vector<float> col_re;
+		vector<float> col_im;
+		vector<float> row_re;
+		vector<float> row_im;
+	};
+	typedef shared_ptr<DataSet> DataSetPtr;
+
+	CThreadPool * mThreadPool;
+	vector<DataSetPtr> mDataSets;
+	bool mSharedData;	// mDataSets belong to another engine (see ShareData)
+
+	// Image information and source
+	unsigned int mImageWidth;
+	unsigned int mImageHeight;
+	unsigned int mImageDepth;
+	double mImageScale;	// mas / pixel
+	GLuint mImageTexture;
+	const float * mImageHost;
+
+	// The current image and its non-zero pixels (structure of arrays, padded to sSIMDWidth)
+	vector<float> mImage;
+	vector<float> mPixelX;
+	vector<float> mPixelY;
+	vector<float> mPixelFlux;
+	double mFlux;
+
+	// The range of non-zero pixels [start, end) in each row of the image.
+	vector<unsigned int> mRowStart;
+	vector<unsigned int> mRowEnd;
+
+	// Models with closed-form visibilities, used instead of the image if mAnalytic is set
+	// (see SetAnalyticModel).
+	vector<CAnalyticDisk> mDisks;
+	bool mAnalytic;
+
+	// The set of data weights used by ImageToChi et al.
+	unsigned int mWeightSet;
+
+	// Model visibilities at the uv points of the current data set.
+	vector<float> mVisRe;
+	vector<float> mVisIm;
+
+	static const unsigned int sSIMDWidth = 16;
+	static const size_t sMaxTwiddleBytes;
+
+public:
+	CVisibilityEngine_CPU(CThreadPool * thread_pool);
+	virtual ~CVisibilityEngine_CPU();
+
+	void 	CopyImageToBuffer(int layer);
+	void 	ExportImage(float * image, unsigned int width, unsigned int height, unsigned int depth);
+
+	void 	GetCalibrationScales(int data_num, double old_diameter, double new_diameter, float * output, unsigned int n);
+	OIDataList GetData(unsigned int data_num);
+	double 	GetDataAveJD(unsigned int data_num);
+	int 	GetNData();
+	int 	GetNDataAllocated();
+	int 	GetNDataAllocated(int data_num);
+	int 	GetNDataSets();
+	int 	GetNT3(int data_num);
+	int 	GetNV2(int data_num);
+
+	void 	ImageToChi(int data_num, float * output, unsigned int n);
+	double 	ImageToChi2(int data_num);
+	void 	ImageToChi2(int data_num, float * output, unsigned int n);
+	double 	ImageToLogLike(int data_num);
+	void 	Init();
+
+	void 	LoadData(string filename);
+	void 	LoadData(const OIDataList & data);
+
+	void 	RemoveData(int data_num);
+	void 	ReplaceData(unsigned int data_num, const OIDataList & data);
+	void 	RunVerification(int data_num);
+
+	void 	SaveImage(string filename);
+	void 	SelectWeights(unsigned int weight_set) { mWeightSet = weight_set; };
+	void 	SetAnalyticModel(const vector<CAnalyticDisk> & disks);
+	void 	SetDataWeights(int data_num, unsigned int weight_set, const float * weights, const float * scales, unsigned int n);
+	void 	SetImageInfo(unsigned int width, unsigned int height, unsigned int depth, double scale);
+	void 	SetImageSource(GLuint texture);
+	void 	SetImageSource(const float * image);
+	void 	ShareData(const CVisibilityEngine_CPU & source);
+	bool 	SupportsAnalyticModels() { return true; };
+	bool 	SupportsDataWeights() { return true; };
+
+	double 	TotalFlux(bool compute_sum);
+
+protected:
+	void 	BuildTwiddles(DataSet & data);
+	void 	ComputeChi(const DataSet & data, float * output, unsigned int n);
+	void 	ComputeVisibilities(const DataSet & data);
+	void 	ComputeVisibilitiesAnalytic(const DataSet & data);
+	void 	ComputeVisibilitiesDFT(const DataSet & data);
+	void 	ComputeVisibilitiesSeparable(const DataSet & data);
+	static DataSetPtr FlattenData(const OIDataList & data);
+	DataSetPtr GetDataSet(unsigned int data_num);
+};
+
+#endif /* CVISIBILITYENGINE_CPU_H_ */
@@ -0,0 +1,175 @@
+/*
+ * CVisibilityEngine_OpenCL.cpp
+ *
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+
+#include "CVisibilityEngine_OpenCL.h"
+
+CVisibilityEngine_OpenCL::CVisibilityEngine_OpenCL()
+{
+	mType = OPENCL;
+	mCL = new CLibOI(CL_DEVICE_TYPE_GPU);
+}
+
+CVisibilityEngine_OpenCL::~CVisibilityEngine_OpenCL()
+{
+	delete mCL;
+}
+
+void CVisibilityEngine_OpenCL::CopyImageToBuffer(int layer)
+{
+	mCL->CopyImageToBuffer(layer);
+}
+
+void CVisibilityEngine_OpenCL::ExportImage(float * image, unsigned int width, unsigned int height, unsigned int depth)
+{
+	mCL->ExportImage(image, width, height, depth);
+}
+
+OIDataList CVisibilityEngine_OpenCL::GetData(unsigned int data_num)
+{
+	return mCL->GetData(data_num);
+}
+
+double CVisibilityEngine_OpenCL::GetDataAveJD(unsigned int data_num)
+{
+	return mCL->GetDataAveJD(data_num);
+}
+
+int CVisibilityEngine_OpenCL::GetNData()
+{
+	return mCL->GetNData();
+}
+
+int CVisibilityEngine_OpenCL::GetNDataAllocated()
+{
+	return mCL->GetNDataAllocated();
+}
+
+int CVisibilityEngine_OpenCL::GetNDataAllocated(int data_num)
+{
+	return mCL->GetNDataAllocated(data_num);
+}
+
+int CVisibilityEngine_OpenCL::GetNDataSets()
+{
+	return mCL->GetNDataSets();
+}
+
+int CVisibilityEngine_OpenCL::GetNT3(int data_num)
+{
+	return mCL->GetNT3(data_num);
+}
+
+int CVisibilityEngine_OpenCL::GetNV2(int data_num)
+{
+	return mCL->GetNV2(data_num);
+}
+
+void CVisibilityEngine_OpenCL::ImageToChi(int data_num, float * output, unsigned int n)
+{
+	mCL->ImageToChi(data_num, output, n);
+}
+
+double CVisibilityEngine_OpenCL::ImageToChi2(int data_num)
+{
+	return mCL->ImageToChi2(data_num);
+}
+
+void CVisibilityEngine_OpenCL::ImageToChi2(int data_num, float * output, unsigned int n)
+{
+	mCL->ImageToChi2(data_num, output, n);
+}
+
+double CVisibilityEngine_OpenCL::ImageToLogLike(int data_num)
+{
+	return mCL->ImageToLogLike(data_num);
+}
+
+void CVisibilityEngine_OpenCL::Init()
+{
+	mCL->Init();
+}
+
+void CVisibilityEngine_OpenCL::LoadData(string filename)
+{
+	mCL->LoadData(filename);
+}
+
+void CVisibilityEngine_OpenCL::LoadData(const OIDataList & data)
+{
+	mCL->LoadData(data);
+}
+
+void CVisibilityEngine_OpenCL::RemoveData(int data_num)
+{
+	mCL->RemoveData(data_num);
+}
+
+void CVisibilityEngine_OpenCL::ReplaceData(unsigned int data_num, const OIDataList & data)
+{
+	mCL->ReplaceData(data_num, data);
+}
+
+void CVisibilityEngine_OpenCL::RunVerification(int data_num)
+{
+	mCL->RunVerification(data_num);
+}
+
+void CVisibilityEngine_OpenCL::SaveImage(string filename)
+{
+	mCL->SaveImage(filename);
+}
+
+void CVisibilityEngine_OpenCL::SetImageInfo(unsigned int width, unsigned int height, unsigned int depth, double scale)
+{
+	mCL->SetImageInfo(width, height, depth, scale);
+}
+
+void CVisibilityEngine_OpenCL::SetImageSource(GLuint texture)
+{
+	mCL->SetImageSource(texture, LibOIEnums::OPENGL_TEXTUREBUFFER);
+}
+
+/// liboi can only read images from OpenGL buffers.
+void CVisibilityEngine_OpenCL::SetImageSource(const float * image)
+{
+	throw runtime_error("The OpenCL visibility engine requires an OpenGL image source.");
+}
+
+void CVisibilityEngine_OpenCL::SetKernelSourcePath(string path)
+{
+	mCL->SetKernelSourcePath(path);
+}
+
+double CVisibilityEngine_OpenCL::TotalFlux(bool compute_sum)
+{
+	return mCL->TotalFlux(compute_sum);
+}
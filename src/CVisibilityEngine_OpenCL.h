@@ -0,0 +1,83 @@
+/*
+ * CVisibilityEngine_OpenCL.h
+ *
+ *  Visibility engine which forwards all requests to liboi (OpenCL).
+ */
+ 
+ /* 
+ * Copyright (c) 2012 Brian Kloppenborg
+ *
+ * If you use this software as part of a scientific publication, please cite as:
+ *
+ * Kloppenborg, B.; Baron, F. (2012), "SIMTOI: The SImulation and Modeling 
+ * Tool for Optical Interferometry" (Version X). 
+ * Available from  <https://github.com/bkloppenborg/simtoi>.
+ *
+ * This file is part of the SImulation and Modeling Tool for Optical 
+ * Interferometry (SIMTOI).
+ * 
+ * SIMTOI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation version 3.
+ * 
+ * SIMTOI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public 
+ * License along with SIMTOI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CVISIBILITYENGINE_OPENCL_H_
+#define CVISIBILITYENGINE_OPENCL_H_
+
+#include "CVisibilityEngine.h"
+#include "liboi.hpp"
+
+using namespace liboi;
+
+class CVisibilityEngine_OpenCL : public CVisibilityEngine
+{
+protected:
+	CLibOI * mCL;
+
+public:
+	CVisibilityEngine_OpenCL();
+	virtual ~CVisibilityEngine_OpenCL();
+
+	void 	CopyImageToBuffer(int layer);
+	void 	ExportImage(float * image, unsigned int width, unsigned int height, unsigned int depth);
+
+	OIDataList GetData(unsigned int data_num);
+	double 	GetDataAveJD(unsigned int data_num);
+	int 	GetNData();
+	int 	GetNDataAllocated();
+	int 	GetNDataAllocated(int data_num);
+	int 	GetNDataSets();
+	int 	GetNT3(int data_num);
+	int 	GetNV2(int data_num);
+
+	void 	ImageToChi(int data_num, float * output, unsigned int n);
+	double 	ImageToChi2(int data_num);
+	void 	ImageToChi2(int data_num, float * output, unsigned int n);
+	double 	ImageToLogLike(int data_num);
+	void 	Init();
+
+	void 	LoadData(string filename);
+	void 	LoadData(const OIDataList & data);
+
+	void 	RemoveData(int data_num);
+	void 	ReplaceData(unsigned int data_num, const OIDataList & data);
+	void 	RunVerification(int data_num);
+
+	void 	SaveImage(string filename);
+	void 	SetImageInfo(unsigned int width, unsigned int height, unsigned int depth, double scale);
+	void 	SetImageSource(GLuint texture);
+	void 	SetImageSource(const float * image);
+	void 	SetKernelSourcePath(string path);
+
+	double 	TotalFlux(bool compute_sum);
+};
+
+#endif /* CVISIBILITYENGINE_OPENCL_H_ */
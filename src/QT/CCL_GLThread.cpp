@@ -35,11 +35,19 @@
 #include "CModel.h"
 #include "CGLShaderList.h"
 #include "CPosition.h"
-#include "liboi.hpp"
+#include "CRasterizer.h"
+#include "CThreadPool.h"
+#include "CVisibilityEngine.h"
+#include "CVisibilityEngine_CPU.h"
+#include "CRenderWorker.h"
 #include "json/json.h"
 #include "textio.hpp"
 
 int CCL_GLThread::count = 0;
+CCL_GLThread::RenderTypes CCL_GLThread::mDefaultRenderType = CCL_GLThread::OPENGL;
+CVisibilityEngine::EngineTypes CCL_GLThread::mDefaultEngineType = CVisibilityEngine::OPENCL;
+unsigned int CCL_GLThread::mDefaultNWorkers = 0;
+bool CCL_GLThread::mDefaultAnalytic = false;
 
 CCL_GLThread::CCL_GLThread(CGLWidget *glWidget, string shader_source_dir, string kernel_source_dir)
 	: QThread(), mGLWidget(glWidget)
@@ -61,11 +69,18 @@ CCL_GLThread::CCL_GLThread(CGLWidget *glWidget, string shader_source_dir, string
     mKernelSourceDir = kernel_source_dir;
     mCL = NULL;
     mCLInitalized = false;
-    // These values come from outside of this class, if they are an array don't delete or free them here.
-    mCLDataSet = 0;
-    mCLValue = 0;
-    mCLArrayValue = NULL;
-    mCLArrayN = 0;
+
+    // Render workers, created on the first batch evaluated with them.
+    mNWorkers = mDefaultNWorkers;
+    mAnalytic = mDefaultAnalytic;
+    mWorkerPool = NULL;
+    mWorkerData = NULL;
+    mDataVersion = 1;
+    mWorkerDataVersion = 0;
+
+    // Nothing has been rendered or copied to the visibility engine yet.
+    mRenderedGeneration = 0;
+    mCopiedGeneration = 0;
 
     mFBO = 0;
  	mFBO_texture = 0;
@@ -73,20 +88,60 @@ CCL_GLThread::CCL_GLThread(CGLWidget *glWidget, string shader_source_dir, string
     mFBO_storage = 0;
 	mFBO_storage_texture = 0;
  	mSamples = 4;
+ 	mPreviewInterval = 100;	// at most 10 Hz
+
+    // Software rendering and CPU visibilities, only allocated when they are in use.  The
+    // rasterizers and the visibility engine have separate pools because a pool runs one loop
+    // at a time and RunBatchPipelined runs the two stages concurrently.
+    mRenderType = mDefaultRenderType;
+    mThreadPool = NULL;
+    mRasterPool = NULL;
+    mRasterizer = NULL;
+    mRasterizerBack = NULL;
+    if(mRenderType == SOFTWARE || mDefaultEngineType == CVisibilityEngine::CPU)
+    	mThreadPool = new CThreadPool();
+
+    if(mRenderType == SOFTWARE)
+    {
+    	mRasterPool = new CThreadPool();
+    	mRasterizer = new CRasterizer(mRasterPool);
+    	mRasterizerBack = new CRasterizer(mRasterPool);
+    }
+
+    // The CPU engine reads software-rendered images from host memory, so without a widget
+    // this combination needs no OpenGL context and can run headless.  With a widget, OpenGL
+    // is still used to display the images.
+    mUseOpenGL = (mGLWidget != NULL) || !(mRenderType == SOFTWARE && mDefaultEngineType == CVisibilityEngine::CPU);
+    if(mUseOpenGL && mGLWidget == NULL)
+    	throw runtime_error("CCL_GLThread: OpenGL rendering requires a CGLWidget.");
+
+    // There is nothing to display without a widget.
+    if(mGLWidget == NULL)
+    	mPreviewInterval = -1;
 }
 
 CCL_GLThread::~CCL_GLThread()
 {
 	// Free OpenGL memory buffers
-	glDeleteFramebuffers(1, &mFBO);
-	glDeleteFramebuffers(1, &mFBO_texture);
-	glDeleteFramebuffers(1, &mFBO_depth);
-	glDeleteFramebuffers(1, &mFBO_storage);
-	glDeleteFramebuffers(1, &mFBO_storage_texture);
+	if(mUseOpenGL)
+	{
+		glDeleteFramebuffers(1, &mFBO);
+		glDeleteFramebuffers(1, &mFBO_texture);
+		glDeleteFramebuffers(1, &mFBO_depth);
+		glDeleteFramebuffers(1, &mFBO_storage);
+		glDeleteFramebuffers(1, &mFBO_storage_texture);
+	}
 
+	mWorkers.clear();
+	delete mWorkerPool;
+	delete mWorkerData;
 	delete mCL;
 	delete mModelList;
 	delete mShaderList;
+	delete mRasterizer;
+	delete mRasterizerBack;
+	delete mRasterPool;
+	delete mThreadPool;
 }
 
 /// Appends a model to the model list, importing shaders and features as necessary.
@@ -106,6 +161,10 @@ void CCL_GLThread::AddModel(CModelList::ModelTypes model)
 /// Copies the off-screen framebuffer to the on-screen buffer.  To be called only by the thread.
 void CCL_GLThread::BlitToScreen()
 {
+	// There is no screen without OpenGL.
+	if(!mUseOpenGL)
+		return;
+
     // Bind back to the default buffer (just in case something didn't do it),
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -133,18 +192,35 @@ void CCL_GLThread::BlitToBuffer(GLuint in_buffer, GLuint out_buffer, unsigned in
   	CCL_GLThread::CheckOpenGLError("CGLThread BlitToBuffer");
 }
 
+/// Removes all pending rendering (GLT_*) operations from the queue.  Computation (CLT_*)
+/// requests are kept because their callers are waiting on the results.
+/// To be called only by the thread.
 void CCL_GLThread::ClearQueue()
 {
-	// Clear the queue and reset the semaphore.
 	mQueueMutex.lock();
 
-	// Clear the queue
-	while (!mQueue.empty())
+	deque<CL_GLT_RequestPtr> kept;
+	unsigned int n_removed = 0;
+	for(auto request : mQueue)
 	{
-		mQueue.pop();
+		switch(request->op)
+		{
+		case GLT_Animate:
+		case GLT_AnimateStop:
+		case GLT_BlitToScreen:
+		case GLT_RenderModels:
+		case GLT_RenderOffscreen:
+			n_removed++;
+			break;
+
+		default:
+			kept.push_back(request);
+			break;
+		}
 	}
 
-	mQueueSemaphore.acquire(mQueueSemaphore.available());
+	mQueue.swap(kept);
+	mQueueSemaphore.acquire(n_removed);
 	mQueueMutex.unlock();
 }
 
@@ -161,14 +237,67 @@ void CCL_GLThread::CheckOpenGLError(string function_name)
     }
 }
 
-/// Enqueue an operation for the CCL_GLThread to process.
+/// Copies the image of the current models into the visibility engine unless the engine
+/// already holds it.  To be called only by the thread.
+void CCL_GLThread::CopyImage()
+{
+	// Offscreen renders are skipped for analytic models, so make sure the image is current.
+	RenderModels();
+
+	if(mRenderedGeneration != 0 && mCopiedGeneration == mRenderedGeneration)
+		return;
+
+	mCL->CopyImageToBuffer(0);
+	mCopiedGeneration = mRenderedGeneration;
+}
+
+/// Returns true (and the disks) if closed-form visibilities are enabled (see SetDefaultAnalytic)
+/// and the current models have closed-form visibilities which the visibility engine can evaluate.
+bool CCL_GLThread::GetAnalyticModel(vector<CAnalyticDisk> & disks)
+{
+	return mAnalytic && mCL->SupportsAnalyticModels() && mModelList->GetAnalyticDisks(disks);
+}
+
+/// Submits a batch of n_vectors parameter vectors (each n_params long, stored contiguously)
+/// to the thread and blocks until all of them have been evaluated.
+void CCL_GLThread::EnqueueBatch(CL_GLT_Operations op, const double * params, unsigned int n_vectors, unsigned int n_params, bool scale_params, float * array, double * output, unsigned int weight_set)
+{
+	CL_GLT_RequestPtr request(new CL_GLT_Request(op));
+	request->params = params;
+	request->n_vectors = n_vectors;
+	request->n_params = n_params;
+	request->scale_params = scale_params;
+	request->array = array;
+	request->output = output;
+	request->weight_set = weight_set;
+
+	// Exceptions are passed on to the calling thread by get()
+	EnqueueRequest(request).get();
+}
+
+/// Enqueue an operation for the CCL_GLThread to process.  The result is not needed.
 void CCL_GLThread::EnqueueOperation(CL_GLT_Operations op)
 {
+	EnqueueRequest(CL_GLT_RequestPtr(new CL_GLT_Request(op)));
+}
+
+/// Enqueue a request for the CCL_GLThread to process.  Requests are processed in the order
+/// they were submitted, except for GLT_Stop which is processed next.  The returned future
+/// becomes ready (or holds the exception thrown) when the request has been processed.
+future<double> CCL_GLThread::EnqueueRequest(CL_GLT_RequestPtr request)
+{
+	future<double> result = request->result.get_future();
+
 	// Lock the queue, append the item, increment the semaphore.
 	mQueueMutex.lock();
-	mQueue.push(op);
+	if(request->op == GLT_Stop)
+		mQueue.push_front(request);
+	else
+		mQueue.push_back(request);
 	mQueueMutex.unlock();
 	mQueueSemaphore.release();
+
+	return result;
 }
 
 // Exports the simulated and real data for all currently loaded data
@@ -298,22 +427,44 @@ void CCL_GLThread::ExportResults(string base_filename)
 /// Returns the chi values in output for the specified data set and the current image.
 void CCL_GLThread::GetChi(int data_num, float * output, int & n)
 {
-	mCLDataSet = data_num;
-	mCLArrayValue = output;
-	mCLArrayN = n;
-	EnqueueOperation(CLT_Chi);
-	mCLOpSemaphore.acquire();
-	n = mCLArrayN;
+	CL_GLT_RequestPtr request(new CL_GLT_Request(CLT_Chi));
+	request->data_num = data_num;
+	request->array = output;
+	request->array_n = n;
+	EnqueueRequest(request).get();
+	n = request->array_n;
+}
+
+/// Evaluates the chi elements for n_vectors parameter vectors in a single submission.
+/// output must hold n_vectors * GetNDataAllocated() values, each vector's chi values are
+/// stored for every data set consecutively (same layout as repeated GetChi calls).
+void CCL_GLThread::GetChiBatch(const double * params, unsigned int n_vectors, unsigned int n_params, bool scale_params, float * output, unsigned int weight_set)
+{
+	EnqueueBatch(CLT_ChiBatch, params, n_vectors, n_params, scale_params, output, NULL, weight_set);
 }
 
 /// Returns the chi2 for the specified data set
 double CCL_GLThread::GetChi2(int data_num)
 {
 	// Set the data number, enqueue the operation and then block until we receive an answer.
-	mCLDataSet = data_num;
-	EnqueueOperation(CLT_Chi2);
-	mCLOpSemaphore.acquire();
-	return mCLValue;
+	CL_GLT_RequestPtr request(new CL_GLT_Request(CLT_Chi2));
+	request->data_num = data_num;
+	return EnqueueRequest(request).get();
+}
+
+/// Evaluates the chi2 for n_vectors parameter vectors in a single submission.
+/// output must hold n_vectors * GetNDataSets() values (one per vector per data set).
+void CCL_GLThread::GetChi2Batch(const double * params, unsigned int n_vectors, unsigned int n_params, bool scale_params, double * output, unsigned int weight_set)
+{
+	EnqueueBatch(CLT_Chi2Batch, params, n_vectors, n_params, scale_params, NULL, output, weight_set);
+}
+
+/// Computes the factors by which the amplitudes in data set data_num change if the calibrator
+/// diameter changes (see CVisibilityEngine_CPU::GetCalibrationScales).
+void CCL_GLThread::GetCalibrationScales(int data_num, double old_diameter, double new_diameter, float * output, unsigned int n)
+{
+	if(mCL != NULL)
+		mCL->GetCalibrationScales(data_num, old_diameter, new_diameter, output, n);
 }
 
 /// Returns a copy of the ccoifits data loaded in index data_num.
@@ -334,9 +485,7 @@ double CCL_GLThread::GetDataAveJD(int data_num)
 /// Returns the flux of the current rendered image
 double CCL_GLThread::GetFlux()
 {
-	EnqueueOperation(CLT_Flux);
-	mCLOpSemaphore.acquire();
-	return mCLValue;
+	return EnqueueRequest(CL_GLT_RequestPtr(new CL_GLT_Request(CLT_Flux))).get();
 }
 
 /// Returns the current rendered image, including depth, as a floating point array of size width * height * depth
@@ -347,19 +496,25 @@ void CCL_GLThread::GetImage(float * image, unsigned int width, unsigned int heig
 		return;
 
 	// Enqueue the copy operation, block until it has completed.
-	mCLArrayValue = image;
-	EnqueueOperation(CLT_CopyImage);
-	mCLOpSemaphore.acquire();
+	CL_GLT_RequestPtr request(new CL_GLT_Request(CLT_CopyImage));
+	request->array = image;
+	EnqueueRequest(request).get();
 }
 
 /// Returns the chi2 for the specified data set
 double CCL_GLThread::GetLogLike(int data_num)
 {
 	// Set the data number, enqueue the operation and then block until we receive an answer.
-	mCLDataSet = data_num;
-	EnqueueOperation(CLT_LogLike);
-	mCLOpSemaphore.acquire();
-	return mCLValue;
+	CL_GLT_RequestPtr request(new CL_GLT_Request(CLT_LogLike));
+	request->data_num = data_num;
+	return EnqueueRequest(request).get();
+}
+
+/// Evaluates the log likelihood for n_vectors parameter vectors in a single submission.
+/// output must hold n_vectors * GetNDataSets() values (one per vector per data set).
+void CCL_GLThread::GetLogLikeBatch(const double * params, unsigned int n_vectors, unsigned int n_params, bool scale_params, double * output, unsigned int weight_set)
+{
+	EnqueueBatch(CLT_LogLikeBatch, params, n_vectors, n_params, scale_params, NULL, output, weight_set);
 }
 
 /// Returns the total number of data points (V2 + T3) in all data sets loaded.
@@ -415,15 +570,15 @@ int CCL_GLThread::GetNV2(int data_num)
 }
 
 
-/// Get the next operation from the queue.  This is a blocking function.
-CL_GLT_Operations CCL_GLThread::GetNextOperation(void)
+/// Get the next request from the queue.  This is a blocking function.
+CL_GLT_RequestPtr CCL_GLThread::GetNextRequest(void)
 {
 	// First try to get access to the semaphore.  This is a blocking call if the queue is empty.
 	mQueueSemaphore.acquire();
-	// Now lock the queue, pull off the top item, pop it from the queue, and return.
+	// Now lock the queue, pull off the front item, pop it from the queue, and return.
 	mQueueMutex.lock();
-	CL_GLT_Operations tmp = mQueue.top();
-	mQueue.pop();
+	CL_GLT_RequestPtr tmp = mQueue.front();
+	mQueue.pop_front();
 	mQueueMutex.unlock();
 	return tmp;
 }
@@ -523,21 +678,20 @@ void CCL_GLThread::InitStorageBuffer(void)
 }
 
 
-/// Loads data.
+/// Loads data from a file. Returns the data id (>= 0) on success, -1 on failure.
 int CCL_GLThread::LoadData(string filename)
 {
-	mCLString = filename;
-	EnqueueOperation(CLT_DataLoadFromString);
-	mCLOpSemaphore.acquire();
+	CL_GLT_RequestPtr request(new CL_GLT_Request(CLT_DataLoadFromString));
+	request->filename = filename;
+	return int(EnqueueRequest(request).get());
 }
 
 /// Loads data to the OpenCL device. Returns the data id (>= 0) on success, -1 on failure.
 int CCL_GLThread::LoadData(const OIDataList & data)
 {
-	mCLDataList = data;
-	EnqueueOperation(CLT_DataLoadFromList);
-	mCLOpSemaphore.acquire();
-	return mCL->GetNData();
+	CL_GLT_RequestPtr request(new CL_GLT_Request(CLT_DataLoadFromList));
+	request->data = data;
+	return int(EnqueueRequest(request).get());
 }
 
 /// Opens a save file
@@ -553,26 +707,288 @@ void CCL_GLThread::Open(string filename)
 	EnqueueOperation(GLT_RenderModels);
 }
 
+/// Returns true if a throttled on-screen preview should be shown now.  Previews need OpenGL.
+bool CCL_GLThread::PreviewDue()
+{
+	return mUseOpenGL && mPreviewInterval >= 0 && (mPreviewTimer.isNull() || mPreviewTimer.elapsed() >= mPreviewInterval);
+}
+
+/// Executes a single request.  Computation (CLT_*) requests return their result through
+/// the request's promise.  To be called only by the thread.
+void CCL_GLThread::ProcessRequest(CL_GLT_RequestPtr request)
+{
+	double half_width = 0;
+
+	// Chi values are computed with the data weights requested (set 0 unless specified).
+	if(mCL != NULL)
+		mCL->SelectWeights(request->weight_set);
+
+	// NOTE: Resize and Render cascade.
+	switch(request->op)
+	{
+	case GLT_Animate:
+		mModelList->IncrementTime();
+		QThread::msleep(40);
+		EnqueueOperation(GLT_RenderModels);
+		EnqueueOperation(GLT_Animate);
+		break;
+
+	case GLT_Resize:
+		// Resize the screen, then cascade to a render and a blit.
+		if(mUseOpenGL)
+		{
+			glViewport(0, 0, mImageWidth, mImageHeight);
+			glMatrixMode(GL_PROJECTION);
+			glLoadIdentity();
+			half_width = mImageWidth * mScale / 2;
+			glOrtho(-half_width, half_width, -half_width, half_width, -mAreaDepth, mAreaDepth);
+			glMatrixMode(GL_MODELVIEW);
+			CCL_GLThread::CheckOpenGLError("CGLThread GLT_Resize");
+		}
+		if(mRasterizer != NULL)
+		{
+			mRasterizer->SetImageInfo(mImageWidth, mImageHeight, mScale, mAreaDepth);
+			mRasterizerBack->SetImageInfo(mImageWidth, mImageHeight, mScale, mAreaDepth);
+		}
+		// Now tell OpenCL about the image (depth = 1 because we have only one layer)
+		mCL->SetImageInfo(mImageWidth, mImageHeight, 1, double(mScale));
+		SetImageSource();
+		mRenderedGeneration = 0;
+		mPermitResize = false;
+
+	default:
+	case GLT_RenderModels:
+		// Render the models, then cascade to a blit to screen.
+		RenderModels();
+
+	case GLT_BlitToScreen:
+		BlitToScreen();
+		mPreviewTimer.restart();
+		break;
+
+	case GLT_RenderOffscreen:
+		// Render for computation only, the screen is refreshed at a throttled rate.
+		RenderOffscreen();
+		break;
+
+	case GLT_Stop:
+		mRun = false;
+		break;
+
+	case GLT_AnimateStop:
+		ClearQueue();
+		EnqueueOperation(GLT_RenderModels);
+		break;
+
+	case CLT_DataLoadFromString:
+		mCL->LoadData(request->filename);
+		mDataVersion++;
+		mCopiedGeneration = 0;
+		// The new data set is the last one.
+		request->result.set_value(mCL->GetNDataSets() - 1);
+		break;
+
+	case CLT_DataLoadFromList:
+		mCL->LoadData(request->data);
+		mDataVersion++;
+		mCopiedGeneration = 0;
+		// The new data set is the last one.
+		request->result.set_value(mCL->GetNDataSets() - 1);
+		break;
+
+	case CLT_DataRemove:
+		mCL->RemoveData(request->data_num);
+		mDataVersion++;
+		mCopiedGeneration = 0;
+		request->result.set_value(0);
+		break;
+
+	case CLT_DataReplace:
+		mDataVersion++;
+		mCopiedGeneration = 0;
+		mCL->ReplaceData(request->data_num, request->data);
+		request->result.set_value(0);
+		break;
+
+	case CLT_DataSetWeights:
+		// The weights are stored with the data sets, which the render workers share, so
+		// they do not need to be synchronized.
+		if(request->weights.size() > 0)
+			mCL->SetDataWeights(request->data_num, request->weight_set, &request->weights[0], (request->scales.size() > 0) ? &request->scales[0] : NULL, request->weights.size());
+		else
+			mCL->SetDataWeights(request->data_num, request->weight_set, NULL, NULL, 0);
+
+		request->result.set_value(0);
+		break;
+
+	case CLT_Chi:
+		// Copy the image (or the analytic model) to the buffer, compute the chi values, and initiate a copy to the
+		// local value.
+		SetVisibilitySource();
+		mCL->ImageToChi(request->data_num, request->array, request->array_n);
+		request->result.set_value(0);
+		break;
+
+	case CLT_ChiBatch:
+	case CLT_Chi2Batch:
+	case CLT_LogLikeBatch:
+		// Render and reduce every parameter vector in the batch, signal once at the end.
+		RunBatch(request);
+		request->result.set_value(0);
+		break;
+
+	case CLT_Chi2:
+		// Copy the image into the buffer, compute the chi2, return the value.
+		// TODO: Note the spectral data will need something special here.
+		SetVisibilitySource();
+		request->result.set_value(mCL->ImageToChi2(request->data_num));
+		break;
+
+	case CLT_Flux:
+		// Copy the image to the buffer, compute the flux, return the value.
+		CopyImage();
+		request->result.set_value(mCL->TotalFlux(true));
+		break;
+
+	case CLT_Init:
+		// Init all LibOI routines
+		mCL->Init();
+		mCLInitalized = true;
+		request->result.set_value(0);
+		break;
+
+	case CLT_LogLike:
+		// Copy the image into the buffer, compute the log likelihood, return the value.
+		// TODO: Note the spectral data will need something special here.
+		SetVisibilitySource();
+		request->result.set_value(mCL->ImageToLogLike(request->data_num));
+		break;
+
+	case CLT_Tests:
+		// Runs the LibOI test sequence on the zeroth data set
+		CopyImage();
+		mCL->RunVerification(0);
+		request->result.set_value(0);
+		break;
+
+	case CLT_CopyImage:
+		// Copy the current OpenCL image into the request's CPU buffer
+		CopyImage();
+		mCL->ExportImage(request->array, mImageWidth, mImageHeight, mImageDepth);
+		request->result.set_value(0);
+		break;
+
+	case CLT_SaveImage:
+		// Save the current OpenCL image to the requested file
+		CopyImage();
+		mCL->SaveImage(request->filename);
+		request->result.set_value(0);
+		break;
+
+//        case CLT_GetData:
+//        	mCL->CopyImageToBuffer(0);
+//        	mCL->GetSimulatedData(mCLDataSet, mCLArrayValue, mCLArrayN);
+//        	mCLOpSemaphore.release(1);
+//        	break;
+
+	case CLT_GetChi2_Elements:
+		SetVisibilitySource();
+		mCL->ImageToChi2(request->data_num, request->array, request->array_n);
+		request->result.set_value(0);
+		break;
+	}
+}
+
+/// Reduces the image in the visibility engine's buffer for entry (vector i, data_set) of a
+/// batch request.
+void CCL_GLThread::ReduceBatchItem(CL_GLT_RequestPtr request, unsigned int i, unsigned int data_set)
+{
+	unsigned int n_data_sets = mCL->GetNDataSets();
+	unsigned int offset = i * mCL->GetNDataAllocated();
+
+	switch(request->op)
+	{
+	case CLT_ChiBatch:
+		for(unsigned int j = 0; j < data_set; j++)
+			offset += mCL->GetNDataAllocated(j);
+
+		mCL->ImageToChi(data_set, request->array + offset, mCL->GetNDataAllocated(data_set));
+		break;
+
+	case CLT_Chi2Batch:
+		request->output[i * n_data_sets + data_set] = mCL->ImageToChi2(data_set);
+		break;
+
+	default:
+	case CLT_LogLikeBatch:
+		request->output[i * n_data_sets + data_set] = mCL->ImageToLogLike(data_set);
+		break;
+	}
+}
+
 void CCL_GLThread::RemoveData(int data_num)
 {
-	mCLDataSet = data_num;
-	EnqueueOperation(CLT_DataRemove);
-	mCLOpSemaphore.acquire();
+	CL_GLT_RequestPtr request(new CL_GLT_Request(CLT_DataRemove));
+	request->data_num = data_num;
+	EnqueueRequest(request).get();
 }
 
 /// Replaces the data set in ID old_data_id with new_data
 void CCL_GLThread::ReplaceData(unsigned int old_data_id, const OIDataList & new_data)
 {
-	mCLException = NULL;
+	CL_GLT_RequestPtr request(new CL_GLT_Request(CLT_DataReplace));
+	request->data_num = old_data_id;
+	request->data = new_data;
 
-	mCLDataSet = old_data_id;
-	mCLDataList = new_data;
-	EnqueueOperation(CLT_DataReplace);
-	mCLOpSemaphore.acquire();
+	// Exceptions are passed on to the calling thread by get()
+	EnqueueRequest(request).get();
+}
+
+/// Renders the models into mFBO_storage using the selected render back end.
+/// To be called only by the thread.
+void CCL_GLThread::RenderModels()
+{
+	// Nothing that affects the image has changed since the last render.
+	unsigned int generation = mModelList->GetGeneration();
+	if(generation == mRenderedGeneration)
+		return;
 
-	// Pass any exceptions on to the calling thread
-	if(mCLException)
-		rethrow_exception(mCLException);
+	if(mRenderType == SOFTWARE)
+	{
+		// Rasterize on the CPU, then (unless running headless) upload the image to the storage
+		// texture so that OpenCL and the on-screen display can use it just like an OpenGL render.
+		mModelList->Rasterize(mRasterizer);
+		if(mUseOpenGL)
+			UploadImage(mRasterizer->GetImage());
+	}
+	else
+	{
+		mModelList->Render(mFBO, mImageWidth, mImageHeight);
+		BlitToBuffer(mFBO, mFBO_storage, 0);
+		CCL_GLThread::CheckOpenGLError("CGLThread::RenderModels()");
+	}
+
+	mRenderedGeneration = generation;
+}
+
+/// Renders the models for computation only and refreshes the screen at most once every
+/// mPreviewInterval milliseconds (never if the interval is negative).
+/// To be called only by the thread.
+void CCL_GLThread::RenderOffscreen()
+{
+	// Analytic models are evaluated without an image (see SetVisibilitySource), so only
+	// render them when the screen is to be refreshed.
+	vector<CAnalyticDisk> disks;
+	bool preview = PreviewDue();
+	if(!preview && GetAnalyticModel(disks))
+		return;
+
+	RenderModels();
+	if(preview)
+	{
+		BlitToScreen();
+		mPreviewTimer.restart();
+	}
 }
 
 /// Resets any OpenGL errors by looping.
@@ -598,53 +1014,261 @@ void CCL_GLThread::resizeViewport(int width, int height)
 	}
 }   
 
+/// Evaluates every parameter vector of the current batch against every data set without
+/// returning to the calling thread in between.  The models are left at the last vector.
+/// To be called only by the thread.
+void CCL_GLThread::RunBatch(CL_GLT_RequestPtr request)
+{
+	if(mNWorkers > 1)
+	{
+		RunBatchWorkers(request);
+		return;
+	}
+
+	// Software rendering feeding the CPU engine can overlap the two stages.  Analytic models
+	// are not rendered at all, so there is nothing to overlap.
+	vector<CAnalyticDisk> disks;
+	if(mRasterizer != NULL && mCL->GetType() == CVisibilityEngine::CPU && !GetAnalyticModel(disks))
+	{
+		RunBatchPipelined(request);
+		return;
+	}
+
+	unsigned int n_data_sets = mCL->GetNDataSets();
+	bool time_dependent = mModelList->IsTimeDependent();
+	vector<double> epochs;
+	for(unsigned int data_set = 0; data_set < n_data_sets; data_set++)
+		epochs.push_back(mCL->GetDataAveJD(data_set));
+
+	for(unsigned int i = 0; i < request->n_vectors; i++)
+	{
+		mModelList->SetFreeParameters(request->params + i * request->n_params, request->n_params, request->scale_params);
+		if(time_dependent)
+			mModelList->PrecomputePositions(epochs);
+
+		for(unsigned int data_set = 0; data_set < n_data_sets; data_set++)
+		{
+			// Static scenes are rendered once and reduced against every data set.
+			if(time_dependent || data_set == 0)
+			{
+				mModelList->SetTime(mCL->GetDataAveJD(data_set));
+				RenderOffscreen();
+				SetVisibilitySource();
+			}
+
+			ReduceBatchItem(request, i, data_set);
+		}
+	}
+}
+
+/// Evaluates the current batch with the software rasterizer and CPU visibility engine.  The
+/// images are double buffered: while the visibilities and chi of one epoch (vector, data set)
+/// are computed in the background, the next epoch is rasterized into the other buffer.
+/// To be called only by the thread.
+void CCL_GLThread::RunBatchPipelined(CL_GLT_RequestPtr request)
+{
+	unsigned int n_data_sets = mCL->GetNDataSets();
+	// Static scenes need only one image per parameter vector, reduced against every data set.
+	unsigned int n_images = (mModelList->IsTimeDependent()) ? n_data_sets : 1;
+	unsigned int n_epochs = request->n_vectors * n_images;
+	CRasterizer * buffers[2] = {mRasterizer, mRasterizerBack};
+	vector<double> epochs;
+	future<void> reduction;
+
+	for(unsigned int data_set = 0; data_set < n_data_sets; data_set++)
+		epochs.push_back(mCL->GetDataAveJD(data_set));
+
+	if(n_data_sets == 0)
+		return;
+
+	try
+	{
+		for(unsigned int epoch = 0; epoch < n_epochs; epoch++)
+		{
+			unsigned int i = epoch / n_images;
+			unsigned int data_set = epoch % n_images;
+			unsigned int data_set_end = (n_images == 1) ? n_data_sets : data_set + 1;
+			CRasterizer * rasterizer = buffers[epoch % 2];
+
+			if(data_set == 0)
+			{
+				mModelList->SetFreeParameters(request->params + i * request->n_params, request->n_params, request->scale_params);
+				if(n_images > 1)
+					mModelList->PrecomputePositions(epochs);
+			}
+
+			// Render this epoch while the previous one is being reduced from the other buffer.
+			mModelList->SetTime(mCL->GetDataAveJD(data_set));
+			mModelList->Rasterize(rasterizer);
+
+			if(reduction.valid())
+				reduction.get();
+
+			if(PreviewDue())
+			{
+				UploadImage(rasterizer->GetImage());
+				BlitToScreen();
+				mPreviewTimer.restart();
+			}
+
+			reduction = async(launch::async, [this, request, rasterizer, i, data_set, data_set_end]()
+			{
+				mCL->SetImageSource(rasterizer->GetImage());
+				mCL->CopyImageToBuffer(0);
+				for(unsigned int j = data_set; j < data_set_end; j++)
+					ReduceBatchItem(request, i, j);
+			});
+		}
+
+		if(reduction.valid())
+			reduction.get();
+	}
+	catch(...)
+	{
+		// Wait for the reduction still using a buffer (its result no longer matters), then
+		// restore the front buffer as below before passing the exception on.
+		if(reduction.valid())
+			reduction.wait();
+
+		mRenderedGeneration = 0;
+		SetImageSource();
+		throw;
+	}
+
+	// The front buffer no longer holds the image of the current models.
+	mRenderedGeneration = 0;
+	SetImageSource();
+}
+
+/// Evaluates the current batch by distributing the parameter vectors over the render workers.
+/// Batches queued behind it (e.g. from concurrent minimizers) are evaluated at the same time
+/// and completed here, so that small batches still keep every worker busy.  The models are
+/// left at the last vector of request.  To be called only by the thread.
+void CCL_GLThread::RunBatchWorkers(CL_GLT_RequestPtr request)
+{
+	SyncWorkers();
+
+	vector<CL_GLT_RequestPtr> requests(1, request);
+	TakeQueuedBatches(requests);
+
+	// Every (request, vector) pair is a separate task.
+	vector< pair<unsigned int, unsigned int> > items;
+	for(unsigned int j = 0; j < requests.size(); j++)
+	{
+		for(unsigned int i = 0; i < requests[j]->n_vectors; i++)
+			items.push_back(pair<unsigned int, unsigned int>(j, i));
+	}
+
+	unsigned int n_data_sets = mCL->GetNDataSets();
+	unsigned int n_alloc = mCL->GetNDataAllocated();
+	vector<exception_ptr> exceptions(requests.size());
+	QMutex exception_mutex;
+
+	CThreadPool::TaskFunction task = [&](unsigned int k, unsigned int thread_id)
+	{
+		CL_GLT_RequestPtr batch = requests[items[k].first];
+		unsigned int i = items[k].second;
+		const double * params = batch->params + i * batch->n_params;
+		CRenderWorkerPtr worker = mWorkers[thread_id];
+
+		try
+		{
+			worker->SelectWeights(batch->weight_set);
+
+			switch(batch->op)
+			{
+			case CLT_ChiBatch:
+				worker->GetChi(params, batch->n_params, batch->scale_params, batch->array + i * n_alloc);
+				break;
+
+			case CLT_Chi2Batch:
+				worker->GetChi2(params, batch->n_params, batch->scale_params, batch->output + i * n_data_sets);
+				break;
+
+			default:
+			case CLT_LogLikeBatch:
+				worker->GetLogLike(params, batch->n_params, batch->scale_params, batch->output + i * n_data_sets);
+				break;
+			}
+		}
+		catch(...)
+		{
+			exception_mutex.lock();
+			exceptions[items[k].first] = current_exception();
+			exception_mutex.unlock();
+		}
+	};
+
+	mWorkerPool->ParallelFor(items.size(), task);
+
+	// The additional batches are complete, request is completed by ProcessRequest.
+	for(unsigned int j = 1; j < requests.size(); j++)
+	{
+		if(exceptions[j])
+			requests[j]->result.set_exception(exceptions[j]);
+		else
+			requests[j]->result.set_value(0);
+	}
+
+	if(exceptions[0])
+		rethrow_exception(exceptions[0]);
+
+	if(request->n_vectors > 0)
+	{
+		mModelList->SetFreeParameters(request->params + (request->n_vectors - 1) * request->n_params, request->n_params, request->scale_params);
+	}
+}
+
 /// Run the thread.
 void CCL_GLThread::run()
 {
-	// Claim the OpenGL context.
-    mGLWidget->makeCurrent();
-
 	// ########
-	// OpenGL initialization
+	// OpenGL initialization, skipped when software images go straight to the CPU engine
 	// ########
-	glClearColor(0.0, 0.0, 0.0, 0.0);
-	// Set to flat (non-interpolated) shading:
-	glShadeModel(GL_FLAT);
-	glDisable(GL_DITHER);
-	glEnable(GL_DEPTH_TEST);    // enable the Z-buffer depth testing
+	if(mUseOpenGL)
+	{
+		// Claim the OpenGL context.
+		mGLWidget->makeCurrent();
+
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+		// Set to flat (non-interpolated) shading:
+		glShadeModel(GL_FLAT);
+		glDisable(GL_DITHER);
+		glEnable(GL_DEPTH_TEST);    // enable the Z-buffer depth testing
 
-	// Enable alpha blending:
-	glEnable (GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		// Enable alpha blending:
+		glEnable (GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// Enable multisample anti-aliasing.
-	glEnable(GL_MULTISAMPLE);
-	//glHint(GL_MULTISAMPLE_FILTER_HINT_NV, GL_NICEST);
+		// Enable multisample anti-aliasing.
+		glEnable(GL_MULTISAMPLE);
+		//glHint(GL_MULTISAMPLE_FILTER_HINT_NV, GL_NICEST);
 
-	// Now setup the projection system to be orthographic
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
+		// Now setup the projection system to be orthographic
+		glMatrixMode(GL_PROJECTION);
+		glLoadIdentity();
 
-	// Note, the coordinates here are in object-space, not coordinate space.
-	double half_width = mImageWidth * mScale;
-	glOrtho(-half_width, half_width, -half_width, half_width, -mAreaDepth, mAreaDepth);
+		// Note, the coordinates here are in object-space, not coordinate space.
+		double half_width = mImageWidth * mScale;
+		glOrtho(-half_width, half_width, -half_width, half_width, -mAreaDepth, mAreaDepth);
 
-    // Init the off-screen frame buffers.
-    InitFrameBuffers();
+		// Init the off-screen frame buffers.
+		InitFrameBuffers();
+
+		CCL_GLThread::CheckOpenGLError("Error occurred during GL Thread Initialization.");
+	}
 
     // Start the thread
     mRun = true;
     EnqueueOperation(GLT_RenderModels);
     //EnqueueOperation(GLT_BlitToScreen);
-    CL_GLT_Operations op;
-
-	CCL_GLThread::CheckOpenGLError("Error occurred during GL Thread Initialization.");
+    CL_GLT_RequestPtr request;
 
 	// ########
 	// OpenCL initialization
 	// ########
-	mCL = new CLibOI(CL_DEVICE_TYPE_GPU);
-	mCL->SetImageSource(mFBO_storage_texture, LibOIEnums::OPENGL_TEXTUREBUFFER);
+	mCL = CVisibilityEngine::GetVisibilityEngine(mDefaultEngineType, mThreadPool);
+	SetImageSource();
 	mCL->SetKernelSourcePath(mKernelSourceDir);
 
 	// ########
@@ -657,148 +1281,16 @@ void CCL_GLThread::run()
 	mIsRunning = true;
     while (mRun)
     {
-        op = GetNextOperation();
+        request = GetNextRequest();
 
-        // NOTE: Resize and Render cascade.
-        switch(op)
+        try
         {
-        case GLT_Animate:
-         	mModelList->IncrementTime();
-         	QThread::msleep(40);
-         	EnqueueOperation(GLT_RenderModels);
-         	EnqueueOperation(GLT_Animate);
-         	break;
-
-        case GLT_Resize:
-        	// Resize the screen, then cascade to a render and a blit.
-            glViewport(0, 0, mImageWidth, mImageHeight);
-            glMatrixMode(GL_PROJECTION);
-            glLoadIdentity();
-            half_width = mImageWidth * mScale / 2;
-			glOrtho(-half_width, half_width, -half_width, half_width, -mAreaDepth, mAreaDepth);
-            glMatrixMode(GL_MODELVIEW);
-        	CCL_GLThread::CheckOpenGLError("CGLThread GLT_Resize");
-        	// Now tell OpenCL about the image (depth = 1 because we have only one layer)
-        	mCL->SetImageInfo(mImageWidth, mImageHeight, 1, double(mScale));
-        	mPermitResize = false;
-
-        default:
-        case GLT_RenderModels:
-            // Render the models, then cascade to a blit to screen.
-        	CCL_GLThread::CheckOpenGLError("CGLThread GLT_RenderModels Entry");
-            mModelList->Render(mFBO, mImageWidth, mImageHeight);
-            BlitToBuffer(mFBO, mFBO_storage, 0);
-
-     	case GLT_BlitToScreen:
-			BlitToScreen();
-        	CCL_GLThread::CheckOpenGLError("CGLThread GLT_BlitToScreen");
-			break;
-
-        case GLT_Stop:
-            mRun = false;
-            break;
-
-        case GLT_AnimateStop:
-        	ClearQueue();
-        	EnqueueOperation(GLT_RenderModels);
-        	break;
-
-        case CLT_DataLoadFromString:
-        	mCL->LoadData(mCLString);
-        	mCLOpSemaphore.release(1);
-        	break;
-
-        case CLT_DataLoadFromList:
-        	mCL->LoadData(mCLDataList);
-        	mCLOpSemaphore.release(1);
-        	break;
-
-        case CLT_DataRemove:
-        	mCL->RemoveData(mCLDataSet);
-        	mCLOpSemaphore.release(1);
-        	break;
-
-        case CLT_DataReplace:
-        	try
-        	{
-        		mCL->ReplaceData(mCLDataSet, mCLDataList);
-        	}
-        	catch(...)
-        	{
-        		mCLException = current_exception();
-        	}
-        	mCLOpSemaphore.release(1);
-        	break;
-
-        case CLT_Chi:
-        	// Copy the image to the buffer, compute the chi values, and initiate a copy to the
-        	// local value.
-        	mCL->CopyImageToBuffer(0);
-        	mCL->ImageToChi(mCLDataSet, mCLArrayValue, mCLArrayN);
-        	mCLOpSemaphore.release(1);
-        	break;
-
-        case CLT_Chi2:
-        	// Copy the image into the buffer, compute the chi2, set the value, release the operation semaphore.
-        	// TODO: Note the spectral data will need something special here.
-        	mCL->CopyImageToBuffer(0);
-        	mCLValue = mCL->ImageToChi2(mCLDataSet);
-        	mCLOpSemaphore.release(1);
-        	break;
-
-        case CLT_Flux:
-        	// Copy the image to the buffer, compute the chi values, and initiate a copy to the
-        	// local value.
-        	mCL->CopyImageToBuffer(0);
-        	mCLValue = mCL->TotalFlux(true);
-        	mCLOpSemaphore.release(1);
-        	break;
-
-        case CLT_Init:
-        	// Init all LibOI routines
-        	mCL->Init();
-        	mCLInitalized = true;
-        	break;
-
-        case CLT_LogLike:
-        	// Copy the image into the buffer, compute the chi2, set the value, release the operation semaphore.
-        	// TODO: Note the spectral data will need something special here.
-        	mCL->CopyImageToBuffer(0);
-        	mCLValue = mCL->ImageToLogLike(mCLDataSet);
-        	mCLOpSemaphore.release(1);
-        	break;
-
-        case CLT_Tests:
-        	// Runs the LibOI test sequence on the zeroth data set
-        	mCL->CopyImageToBuffer(0);
-        	mCL->RunVerification(0);
-        	break;
-
-        case CLT_CopyImage:
-        	// Copy the current OpenCL image into the mCLArrayValue CPU buffer
-        	mCL->CopyImageToBuffer(0);
-        	mCL->ExportImage(mCLArrayValue, mImageWidth, mImageHeight, mImageDepth);
-        	mCLOpSemaphore.release(1);
-        	break;
-
-        case CLT_SaveImage:
-        	// Copy the current OpenCL image into the mCLArrayValue CPU buffer
-        	mCL->CopyImageToBuffer(0);
-        	mCL->SaveImage(mCLString);
-        	mCLOpSemaphore.release(1);
-        	break;
-
-//        case CLT_GetData:
-//        	mCL->CopyImageToBuffer(0);
-//        	mCL->GetSimulatedData(mCLDataSet, mCLArrayValue, mCLArrayN);
-//        	mCLOpSemaphore.release(1);
-//        	break;
-
-        case CLT_GetChi2_Elements:
-        	mCL->CopyImageToBuffer(0);
-        	mCL->ImageToChi2(mCLDataSet, mCLArrayValue, mCLArrayN);
-        	mCLOpSemaphore.release(1);
-        	break;
+        	ProcessRequest(request);
+        }
+        catch(...)
+        {
+        	// Pass the exception on to whoever is waiting for this request.
+        	request->result.set_exception(current_exception());
         }
     }
 
@@ -818,17 +1310,75 @@ void CCL_GLThread::Save(string filename)
 
 void CCL_GLThread::SaveImage(string filename)
 {
-	// Enqueue the copy operation, block until it has completed.
-	mCLString = filename;
-	EnqueueOperation(CLT_SaveImage);
-	mCLOpSemaphore.acquire();
+	// Enqueue the save operation, block until it has completed.
+	CL_GLT_RequestPtr request(new CL_GLT_Request(CLT_SaveImage));
+	request->filename = filename;
+	EnqueueRequest(request).get();
 }
 
-/// Sets the scale for the model.
+/// Selects whether all subsequently created CCL_GLThread objects (and their render workers) use
+/// closed-form visibilities for models made only of disks (see CModelList::GetAnalyticDisks).
+/// The choice is fixed for the life of the thread so the likelihood does not change form
+/// during a fit.
+void CCL_GLThread::SetDefaultAnalytic(bool analytic)
+{
+	mDefaultAnalytic = analytic;
+}
+
+/// Sets the number of render workers used by all subsequently created CCL_GLThread objects
+/// to evaluate batches.  Zero or one disables the workers.
+void CCL_GLThread::SetDefaultNWorkers(unsigned int n_workers)
+{
+	mDefaultNWorkers = n_workers;
+}
+
+/// Sets the render back end used by all subsequently created CCL_GLThread objects.
+void CCL_GLThread::SetDefaultRenderType(RenderTypes type)
+{
+	if(type >= OPENGL && type < LAST_VALUE)
+		mDefaultRenderType = type;
+}
+
+/// Sets the visibility engine used by all subsequently created CCL_GLThread objects.
+void CCL_GLThread::SetDefaultVisibilityEngine(CVisibilityEngine::EngineTypes type)
+{
+	if(type >= CVisibilityEngine::OPENCL && type < CVisibilityEngine::LAST_VALUE)
+		mDefaultEngineType = type;
+}
+
+/// Weights the chi elements of data set data_num and scales its amplitudes (see
+/// CVisibilityEngine_CPU::SetDataWeights), empty weights clear the set.  The weights are
+/// used by requests with the same weight_set.  Only available if SupportsDataWeights() is true.
+void CCL_GLThread::SetDataWeights(unsigned int data_num, unsigned int weight_set, const vector<float> & weights, const vector<float> & scales)
+{
+	CL_GLT_RequestPtr request(new CL_GLT_Request(CLT_DataSetWeights));
+	request->data_num = data_num;
+	request->weight_set = weight_set;
+	request->weights = weights;
+	request->scales = scales;
+
+	// Exceptions are passed on to the calling thread by get()
+	EnqueueRequest(request).get();
+}
+
+/// Sets the free parameters of the models.  No render is queued, callers must enqueue
+/// GLT_RenderModels (on-screen) or GLT_RenderOffscreen (computation) as appropriate.
 void CCL_GLThread::SetFreeParameters(double * params, unsigned int n_params, bool scale_params)
 {
 	mModelList->SetFreeParameters(params, n_params, scale_params);
-	EnqueueOperation(GLT_RenderModels);
+}
+
+/// Tells the visibility engine where to find rendered images.  The CPU engine reads
+/// software-rendered images directly from host memory, all other cases use the storage texture.
+/// To be called only by the thread.
+void CCL_GLThread::SetImageSource()
+{
+	if(mRasterizer != NULL && mCL->GetType() == CVisibilityEngine::CPU)
+		mCL->SetImageSource(mRasterizer->GetImage());
+	else
+		mCL->SetImageSource(mFBO_storage_texture);
+
+	mCopiedGeneration = 0;
 }
 
 void CCL_GLThread::SetPositionType(int model_id, CPosition::PositionTypes pos_type)
@@ -859,6 +1409,115 @@ void CCL_GLThread::SetTimestep(double dt)
 	mModelList->SetTimestep(dt);
 }
 
+/// Gives the visibility engine the current models, either in closed form or as an image.
+/// To be called only by the thread.
+void CCL_GLThread::SetVisibilitySource()
+{
+	vector<CAnalyticDisk> disks;
+	if(GetAnalyticModel(disks))
+	{
+		mCL->SetAnalyticModel(disks);
+		mCopiedGeneration = 0;
+		return;
+	}
+
+	CopyImage();
+}
+
+/// Brings the render workers up to date with the models, image geometry and data of this
+/// thread, creating them if necessary.  To be called only by the thread.
+void CCL_GLThread::SyncWorkers()
+{
+	if(mWorkers.size() == 0)
+	{
+		mWorkerPool = new CThreadPool(mNWorkers);
+		for(unsigned int i = 0; i < mWorkerPool->GetNThreads(); i++)
+		{
+			mWorkers.push_back(CRenderWorkerPtr(new CRenderWorker()));
+			mWorkers.back()->SetAnalytic(mAnalytic);
+		}
+	}
+
+	// Workers share the data sets of a CPU visibility engine.  If the main engine is not a
+	// CPU engine, a private copy of the data is loaded once per change.
+	if(mWorkerDataVersion != mDataVersion)
+	{
+		CVisibilityEngine_CPU * source = dynamic_cast<CVisibilityEngine_CPU*>(mCL);
+		if(source == NULL)
+		{
+			delete mWorkerData;
+			mWorkerData = new CVisibilityEngine_CPU(NULL);
+			mWorkerData->SetImageInfo(mImageWidth, mImageHeight, 1, mScale);
+			for(int data_set = 0; data_set < mCL->GetNDataSets(); data_set++)
+				mWorkerData->LoadData(mCL->GetData(data_set));
+
+			source = mWorkerData;
+		}
+
+		for(auto worker : mWorkers)
+			worker->SetData(*source);
+
+		mWorkerDataVersion = mDataVersion;
+		mWorkerState.clear();
+	}
+
+	// The workers set the free parameters for every evaluation, so the models only need to
+	// be copied (which discards the workers' caches) when the layout of the free parameters,
+	// a fixed parameter or the image changes.
+	vector<double> state;
+	mModelList->GetFixedParameters(state);
+	state.push_back(mModelList->GetFreeGeneration());
+	state.push_back(mImageWidth);
+	state.push_back(mImageHeight);
+	state.push_back(mScale);
+	state.push_back(mAreaDepth);
+	if(state == mWorkerState)
+		return;
+
+	mWorkerState = state;
+
+	if(mWorkerData != NULL)
+		mWorkerData->SetImageInfo(mImageWidth, mImageHeight, 1, mScale);
+
+	Json::Value models = mModelList->Serialize();
+	for(auto worker : mWorkers)
+	{
+		worker->SetModels(models, mShaderList);
+		worker->SetImageInfo(mImageWidth, mImageHeight, mScale, mAreaDepth);
+	}
+}
+
+/// Moves the batch requests waiting at the front of the queue into requests.  To be called
+/// only by the thread.
+void CCL_GLThread::TakeQueuedBatches(vector<CL_GLT_RequestPtr> & requests)
+{
+	mQueueMutex.lock();
+	while(mQueue.size() > 0)
+	{
+		CL_GLT_Operations op = mQueue.front()->op;
+		if(op != CLT_ChiBatch && op != CLT_Chi2Batch && op != CLT_LogLikeBatch)
+			break;
+
+		// The semaphore is released after the request is queued.
+		if(!mQueueSemaphore.tryAcquire())
+			break;
+
+		requests.push_back(mQueue.front());
+		mQueue.pop_front();
+	}
+	mQueueMutex.unlock();
+}
+
+/// Uploads a software-rendered image to the storage texture so that OpenCL and the on-screen
+/// display can use it just like an OpenGL render.  To be called only by the thread.
+void CCL_GLThread::UploadImage(const float * image)
+{
+	glBindTexture(GL_TEXTURE_2D, mFBO_storage_texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mImageWidth, mImageHeight, GL_RED, GL_FLOAT, image);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glFinish();
+}
+
 /// Stop the thread.
 void CCL_GLThread::stop()
 {
@@ -46,30 +46,39 @@
 #include <QSize>
 #include <QMutex>
 #include <QSemaphore>
+#include <QTime>
 #include <string>
-#include <queue>
+#include <deque>
+#include <future>
+#include <memory>
 
 #include <GL/gl.h>
 #include <GL/glu.h>
 #include "CModelList.h"
 #include "CGLShaderList.h"
-#include "liboi.hpp"
+#include "CVisibilityEngine.h"
+#include "CRenderWorker.h"
 
 class CGLWidget;
 class CModel;
 class CGLShaderWrapper;
+class CRasterizer;
+class CThreadPool;
+class CVisibilityEngine_CPU;
 
 using namespace std;
-using namespace liboi;
 
 // A list of operations permitted.
 enum CL_GLT_Operations
 {
 	CLT_Chi,
+	CLT_ChiBatch,
 	CLT_Chi2,
+	CLT_Chi2Batch,
 	CLT_CopyImage,
 	CLT_DataRemove,
 	CLT_DataReplace,
+	CLT_DataSetWeights,
 	CLT_DataLoadFromString,
 	CLT_DataLoadFromList,
 	CLT_Flux,
@@ -77,35 +86,65 @@ enum CL_GLT_Operations
 	CLT_GetChi2_Elements,
 	CLT_Init,
 	CLT_LogLike,
+	CLT_LogLikeBatch,
 	CLT_SaveImage,
 	CLT_Tests,
 	GLT_Animate,
 	GLT_AnimateStop,
 	GLT_BlitToScreen,
 	GLT_RenderModels,
+	GLT_RenderOffscreen,
 	GLT_Resize,
 	GLT_Stop
 };
 
-/// A quick class for making priority queue comparisons.  Used for CCL_GLThread, mQueue
-class GLQueueComparision
+/// An operation queued for CCL_GLThread.  Each request carries its own inputs and a promise
+/// through which its result (or exception) is returned, so several requests may be
+/// outstanding at once and callers never share result storage.
+class CL_GLT_Request
 {
 public:
-	GLQueueComparision() {};
+	CL_GLT_Operations op;
+
+	// Inputs (which are used depends on the operation):
+	int data_num;
+	string filename;
+	OIDataList data;
+	vector<float> weights;
+	vector<float> scales;
+	float * array;				// output array for chi values, images, etc.
+	unsigned int array_n;
+	const double * params;		// batched parameter vectors, stored contiguously
+	unsigned int n_vectors;
+	unsigned int n_params;
+	bool scale_params;
+	double * output;			// batched per-data-set results
+	unsigned int weight_set;	// data weights used for chi values, see SetDataWeights
+
+	// The (scalar) result of the operation.
+	promise<double> result;
 
-	bool operator() (const CL_GLT_Operations & lhs, const CL_GLT_Operations & rhs) const
-	{
-		if(rhs == GLT_Stop)
-			return true;
-
-		return false;
-	}
+public:
+	CL_GLT_Request(CL_GLT_Operations op)
+		: op(op), data_num(0), array(NULL), array_n(0), params(NULL), n_vectors(0),
+		  n_params(0), scale_params(false), output(NULL), weight_set(0) {};
 };
 
+typedef shared_ptr<CL_GLT_Request> CL_GLT_RequestPtr;
+
 
 class CCL_GLThread : public QThread {
     Q_OBJECT
 
+public:
+	/// Back ends which may be used to render the models.
+	enum RenderTypes
+	{
+		OPENGL,
+		SOFTWARE,
+		LAST_VALUE	// must be the last value in this list.
+	};
+
 protected:
 
     // Window-related items:
@@ -118,7 +157,7 @@ protected:
     double mScale;
 
     // Queue:
-	priority_queue<CL_GLT_Operations, vector<CL_GLT_Operations>, GLQueueComparision> mQueue;
+	deque<CL_GLT_RequestPtr> mQueue;
     QMutex mQueueMutex;
     QSemaphore mQueueSemaphore;
 
@@ -134,19 +173,41 @@ protected:
 
 	GLsizei mSamples;
 
-    // OpenCL:
-    CLibOI * mCL;
+	// Generation (see CModelList::GetGeneration) of the models in the storage buffer and in
+	// the visibility engine, zero if unknown.
+	unsigned int mRenderedGeneration;
+	unsigned int mCopiedGeneration;
+
+	// Throttled on-screen preview for off-screen (compute-only) renders:
+	int mPreviewInterval;
+	QTime mPreviewTimer;
+
+    // Software rendering:
+    static RenderTypes mDefaultRenderType;
+    RenderTypes mRenderType;
+    CThreadPool * mThreadPool;	// used by the CPU visibility engine
+    CThreadPool * mRasterPool;	// used by the rasterizers
+    CRasterizer * mRasterizer;
+    CRasterizer * mRasterizerBack;	// second image buffer for pipelined batches
+    bool mUseOpenGL;	// false if headless: software images go straight to the CPU engine
+
+    // OpenCL / visibility computations:
+    static CVisibilityEngine::EngineTypes mDefaultEngineType;
+    CVisibilityEngine * mCL;
     string mKernelSourceDir;
     bool mCLInitalized;
-    QSemaphore mCLOpSemaphore;
-    // TODO: We should serialize access to these variables:
-    int mCLDataSet;
-    double mCLValue;
-    float * mCLArrayValue;
-    unsigned int mCLArrayN;
-    string mCLString;
-    OIDataList mCLDataList;
-    exception_ptr mCLException;
+
+    // Render workers which evaluate batches in parallel, only allocated when they are in use:
+    static unsigned int mDefaultNWorkers;
+    unsigned int mNWorkers;
+    static bool mDefaultAnalytic;
+    bool mAnalytic;	// use closed-form visibilities where possible
+    vector<CRenderWorkerPtr> mWorkers;
+    CThreadPool * mWorkerPool;
+    CVisibilityEngine_CPU * mWorkerData;
+    unsigned int mDataVersion;
+    unsigned int mWorkerDataVersion;
+    vector<double> mWorkerState;	// fixed parameters, layout and image last copied to the workers
 
     // Misc datamembers:
 	bool mRun;
@@ -169,13 +230,21 @@ public:
     static void CheckOpenGLError(string function_name);
 protected:
     void ClearQueue();
-
+    void CopyImage();
+    void 	EnqueueBatch(CL_GLT_Operations op, const double * params, unsigned int n_vectors, unsigned int n_params, bool scale_params, float * array, double * output, unsigned int weight_set);
 public:
     void 	EnqueueOperation(CL_GLT_Operations op);
+    future<double> EnqueueRequest(CL_GLT_RequestPtr request);
     void 	ExportResults(string base_filename);
 
+protected:
+	bool 	GetAnalyticModel(vector<CAnalyticDisk> & disks);
+public:
 	void 	GetChi(int data_num, float * output, int & n);
+	void 	GetChiBatch(const double * params, unsigned int n_vectors, unsigned int n_params, bool scale_params, float * output, unsigned int weight_set = 0);
     double GetChi2(int data_num);
+    void 	GetChi2Batch(const double * params, unsigned int n_vectors, unsigned int n_params, bool scale_params, double * output, unsigned int weight_set = 0);
+    void 	GetCalibrationScales(int data_num, double old_diameter, double new_diameter, float * output, unsigned int n);
     OIDataList GetData(unsigned int data_num);
     double GetDataAveJD(int data_num);
     unsigned int GetImageDepth() { return mImageDepth; };
@@ -184,8 +253,11 @@ public:
     unsigned int GetImageHeight() { return mImageHeight; };
     void 	GetImage(float * image, unsigned int width, unsigned int height, unsigned int depth);
 	double GetLogLike(int data_num);
+	void 	GetLogLikeBatch(const double * params, unsigned int n_vectors, unsigned int n_params, bool scale_params, double * output, unsigned int weight_set = 0);
 	CModelList * GetModelList() { return mModelList; };
-    CL_GLT_Operations GetNextOperation(void);
+protected:
+    CL_GLT_RequestPtr GetNextRequest(void);
+public:
 	int 	GetNFreeParameters() { return mModelList->GetNFreeParameters(); };
 	vector< pair<double, double> > GetFreeParamMinMaxes() { return mModelList->GetFreeParamMinMaxes(); };
 	double GetFreeParameterPriorProduct() { return mModelList->GetFreeParameterPriorProduct(); };
@@ -196,6 +268,8 @@ public:
 	int 	GetNDataSets();
 	int		GetNT3(int data_num);
 	int		GetNV2(int data_num);
+	RenderTypes GetRenderType() { return mRenderType; };
+	bool	UsesOpenGL() { return mUseOpenGL; };
 	double GetScale() { return mScale; };
 	vector< pair<CGLShaderList::ShaderTypes, string> > GetShaderNames(void);
 	unsigned int GetImageWidth() { return mImageWidth; };
@@ -212,6 +286,16 @@ protected:
     void 	InitMultisampleRenderBuffer(void);
     void 	InitStorageBuffer(void);
 
+    bool	PreviewDue();
+    void	ProcessRequest(CL_GLT_RequestPtr request);
+
+    void	RenderModels();
+    void	RenderOffscreen();
+    void	ReduceBatchItem(CL_GLT_RequestPtr request, unsigned int i, unsigned int data_set);
+    void	RunBatch(CL_GLT_RequestPtr request);
+    void	RunBatchPipelined(CL_GLT_RequestPtr request);
+    void	RunBatchWorkers(CL_GLT_RequestPtr request);
+
 public:
     int LoadData(string filename);
     int LoadData(const OIDataList & data);
@@ -228,12 +312,29 @@ public:
 
     void Save(string filename);
     void SaveImage(string filename);
+    static void SetDefaultAnalytic(bool analytic);
+    static void SetDefaultNWorkers(unsigned int n_workers);
+    static void SetDefaultRenderType(RenderTypes type);
+    static void SetDefaultVisibilityEngine(CVisibilityEngine::EngineTypes type);
+    void SetDataWeights(unsigned int data_num, unsigned int weight_set, const vector<float> & weights, const vector<float> & scales);
     void SetFreeParameters(double * params, unsigned int n_params, bool scale_params);
+protected:
+    void SetImageSource();
+public:
     void SetPositionType(int model_id, CPosition::PositionTypes pos_type);
+    void SetPreviewInterval(int msec) { mPreviewInterval = msec; };
     void SetScale(double scale);
     void SetShader(int model_id, CGLShaderList::ShaderTypes shader);
     void SetTime(double t);
     void SetTimestep(double dt);
+protected:
+    void SetVisibilitySource();
+public:
+    bool SupportsDataWeights() { return mCL != NULL && mCL->SupportsDataWeights(); };
+protected:
+    void SyncWorkers();
+    void TakeQueuedBatches(vector<CL_GLT_RequestPtr> & requests);
+    void UploadImage(const float * image);
 public:
     void stop();
 
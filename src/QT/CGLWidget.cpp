@@ -235,6 +235,7 @@ void CGLWidget::stopRendering()
 void CGLWidget::SetFreeParameters(double * params, int n_params, bool scale_params)
 {
 	mGLT.SetFreeParameters(params, n_params, scale_params);
+	mGLT.EnqueueOperation(GLT_RenderModels);
 }
 
 void CGLWidget::SetSaveFileBasename(string filename)
@@ -40,9 +40,15 @@
 #endif
 
 #include <iostream>
+#include <stdexcept>
 
 #include "main.h"
 #include "gui_main.h"
+#include "CCL_GLThread.h"
+#include "CMinimizer.h"
+#include "CMinimizer_Bootstrap.h"
+#include "CMinimizer_GridSearch.h"
+#include "CMinimizer_levmar.h"
 
 using namespace std;
 
@@ -56,23 +62,52 @@ int main(int argc, char *argv[])
     //app.setAttribute(Qt::AA_X11InitThreads, true);
 #endif
 
-	// Pass off to the GUI:
-    QApplication app(argc, argv);
-
-    // get the list of command line arguments and parse them.
-    QStringList args = app.arguments();
+    // get the list of command line arguments and parse them.  They are read before the
+    // application is created so that headless runs never connect to a display.
+    QStringList args;
+    for(int i = 0; i < argc; i++)
+    	args.append(QString::fromLocal8Bit(argv[i]));
     QStringList data_files;
     QStringList model_files;
     int minimizer = 0;
+    int renderer = 0;
+    int engine = 0;
+    int n_workers = 0;
+    int jacobian = CMinimizer_levmar::BATCHED;
     int width = 0;
     double scale = 0;
     bool close_simtoi = false;
+    bool resume = false;
+    bool analytic = false;
+    int sweep = CMinimizer_GridSearch::GRID;
+    unsigned long long n_samples = 2500;
+    vector<unsigned int> steps;
 
     // If there were command-line options, parse them
     if(args.size() > 0)
-    	ParseArgs(args, data_files, model_files, minimizer, width, scale, close_simtoi);
+    	ParseArgs(args, data_files, model_files, minimizer, renderer, engine, n_workers, jacobian, width, scale, close_simtoi, resume, sweep, n_samples, steps, analytic);
+
+    // Select the render back end and visibility engine before any rendering threads are created.
+    CCL_GLThread::SetDefaultRenderType(CCL_GLThread::RenderTypes(renderer));
+    CCL_GLThread::SetDefaultVisibilityEngine(CVisibilityEngine::EngineTypes(engine));
+    CCL_GLThread::SetDefaultNWorkers(n_workers);
+    CCL_GLThread::SetDefaultAnalytic(analytic);
+    CMinimizer_levmar::SetDefaultJacobianMode(CMinimizer_levmar::JacobianModes(jacobian));
+    CMinimizer_Bootstrap::SetDefaultResume(resume);
+    CMinimizer_GridSearch::SetDefaultSweepType(CMinimizer_GridSearch::SweepTypes(sweep));
+    CMinimizer_GridSearch::SetDefaultNSamples(n_samples);
+    CMinimizer_GridSearch::SetDefaultSteps(steps);
+
+    // Fits with the software renderer and CPU visibility engine which close SIMTOI when
+    // they complete need neither OpenGL nor a display, so run them without the GUI.
+    bool headless = close_simtoi && width > 0 && scale > 0
+    		&& renderer == CCL_GLThread::SOFTWARE && engine == CVisibilityEngine::CPU;
 
-    // Startup the GUI:
+    QApplication app(argc, argv, !headless);
+    if(headless)
+    	return RunHeadless(data_files, model_files, minimizer, width, scale);
+
+	// Pass off to the GUI:
     gui_main main_window;
     main_window.show();
 
@@ -83,8 +118,58 @@ int main(int argc, char *argv[])
     return app.exec();
 }
 
+/// Loads the data and models, runs the minimizer to completion and returns the exit status.
+/// Requires the software renderer and CPU visibility engine (see CCL_GLThread::UsesOpenGL).
+int RunHeadless(QStringList & data_files, QStringList & model_files, int minimizer, int size, double scale)
+{
+	if(minimizer <= CMinimizer::NONE || minimizer >= CMinimizer::LAST_VALUE)
+	{
+		cout << "Unknown minimizer." << endl;
+		return 1;
+	}
+
+	string app_path = QCoreApplication::applicationDirPath().toStdString();
+	CCL_GLThread thread(NULL, app_path + "/shaders/", app_path + "/kernels/");
+	int status = 0;
+
+	thread.SetScale(scale);
+	thread.resizeViewport(size, size);
+	thread.start();
+
+	try
+	{
+		for(int i = 0; i < data_files.size(); i++)
+			thread.LoadData(data_files[i].toStdString());
+
+		for(int i = 0; i < model_files.size(); i++)
+			thread.Open(model_files[i].toStdString());
+
+		if(thread.GetNData() == 0)
+			throw runtime_error("You must load data before running a minimizer.");
+
+		thread.EnqueueOperation(CLT_Init);
+
+		// Same as CMinimizerThread::run, but on this thread.
+		CMinimizer * tmp = CMinimizer::GetMinimizer(CMinimizer::MinimizerTypes(minimizer), &thread);
+		tmp->Init();
+		tmp->SetSaveFileBasename("/tmp/model");
+		tmp->run();
+		delete tmp;
+	}
+	catch(exception & e)
+	{
+		cout << e.what() << endl;
+		status = 1;
+	}
+
+	thread.stop();
+	thread.wait();
+	return status;
+}
+
 /// Parse the command line arguments splitting them into data files, model files, minimizer names, model area size and model area scale
-void ParseArgs(QStringList args, QStringList & filenames, QStringList & models, int &  minimizer, int & size, double & scale, bool & close_simtoi)
+void ParseArgs(QStringList args, QStringList & filenames, QStringList & models, int &  minimizer, int & renderer, int & engine, int & n_workers, int & jacobian, int & size, double & scale, bool & close_simtoi, bool & resume,
+		int & sweep, unsigned long long & n_samples, vector<unsigned int> & steps, bool & analytic)
 {
 	unsigned int n_items = args.size();
 
@@ -95,6 +180,10 @@ void ParseArgs(QStringList args, QStringList & filenames, QStringList & models,
 	{
 		value = args.at(i).toStdString();
 
+		// closed-form visibilities for disk models
+		if(value == "-a")
+			analytic = true;
+
 		if(value == "-c")
 			close_simtoi = true;
 
@@ -106,13 +195,33 @@ void ParseArgs(QStringList args, QStringList & filenames, QStringList & models,
 		if(value == "-e")
 			minimizer = args.at(i + 1).toInt();
 
+		// grid search sweep
+		if(value == "-g")
+			sweep = args.at(i + 1).toInt();
+
 		if(value == "-h" || value == "-help")
 			PrintHelp();
 
+		// levmar Jacobian method
+		if(value == "-j")
+			jacobian = args.at(i + 1).toInt();
+
 		// model file
 		if(value == "-m")
 			models.append(tmp.absoluteFilePath(args.at(i + 1)));
 
+		// number of render workers
+		if(value == "-n")
+			n_workers = args.at(i + 1).toInt();
+
+		// render back end
+		if(value == "-r")
+			renderer = args.at(i + 1).toInt();
+
+		// resume an interrupted bootstrap from its checkpoint
+		if(value == "-resume")
+			resume = true;
+
 //		if(value == "-o")
 //			savefile.append(tmp.absoluteFilePath(args.at(i + 1)));
 
@@ -120,6 +229,22 @@ void ParseArgs(QStringList args, QStringList & filenames, QStringList & models,
 		if(value == "-s")
 			scale = args.at(i+1).toDouble();
 
+		// grid search samples (Latin hypercube and Sobol sweeps)
+		if(value == "-samples")
+			n_samples = args.at(i + 1).toULongLong();
+
+		// grid search steps, one value or a comma separated value for each free parameter
+		if(value == "-steps")
+		{
+			steps.clear();
+			foreach(QString step, args.at(i + 1).split(","))
+				steps.push_back(step.toUInt());
+		}
+
+		// visibility engine
+		if(value == "-v")
+			engine = args.at(i + 1).toInt();
+
 		// model area width
 		if(value == "-w")
 			size = args.at(i+1).toInt();
@@ -135,19 +260,41 @@ void PrintHelp()
 	cout << endl;
 	cout << "Options:" << endl;
 	cout << "  " << "-h, --help   : " << "Show this help message and exit" << endl;
+	cout << "  " << "-a           : " << "Evaluate models made only of (limb darkened) disks " << endl;
+	cout << "  " << "               " << "with closed-form visibilities instead of images. " << endl;
+	cout << "  " << "               " << "The disks must not overlap [default: off]" << endl;
 	cout << "  " << "-c           : " << "Close SIMTOI after minimization completes [default: off]" << endl;
 	cout << "  " << "-d           : " << "Input OIFITS data file. Specify multiple -d to include " << endl;
 	cout << "  " << "               " << "many data files." << endl;
 	cout << "  " << "-e           : " << "Minimization engine ID (see Wiki or CMinimizer.h)" << endl;
+	cout << "  " << "-g           : " << "Grid search sweep: 0 = grid, 1 = Latin hypercube, " << endl;
+	cout << "  " << "               " << "2 = Sobol sequence [default: 0]" << endl;
+	cout << "  " << "-j           : " << "Levmar Jacobian: 0 = serial finite differences, " << endl;
+	cout << "  " << "               " << "1 = batched finite differences, 2 = Broyden updates " << endl;
+	cout << "  " << "               " << "[default: 1]" << endl;
 	cout << "  " << "-m           : " << "Model input file" << endl;
+	cout << "  " << "-n           : " << "Number of software render workers used to evaluate " << endl;
+	cout << "  " << "               " << "batches in parallel (0 = off) [default: 0]" << endl;
+	cout << "  " << "-r           : " << "Render back end: 0 = OpenGL, 1 = software (CPU) " << endl;
+	cout << "  " << "               " << "[default: 0]" << endl;
+	cout << "  " << "-resume      : " << "Resume an interrupted bootstrap from its checkpoint " << endl;
+	cout << "  " << "               " << "[default: off]" << endl;
 	cout << "  " << "-s           : " << "Scale for model in mas/pixel (float > 0)" << endl;
+	cout << "  " << "-samples     : " << "Number of grid search points for the Latin hypercube " << endl;
+	cout << "  " << "               " << "and Sobol sweeps [default: 2500]" << endl;
+	cout << "  " << "-steps       : " << "Grid search steps along each free parameter, a single " << endl;
+	cout << "  " << "               " << "value or a comma separated list [default: 50]" << endl;
+	cout << "  " << "-v           : " << "Visibility engine: 0 = OpenCL, 1 = CPU [default: 0]" << endl;
 	cout << "  " << "-w           : " << "Width of model area in pixels (int > 0)" << endl;
 	cout << endl;
 	cout << "SIMTOI also supports QT commands. For instance you can run SIMTOI from a: " << endl;
 	cout << "remotely executed script (or from gnu screen) by adding: " << endl;
 	cout << "  " << "-display x:y : " << "Run SIMTOI on display 'y' of the computer named 'x'" << endl;
-	cout << "In all cases, SIMTOI must be executed on a valid display on a computer with a" << endl;
-	cout << "with a video card which supports OpenCL, OpenGL, and OpenCL-OpenGL interop." << endl;
+	cout << "SIMTOI must be executed on a valid display and the computer must have a video " << endl;
+	cout << "card which supports OpenCL, OpenGL, and OpenCL-OpenGL interop, unless the " << endl;
+	cout << "software renderer (-r 1) and CPU visibility engine (-v 1) are selected. " << endl;
+	cout << "Command line fits with -r 1 -v 1 -c run without a display (headless) and " << endl;
+	cout << "save their results to /tmp/model*." << endl;
 	cout << endl;
 	exit(0);
 }
@@ -34,11 +34,14 @@
 #define MAIN_H_
 
 #include <string>
+#include <vector>
 
 using namespace std;
 
 int main(int argc, char** argv);
-void ParseArgs(QStringList args, QStringList & filenames, QStringList & model, int &  minimizer, int & size, double & scale, bool & close_simtoi);
+void ParseArgs(QStringList args, QStringList & filenames, QStringList & model, int &  minimizer, int & renderer, int & engine, int & n_workers, int & jacobian, int & size, double & scale, bool & close_simtoi, bool & resume,
+		int & sweep, unsigned long long & n_samples, vector<unsigned int> & steps, bool & analytic);
 void PrintHelp();
+int RunHeadless(QStringList & data_files, QStringList & model_files, int minimizer, int size, double scale);
 
 #endif /* MAIN_H_ */
@@ -52,8 +52,8 @@ CModelDisk::~CModelDisk()
 	delete[] mCosT;
 }
 
-/// Baseclass routine, draws a cylinder with a top and bottom.
-void CModelDisk::Draw()
+/// Adds a cylinder with a top and bottom to the mesh.
+void CModelDisk::BuildMesh()
 {
 	// Rename a few variables for convenience:
 	const double radius = mParams[mBaseParams + 1] / 2;	// diameter / 2
@@ -66,33 +66,41 @@ void CModelDisk::Draw()
 	DrawDisk(0, radius, -half_height);
 }
 
+/// Draws the model's mesh, rebuilding it first if the shape of the model has changed.
+void CModelDisk::Draw()
+{
+	if(MeshChanged())
+	{
+		mMesh.Clear();
+		BuildMesh();
+	}
+
+	DrawMesh(mMesh);
+}
+
 void CModelDisk::DrawDisk(double radius, double at_z)
 {
 	DrawDisk(0, radius, at_z);
 }
 
-/// Draws a flat (planar) disk
+/// Adds a flat (planar) disk to the mesh
 void CModelDisk::DrawDisk(double r_in, double r_out, double at_z)
 {
     double color = mParams[3];
-    glBegin(GL_QUAD_STRIP);
-
-		if(at_z < 0)
-			glNormal3d( 0.0, 0.0, -1.0 );
-		else
-			glNormal3d(0.0, 0.0, 1.0);
+    double transparency = MidplaneTransparency(r_in);
+    double normal_z = (at_z < 0) ? -1.0 : 1.0;
+    GLuint first = mMesh.GetNVertices();
 
-		for(int j = 0; j <= mSlices; j++ )
-		{
-			glColor4d(color, 0.0, 0.0, MidplaneTransparency(r_in));
-			glVertex3d(mCosT[ j ] * r_in, mSinT[ j ] * r_in, at_z);
-			glVertex3d(mCosT[ j ] * r_out, mSinT[ j ] * r_out ,at_z);
-		}
+	for(int j = 0; j <= mSlices; j++ )
+	{
+		mMesh.AddVertex(mCosT[ j ] * r_in, mSinT[ j ] * r_in, at_z, 0.0, 0.0, normal_z, color, transparency);
+		mMesh.AddVertex(mCosT[ j ] * r_out, mSinT[ j ] * r_out, at_z, 0.0, 0.0, normal_z, color, transparency);
+	}
 
-	glEnd();
+	mMesh.AddQuadStrip(first, 2 * (mSlices + 1));
 }
 
-/// Draws the sides of the disk (cylinder)
+/// Adds the sides of the disk (cylinder) to the mesh
 void CModelDisk::DrawSides(double radius, double total_height)
 {
 	double transparency = 0;
@@ -114,19 +122,18 @@ void CModelDisk::DrawSides(double radius, double total_height)
 
 	while(z0 < half_height)
 	{
-		glColor4d(color, 0.0, 0.0, MidplaneTransparency(radius) * Transparency(half_height, z0));
+		transparency = MidplaneTransparency(radius) * Transparency(half_height, z0);
 		r0 = GetRadius(half_height, z0, zStep, radius);
 		r1 = GetRadius(half_height, z1, zStep, radius);
 
-		// Draw the top half
-		glBegin( GL_QUAD_STRIP );
+		// Add one band of the sides
+		GLuint first = mMesh.GetNVertices();
 		for(int j = 0; j <= mSlices; j++ )
 		{
-			glNormal3d( mCosT[ j ],      mSinT[ j ],      0.0 );
-			glVertex3d( mCosT[ j ] * r0, mSinT[ j ] * r0, z0  );
-			glVertex3d( mCosT[ j ] * r1, mSinT[ j ] * r1 ,z1  );
+			mMesh.AddVertex( mCosT[ j ] * r0, mSinT[ j ] * r0, z0, mCosT[ j ], mSinT[ j ], 0.0, color, transparency);
+			mMesh.AddVertex( mCosT[ j ] * r1, mSinT[ j ] * r1, z1, mCosT[ j ], mSinT[ j ], 0.0, color, transparency);
 		}
-		glEnd( );
+		mMesh.AddQuadStrip(first, 2 * (mSlices + 1));
 
 		z0 = z1;
 		z1 += zStep;
@@ -140,6 +147,18 @@ double CModelDisk::GetRadius(double half_height, double h, double dh, double rim
 	return rim_radius;
 }
 
+/// Returns true (and records the current parameters) if any parameter which affects the
+/// mesh has changed since it was last built.  The rotation is applied when drawing.
+bool CModelDisk::MeshChanged()
+{
+	vector<double> params(mParams + mBaseParams, mParams + mNParams);
+	if(params == mMeshParams)
+		return false;
+
+	mMeshParams.swap(params);
+	return true;
+}
+
 void CModelDisk::InitMembers()
 {
 	// CModel(3) because we have three additional parameters for this model
@@ -171,13 +190,10 @@ void CModelDisk::InitMembers()
 	SetMin(mBaseParams + 2, 0.1);
 }
 
-void CModelDisk::Render(GLuint framebuffer_object, int width, int height)
+void CModelDisk::DrawModel()
 {
 	// NOTE: When rendering assume that the framebuffer has already been cleared.
 
-	// Bind to the framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
-
 	// Rename a few variables for convenience:
 	const double radius = mParams[mBaseParams + 1] / 2;	// diameter / 2
 	const double total_height = mParams[mBaseParams + 2];
@@ -186,9 +202,9 @@ void CModelDisk::Render(GLuint framebuffer_object, int width, int height)
 	double min_xyz[3] = {0, 0, 0};
 	double max_xyz[3] = {radius, radius, half_height};
 
-	glDisable(GL_DEPTH_TEST);
+	DepthTest(false);
 
-	glPushMatrix();
+	PushMatrix();
 		SetupMatrix();
 		Color();
 		UseShader(min_xyz, max_xyz);
@@ -201,12 +217,7 @@ void CModelDisk::Render(GLuint framebuffer_object, int width, int height)
 
 		Draw();
 
-	glPopMatrix();
-
-//	glEnable(GL_DEPTH_TEST);
-
+	PopMatrix();
 
-	// Return to the default framebuffer before leaving.
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	CCL_GLThread::CheckOpenGLError("CModelDisk.Render()");
+//	DepthTest(true);
 }
@@ -39,7 +39,9 @@
 #ifndef CMODELDISK_H_
 #define CMODELDISK_H_
 
+#include <vector>
 #include "CModel.h"
+#include "CMesh.h"
 
 class CModelDisk : public CModel
 {
@@ -51,6 +53,15 @@ protected:
 	double * mCosT;
 	double mZeroThreshold;
 
+	// The geometry is built once and only rebuilt when mParams (other than the rotation)
+	// differ from mMeshParams.
+	CMesh mMesh;
+	vector<double> mMeshParams;
+
+	virtual void BuildMesh();
+	virtual void DrawModel();
+	bool MeshChanged();
+
 public:
 	CModelDisk();
 	CModelDisk(int additional_params);
@@ -68,8 +79,6 @@ public:
 	virtual double MidplaneColor(double radius) { return 1; };
 	virtual double MidplaneTransparency(double radius) { return 1; };
 
-	void Render(GLuint framebuffer_object, int width, int height);
-
 	virtual double Transparency(double half_height, double at_z) { return 1; };
 };
 
@@ -67,6 +67,27 @@ CModelDisk_ConcentricRings::~CModelDisk_ConcentricRings()
 //	// Do nothing here.
 //}
 
+/// Adds the rings to the mesh.
+void CModelDisk_ConcentricRings::BuildMesh()
+{
+	const double r_in  = mParams[mBaseParams + 1];
+	const double r_out = mParams[mBaseParams + 2];
+	const double total_height = mParams[mBaseParams + 3];
+	int n_rings  = ceil(mParams[mBaseParams + 6]);
+
+	if(n_rings < 1)
+		n_rings = 1;
+
+	const double dr = (r_out - r_in) / n_rings;
+
+	// Iterate over the rings, also increment the radius
+	for(double radius = r_in; radius < r_out + dr; radius += dr)
+	{
+		DrawDisk(radius, radius + dr, 0);
+		DrawSides(radius, total_height);
+	}
+}
+
 double CModelDisk_ConcentricRings::MidplaneTransparency(double radius)
 {
 	const double r_in  = mParams[mBaseParams + 1];
@@ -76,31 +97,20 @@ double CModelDisk_ConcentricRings::MidplaneTransparency(double radius)
 	return (1 - pow((radius - r_in) / (r_out - r_in), alpha));
 }
 
-void CModelDisk_ConcentricRings::Render(GLuint framebuffer_object, int width, int height)
+void CModelDisk_ConcentricRings::DrawModel()
 {
-	// Bind to the framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
-
 	// Parameters from CModelDisk_ConcentricRings:
 	const double r_in  = mParams[mBaseParams + 1];
 	const double r_out = mParams[mBaseParams + 2];
 	const double total_height = mParams[mBaseParams + 3];
-	const double alpha = mParams[mBaseParams + 4];
-	const double beta  = mParams[mBaseParams + 5];
-	int n_rings  = ceil(mParams[mBaseParams + 6]);
-
-	if(n_rings < 1)
-		n_rings = 1;
-
-	const double dr = (r_out - r_in) / n_rings;
 	const double half_height = total_height/2;
 
 	double min_xyz[3] = {r_in, r_in, 0};
 	double max_xyz[3] = {r_out, r_out, half_height};
 
-	glDisable(GL_DEPTH_TEST);
+	DepthTest(false);
 
-	glPushMatrix();
+	PushMatrix();
 		SetupMatrix();
 		Color();
 		UseShader(min_xyz, max_xyz);
@@ -111,20 +121,11 @@ void CModelDisk_ConcentricRings::Render(GLuint framebuffer_object, int width, in
 		Translate();
 		Rotate();
 
-		// Iterate over the rings, also increment the radius
-		for(double radius = r_in; radius < r_out + dr; radius += dr)
-		{
-			DrawDisk(radius, radius + dr, 0);
-			DrawSides(radius, total_height);
-		}
-
-	glPopMatrix();
+		Draw();
 
-	glDisable(GL_DEPTH_TEST);
+	PopMatrix();
 
-	// Return to the default framebuffer before leaving.
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	CCL_GLThread::CheckOpenGLError("CModelDisk.Render()");
+	DepthTest(false);
 }
 
 double CModelDisk_ConcentricRings::Transparency(double half_height, double at_z)
@@ -24,6 +24,9 @@
 
 class CModelDisk_ConcentricRings: public CModelDisk
 {
+protected:
+	void BuildMesh();
+	void DrawModel();
 
 public:
 	CModelDisk_ConcentricRings();
@@ -32,8 +35,6 @@ public:
 
 	virtual double MidplaneTransparency(double radius);
 
-	void Render(GLuint framebuffer_object, int width, int height);
-
 	virtual double Transparency(double half_height, double at_z);
 
 //	virtual void SetShader(CGLShaderWrapperPtr shader); // Overrides CModel::SetShader
@@ -32,11 +32,13 @@
  */
 
 #include "CModelSphere.h"
+#include "CAnalyticDisk.h"
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
 #include <cmath>
 #include <float.h>
+#include <vector>
 
 using namespace std;
 
@@ -65,20 +67,22 @@ CModelSphere::~CModelSphere()
 	// TODO Auto-generated destructor stub
 }
 
-void CModelSphere::Render(GLuint framebuffer_object, int width, int height)
+/// A sphere appears as a (limb-darkened) disk, so its visibility has a closed form.
+bool CModelSphere::GetAnalyticDisk(CAnalyticDisk & disk)
 {
-	// NOTE: When rendering assume that the framebuffer has already been cleared.
+	disk.diameter = mParams[mBaseParams + 1];
+	return InitAnalyticDisk(disk);
+}
 
+void CModelSphere::DrawModel()
+{
 	// Rename a few variables for convenience:
 	double radius = float(mParams[mBaseParams + 1] / 2);
 
 	double min_xyz[3] = {0, 0, 0};
 	double max_xyz[3] = {radius, radius, radius};
 
-	// Bind to the framebuffer and draw the sphere.
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
-
-	glPushMatrix();
+	PushMatrix();
 		// All models need to call setup matrix to load the identity, set the model view
 		// and set the correct
 		SetupMatrix();
@@ -96,17 +100,42 @@ void CModelSphere::Render(GLuint framebuffer_object, int width, int height)
 		Rotate();
 
 		// Model defined drawing functions:
-		GLUquadricObj * sphere = gluNewQuadric();
-		gluQuadricDrawStyle( sphere, GLU_FILL);
-		gluQuadricNormals( sphere, GLU_SMOOTH);
-		gluQuadricOrientation( sphere, GLU_OUTSIDE);
-		gluQuadricTexture( sphere, GL_TRUE);
-		gluSphere(sphere, radius, mSlices, mSlices);
-		gluDeleteQuadric(sphere);
-
-	glPopMatrix();
-
-	// Return to the default framebuffer before leaving.
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	CCL_GLThread::CheckOpenGLError("CModelSphere.Render()");
+		DrawSphere(radius);
+
+	PopMatrix();
+}
+
+/// Draws a sphere using the same tessellation as gluSphere (mSlices slices and stacks)
+/// with smooth, outward-facing normals.
+void CModelSphere::DrawSphere(double radius)
+{
+	vector<double> sin_t(mSlices + 1);
+	vector<double> cos_t(mSlices + 1);
+	CircleTable(&sin_t[0], &cos_t[0], mSlices);
+
+	double rho0, rho1;
+	double x0, y0, z0, x1, y1, z1;
+
+	for(int i = 0; i < mSlices; i++)
+	{
+		rho0 = PI * i / mSlices;
+		rho1 = PI * (i + 1) / mSlices;
+
+		Begin(GL_QUAD_STRIP);
+		for(int j = 0; j <= mSlices; j++)
+		{
+			x0 = cos_t[j] * sin(rho0);
+			y0 = sin_t[j] * sin(rho0);
+			z0 = cos(rho0);
+			x1 = cos_t[j] * sin(rho1);
+			y1 = sin_t[j] * sin(rho1);
+			z1 = cos(rho1);
+
+			Normal3d(x0, y0, z0);
+			Vertex3d(x0 * radius, y0 * radius, z0 * radius);
+			Normal3d(x1, y1, z1);
+			Vertex3d(x1 * radius, y1 * radius, z1 * radius);
+		}
+		End();
+	}
 }
@@ -40,13 +40,16 @@ class CModelSphere: public CModel
 protected:
 	int mSlices;
 
+	void DrawModel();
+	void DrawSphere(double radius);
+
 public:
 	CModelSphere();
 	virtual ~CModelSphere();
 
-	double GetMaxHeight();
+	bool GetAnalyticDisk(CAnalyticDisk & disk);
 
-	void Render(GLuint framebuffer_object, int width, int height);
+	double GetMaxHeight();
 };
 
 #endif /* CMODELSPHERE_H_ */